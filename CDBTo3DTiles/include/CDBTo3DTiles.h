@@ -14,6 +14,8 @@ public:
     ~GlobalInitializer() noexcept;
 };
 
+class OutputSink;
+
 class Converter
 {
 public:
@@ -31,12 +33,54 @@ public:
 
     void setElevationThresholdIndices(float elevationThresholdIndices);
 
+    void setNormalQuantizationBits(int normalBits);
+
+    void setPositionQuantizationBits(int positionBits);
+
+    void setUVQuantizationBits(int UVBits);
+
+    void setMeshoptCompression(bool meshoptCompression);
+
+    void setMeshoptFallback(bool meshoptFallback);
+
+    void setOptimizeMeshes(bool optimizeMeshes);
+
+    void setDeduplicateContent(bool deduplicateContent);
+
+    void setGzipOutput(bool gzipOutput);
+
+    void setImplicitTiling(bool implicitTiling);
+
+    void setTightBoundingHeights(bool tightBoundingHeights);
+
+    void setMeasuredGeometricError(bool measuredGeometricError);
+
+    void setGSModelInstancing(bool GSModelInstancing);
+
+    void setGSModelHLODLevel(int GSModelHLODLevel);
+
+    void setModelCacheDirectory(const std::filesystem::path &modelCacheDirectory);
+
+    void setModelTextureMaxSize(int modelTextureMaxSize);
+
+    void setModelTextureByteBudget(size_t modelTextureByteBudget);
+
+    void setExternalTilesetLevel(int externalTilesetLevel);
+
+    void setMaxTilesetByteLength(size_t maxTilesetByteLength);
+
     void convert();
 
 private:
     struct Impl;
     struct TilesetCollection;
 
+    // output sinks aren't part of the public API, so only createConverter() of OutputSink.h writes to one
+    Converter(const std::filesystem::path &CDBPath, std::unique_ptr<OutputSink> outputSink);
+
+    friend std::unique_ptr<Converter> createConverter(const std::filesystem::path &CDBPath,
+                                                      std::unique_ptr<OutputSink> outputSink);
+
     std::unique_ptr<Impl> m_impl;
 };
 } // namespace CDBTo3DTiles
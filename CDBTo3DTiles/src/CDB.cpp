@@ -11,10 +11,11 @@ const std::filesystem::path CDB::TILES = "Tiles";
 const std::filesystem::path CDB::METADATA = "Metadata";
 const std::filesystem::path CDB::GTModel = "GTModel";
 
-CDB::CDB(const std::filesystem::path &path)
-    : m_path{path}
+CDB::CDB(const std::filesystem::path &path, const ModelDiskCache *modelDiskCache)
+    : m_modelDiskCache{modelDiskCache}
+    , m_path{path}
 {
-    m_GTModelCache = CDBGTModelCache(path);
+    m_GTModelCache.emplace(path, modelDiskCache);
 }
 
 void CDB::forEachGeoCell(std::function<void(CDBGeoCell)> process)
@@ -92,7 +93,9 @@ void CDB::forEachGTModelTile(const CDBGeoCell &geoCell, std::function<void(CDBGT
     }
 }
 
-void CDB::forEachGSModelTile(const CDBGeoCell &geoCell, std::function<void(CDBGSModels)> process)
+void CDB::forEachGSModelTile(const CDBGeoCell &geoCell,
+                             std::function<void(CDBGSModels)> process,
+                             bool instanceRepeatedModels)
 {
     std::unordered_map<size_t, CDBTileset> tilesets;
     forEachDatasetTile(geoCell, CDBDataset::GSFeature, [&](const std::filesystem::path &GSFeaturePath) {
@@ -121,8 +124,8 @@ void CDB::forEachGSModelTile(const CDBGeoCell &geoCell, std::function<void(CDBGS
                                  nullptr,
                                  nullptr,
                                  [&](CDBModelsAttributes modelAttribute) {
-                                     auto models = CDBGSModels::createFromModelsAttributes(modelAttribute,
-                                                                                           m_path);
+                                     auto models = CDBGSModels::createFromModelsAttributes(
+                                         modelAttribute, m_path, instanceRepeatedModels, m_modelDiskCache);
                                      if (models) {
                                          process(std::move(*models));
                                      }
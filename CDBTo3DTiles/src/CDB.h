@@ -16,7 +16,8 @@ namespace CDBTo3DTiles {
 class CDB
 {
 public:
-    explicit CDB(const std::filesystem::path &path);
+    // converted models are shared with later conversions through modelDiskCache when there is one
+    explicit CDB(const std::filesystem::path &path, const ModelDiskCache *modelDiskCache = nullptr);
 
     void forEachGeoCell(std::function<void(CDBGeoCell geoCell)> process);
 
@@ -24,7 +25,9 @@ public:
 
     void forEachGTModelTile(const CDBGeoCell &geoCell, std::function<void(CDBGTModels)> process);
 
-    void forEachGSModelTile(const CDBGeoCell &geoCell, std::function<void(CDBGSModels)> process);
+    void forEachGSModelTile(const CDBGeoCell &geoCell,
+                            std::function<void(CDBGSModels)> process,
+                            bool instanceRepeatedModels = false);
 
     void forEachRoadNetworkTile(const CDBGeoCell &geoCell, std::function<void(CDBGeometryVectors)> process);
 
@@ -69,6 +72,7 @@ private:
                             std::function<void(const std::filesystem::path &)> process);
 
     std::optional<CDBGTModelCache> m_GTModelCache;
+    const ModelDiskCache *m_modelDiskCache;
     std::filesystem::path m_path;
 };
 } // namespace CDBTo3DTiles
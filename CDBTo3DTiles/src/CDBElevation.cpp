@@ -36,6 +36,16 @@ CDBElevation::CDBElevation(Mesh uniformGridMesh, size_t gridWidth, size_t gridHe
 
 Mesh CDBElevation::createSimplifiedMesh(size_t targetIndexCount, float targetError) const
 {
+    double simplifiedError;
+    return createSimplifiedMesh(targetIndexCount, targetError, simplifiedError);
+}
+
+Mesh CDBElevation::createSimplifiedMesh(size_t targetIndexCount,
+                                        float targetError,
+                                        double &simplifiedError) const
+{
+    // meshoptimizer reports the error relative to the mesh extents
+    float relativeError = 0.0f;
     std::vector<unsigned int> lod(m_uniformGridMesh.indices.size());
     lod.resize(meshopt_simplify(&lod[0],
                                 m_uniformGridMesh.indices.data(),
@@ -44,7 +54,12 @@ Mesh CDBElevation::createSimplifiedMesh(size_t targetIndexCount, float targetErr
                                 m_uniformGridMesh.positionRTCs.size(),
                                 sizeof(glm::vec3),
                                 targetIndexCount,
-                                targetError));
+                                targetError,
+                                &relativeError));
+    float scale = meshopt_simplifyScale(glm::value_ptr(m_uniformGridMesh.positionRTCs[0]),
+                                        m_uniformGridMesh.positionRTCs.size(),
+                                        sizeof(glm::vec3));
+    simplifiedError = static_cast<double>(relativeError) * static_cast<double>(scale);
 
     Mesh simplified;
     simplified.aabb = AABB();
@@ -97,6 +112,18 @@ Mesh CDBElevation::createSimplifiedMesh(size_t targetIndexCount, float targetErr
     return simplified;
 }
 
+double CDBElevation::computeSampleSpacing() const
+{
+    const auto &positions = m_uniformGridMesh.positions;
+    size_t verticesWidth = m_gridWidth + 1;
+    if (positions.size() <= verticesWidth) {
+        return 0.0;
+    }
+
+    return glm::max(glm::distance(positions[0], positions[1]),
+                    glm::distance(positions[0], positions[verticesWidth]));
+}
+
 void CDBElevation::indexUVRelativeToParent(const CDBTile &parentTile)
 {
     auto parentLevel = parentTile.getLevel();
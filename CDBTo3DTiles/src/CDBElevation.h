@@ -15,6 +15,12 @@ public:
 
     Mesh createSimplifiedMesh(size_t targetIndexCount, float targetError) const;
 
+    // simplifiedError receives the largest deviation in meters of the simplified mesh from the uniform grid
+    Mesh createSimplifiedMesh(size_t targetIndexCount, float targetError, double &simplifiedError) const;
+
+    // distance in meters between neighboring samples of the uniform grid
+    double computeSampleSpacing() const;
+
     inline const Mesh &getUniformGridMesh() const noexcept { return m_uniformGridMesh; }
 
     inline size_t getGridWidth() const noexcept { return m_gridWidth; }
@@ -1,17 +1,31 @@
 #include "CDBModels.h"
 #include "CDB.h"
 #include "Ellipsoid.h"
+#include "MD5.h"
 #include "MathHelpers.h"
+#include "ModelDiskCache.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/epsilon.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "osg/Array"
 #include "osg/Material"
+#include "osgDB/FileNameUtils"
 #include "osgDB/ReadFile"
+#include "osgDB/Registry"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
 #include <unordered_set>
 
 namespace CDBTo3DTiles {
 static TextureFilter convertOsgTexFilter(osg::Texture::FilterMode);
 
+static osgDB::ReaderWriter::ReadResult readArchiveEntry(const ZipArchive &archive,
+                                                        const std::string &entryName,
+                                                        const osgDB::Options *options,
+                                                        bool isImage);
+
 GeometryPrimitiveFunctor::GeometryPrimitiveFunctor(Mesh &mesh)
     : osg::PrimitiveIndexFunctor()
     , m_mesh{mesh}
@@ -153,6 +167,17 @@ void CDBModel3DResult::finalize()
     }
 }
 
+void CDBModel3DResult::setContent(std::vector<Mesh> meshes,
+                                  std::vector<Material> materials,
+                                  std::vector<Texture> textures,
+                                  std::vector<osg::ref_ptr<osg::Image>> images)
+{
+    m_meshes = std::move(meshes);
+    m_materials = std::move(materials);
+    m_textures = std::move(textures);
+    m_images = std::move(images);
+}
+
 void CDBModel3DResult::pushStateSet(osg::StateSet *ss)
 {
     if (ss != nullptr) {
@@ -295,31 +320,62 @@ void CDBModel3DResult::processGeometry(osg::Geometry &geometry, osg::Matrix matr
                                       OSGMatrixVal[15]);
     transform = m_transform * glm::transpose(transform);
 
+    // typed arrays are read straight from their contiguous storage. Other array types go through the value
+    // visitor, which costs a virtual call per element
+    auto &mesh = m_meshes[meshIdx];
+
     // parse positions
     if (vertexArray->getType() == osg::Array::Type::Vec3ArrayType) {
-        for (unsigned i = 0; i < vertexArray->getNumElements(); ++i) {
-            vertexArray->accept(i, valueVisitor);
-            osg::Vec3 pos = valueVisitor.vec3;
-            glm::dvec3 glmWorldPos = transform * glm::dvec4(pos[0], pos[1], pos[2], 1.0);
-            m_meshes[meshIdx].aabb->merge(glmWorldPos);
-            m_meshes[meshIdx].positions.emplace_back(glmWorldPos);
-            m_meshes[meshIdx].batchIDs.emplace_back(m_featureID);
+        unsigned vertexCount = vertexArray->getNumElements();
+        mesh.positions.reserve(mesh.positions.size() + vertexCount);
+        mesh.batchIDs.resize(mesh.batchIDs.size() + vertexCount, static_cast<float>(m_featureID));
+
+        auto positions = dynamic_cast<const osg::Vec3Array *>(vertexArray);
+        if (positions && vertexCount > 0) {
+            const osg::Vec3 *pos = &positions->front();
+            for (unsigned i = 0; i < vertexCount; ++i) {
+                glm::dvec3 glmWorldPos = transform * glm::dvec4(pos[i][0], pos[i][1], pos[i][2], 1.0);
+                mesh.aabb->merge(glmWorldPos);
+                mesh.positions.emplace_back(glmWorldPos);
+            }
+        } else {
+            for (unsigned i = 0; i < vertexCount; ++i) {
+                vertexArray->accept(i, valueVisitor);
+                osg::Vec3 pos = valueVisitor.vec3;
+                glm::dvec3 glmWorldPos = transform * glm::dvec4(pos[0], pos[1], pos[2], 1.0);
+                mesh.aabb->merge(glmWorldPos);
+                mesh.positions.emplace_back(glmWorldPos);
+            }
         }
     }
 
     // parse normal
     auto normalArray = geometry.getNormalArray();
     if (normalArray && normalArray->getType() == osg::Array::Type::Vec3ArrayType) {
+        unsigned normalCount = normalArray->getNumElements();
+        mesh.normals.reserve(mesh.normals.size() + normalCount);
+
         glm::dmat4 normalMatrix = glm::inverse(glm::transpose(transform));
-        for (unsigned i = 0; i < normalArray->getNumElements(); ++i) {
-            normalArray->accept(i, valueVisitor);
-            osg::Vec3 normal = valueVisitor.vec3;
+        auto transformNormal = [&normalMatrix, &mesh](const osg::Vec3 &normal) {
             glm::vec3 glmNormal = normalMatrix * glm::vec4(normal[0], normal[1], normal[2], 0.0);
             if (!glm::epsilonEqual(glm::length(glmNormal), 0.0f, static_cast<float>(Core::Math::EPSILON7))) {
                 glmNormal = glm::normalize(glmNormal);
             }
 
-            m_meshes[meshIdx].normals.emplace_back(glmNormal);
+            mesh.normals.emplace_back(glmNormal);
+        };
+
+        auto normals = dynamic_cast<const osg::Vec3Array *>(normalArray);
+        if (normals && normalCount > 0) {
+            const osg::Vec3 *normal = &normals->front();
+            for (unsigned i = 0; i < normalCount; ++i) {
+                transformNormal(normal[i]);
+            }
+        } else {
+            for (unsigned i = 0; i < normalCount; ++i) {
+                normalArray->accept(i, valueVisitor);
+                transformNormal(valueVisitor.vec3);
+            }
         }
     }
 
@@ -328,19 +384,65 @@ void CDBModel3DResult::processGeometry(osg::Geometry &geometry, osg::Matrix matr
     // It will lead to size mismatch with positions and normals array since we are grouping those meshes that has UV
     // and the ones that don't together. A check for texture in material is used to prevent such case
     auto textureCoordArray = geometry.getTexCoordArray(0);
-    const auto &meshMaterial = m_materials[static_cast<size_t>(m_meshes[meshIdx].material)];
+    const auto &meshMaterial = m_materials[static_cast<size_t>(mesh.material)];
     if (textureCoordArray && meshMaterial.texture != -1) {
-        for (unsigned i = 0; i < textureCoordArray->getNumElements(); ++i) {
-            textureCoordArray->accept(i, valueVisitor);
-            valueVisitor.vec2.y() = 1.0f - valueVisitor.vec2.y();
-            m_meshes[meshIdx].UVs.emplace_back(valueVisitor.vec2[0], valueVisitor.vec2[1]);
+        unsigned UVCount = textureCoordArray->getNumElements();
+        mesh.UVs.reserve(mesh.UVs.size() + UVCount);
+
+        auto UVs = dynamic_cast<const osg::Vec2Array *>(textureCoordArray);
+        if (UVs && UVCount > 0) {
+            const osg::Vec2 *UV = &UVs->front();
+            for (unsigned i = 0; i < UVCount; ++i) {
+                mesh.UVs.emplace_back(UV[i][0], 1.0f - UV[i][1]);
+            }
+        } else {
+            for (unsigned i = 0; i < UVCount; ++i) {
+                textureCoordArray->accept(i, valueVisitor);
+                valueVisitor.vec2.y() = 1.0f - valueVisitor.vec2.y();
+                mesh.UVs.emplace_back(valueVisitor.vec2[0], valueVisitor.vec2[1]);
+            }
         }
     }
 }
 
-CDBGTModelCache::CDBGTModelCache(const std::filesystem::path &CDBPath)
+CDBGTModelCache::CDBGTModelCache(const std::filesystem::path &CDBPath, const ModelDiskCache *diskCache)
     : m_CDBPath{CDBPath}
-{}
+    , m_diskCache{diskCache}
+    , m_hitCount{0}
+    , m_missCount{0}
+{
+    // models are stored in category, subcategory and feature code directories and named after their key
+    auto geometryPath = m_CDBPath / CDB::GTModel
+                        / getCDBDatasetDirectoryName(CDBDataset::GTModelGeometry_500);
+    if (!std::filesystem::is_directory(geometryPath)) {
+        return;
+    }
+
+    for (const auto &A_Category : std::filesystem::directory_iterator(geometryPath)) {
+        if (!A_Category.is_directory()) {
+            continue;
+        }
+
+        for (const auto &B_Subcategory : std::filesystem::directory_iterator(A_Category)) {
+            if (!B_Subcategory.is_directory()) {
+                continue;
+            }
+
+            for (const auto &featureCodeDir : std::filesystem::directory_iterator(B_Subcategory)) {
+                if (!featureCodeDir.is_directory()) {
+                    continue;
+                }
+
+                for (const auto &modelFile : std::filesystem::directory_iterator(featureCodeDir)) {
+                    const auto &modelPath = modelFile.path();
+                    if (modelFile.is_regular_file() && modelPath.extension() == ".flt") {
+                        m_keyToPath.insert({modelPath.stem().string(), modelPath});
+                    }
+                }
+            }
+        }
+    }
+}
 
 const CDBModel3DResult *CDBGTModelCache::locateModel3D(const std::string &FACC,
                                                        const std::string &MODL,
@@ -348,39 +450,111 @@ const CDBModel3DResult *CDBGTModelCache::locateModel3D(const std::string &FACC,
                                                        std::string &modelKey) const
 {
     std::string key = getModelKey(FACC, MODL, FSC);
-    auto model = m_keyToModel.find(key);
-    if (model != m_keyToModel.end()) {
+    auto &entry = getModelEntry(key);
+
+    // threads asking for the same model wait for the one loading it. Models that don't exist or fail to
+    // load stay null
+    bool isLoaded = false;
+    std::call_once(entry.loaded, [&]() {
+        isLoaded = true;
+        auto modelPath = m_keyToPath.find(key);
+        if (modelPath != m_keyToPath.end()) {
+            entry.model = loadModel3D(modelPath->second);
+        }
+    });
+
+    if (isLoaded) {
+        ++m_missCount;
+    } else {
+        ++m_hitCount;
+    }
+
+    if (entry.model) {
         modelKey = key;
-        return &model->second;
-    }
-
-    for (std::filesystem::directory_entry A_Cartegory : std::filesystem::directory_iterator(
-             m_CDBPath / CDB::GTModel / getCDBDatasetDirectoryName(CDBDataset::GTModelGeometry_500))) {
-        if (A_Cartegory.path().filename().string().front() == FACC[0]) {
-            for (std::filesystem::directory_entry B_Subcartegory :
-                 std::filesystem::directory_iterator(A_Cartegory)) {
-                if (B_Subcartegory.path().filename().string().front() == FACC[1]) {
-                    for (std::filesystem::directory_entry featureCodeDir :
-                         std::filesystem::directory_iterator(B_Subcartegory)) {
-                        if (featureCodeDir.path().filename().string().substr(0, 3) == FACC.substr(2, 3)) {
-                            osg::ref_ptr<osg::Node> geometry = osgDB::readRefNodeFile(featureCodeDir.path()
-                                                                                      / (key + ".flt"));
-                            if (geometry) {
-                                CDBModel3DResult model3D;
-                                geometry->accept(model3D);
-                                model3D.finalize();
-                                m_keyToModel.insert({key, std::move(model3D)});
-                                modelKey = key;
-                                return &m_keyToModel[key];
-                            }
-                        }
-                    }
-                }
+    }
+
+    return entry.model.get();
+}
+
+void CDBGTModelCache::prefetchModel3Ds(const std::vector<std::string> &FACCs,
+                                       const std::vector<std::string> &MODLs,
+                                       const std::vector<int> &FSCs,
+                                       ThreadPool &threadPool) const
+{
+    size_t instanceCount = glm::min(FACCs.size(), glm::min(MODLs.size(), FSCs.size()));
+    std::unordered_set<std::string> keys;
+    for (size_t i = 0; i < instanceCount; ++i) {
+        auto key = getModelKey(FACCs[i], MODLs[i], FSCs[i]);
+        if (!keys.insert(key).second) {
+            continue;
+        }
+
+        {
+            std::shared_lock<std::shared_mutex> lock(m_keyToModelMutex);
+            if (m_keyToModel.find(key) != m_keyToModel.end()) {
+                continue;
             }
         }
+
+        threadPool.enqueue([this, &FACC = FACCs[i], &MODL = MODLs[i], FSC = FSCs[i]]() {
+            std::string modelKey;
+            locateModel3D(FACC, MODL, FSC, modelKey);
+        });
     }
 
-    return nullptr;
+    threadPool.wait();
+}
+
+std::unique_ptr<CDBModel3DResult> CDBGTModelCache::loadModel3D(const std::filesystem::path &modelPath) const
+{
+    std::string diskCacheKey;
+    if (m_diskCache) {
+        diskCacheKey = "GTModel:" + ModelDiskCache::createSourceKey(modelPath);
+        auto records = m_diskCache->load(diskCacheKey);
+        if (records && records->size() == 1) {
+            auto &record = records->front();
+            auto model3D = std::make_unique<CDBModel3DResult>();
+            model3D->setContent(std::move(record.meshes),
+                                std::move(record.materials),
+                                std::move(record.textures),
+                                std::move(record.images));
+            return model3D;
+        }
+    }
+
+    osg::ref_ptr<osg::Node> geometry = osgDB::readRefNodeFile(modelPath.string());
+    if (!geometry) {
+        return nullptr;
+    }
+
+    auto model3D = std::make_unique<CDBModel3DResult>();
+    geometry->accept(*model3D);
+    model3D->finalize();
+    if (m_diskCache) {
+        m_diskCache->store(diskCacheKey, {ModelDiskCacheRecord::create(modelPath.stem().string(), *model3D)});
+    }
+
+    return model3D;
+}
+
+CDBGTModelCache::ModelEntry &CDBGTModelCache::getModelEntry(const std::string &key) const
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(m_keyToModelMutex);
+        auto entry = m_keyToModel.find(key);
+        if (entry != m_keyToModel.end()) {
+            return *entry->second;
+        }
+    }
+
+    // entries are never removed, so references to them stay valid after the lock is released
+    std::unique_lock<std::shared_mutex> lock(m_keyToModelMutex);
+    auto &entry = m_keyToModel[key];
+    if (!entry) {
+        entry = std::make_unique<ModelEntry>();
+    }
+
+    return *entry;
 }
 
 std::string CDBGTModelCache::getModelKey(const std::string &FACC, const std::string &MODL, int FCC) const
@@ -416,6 +590,19 @@ const CDBModel3DResult *CDBGTModels::locateModel3D(size_t instanceIdx, std::stri
     return nullptr;
 }
 
+void CDBGTModels::prefetchModel3Ds(ThreadPool &threadPool) const
+{
+    const auto &instancesAttribs = m_attributes->getInstancesAttributes();
+    const auto &stringAttribs = instancesAttribs.getStringAttribs();
+    const auto &integerAttribs = instancesAttribs.getIntegerAttribs();
+    auto FACCs = stringAttribs.find("FACC");
+    auto MODLs = stringAttribs.find("MODL");
+    auto FSCs = integerAttribs.find("FSC");
+    if (FACCs != stringAttribs.end() && MODLs != stringAttribs.end() && FSCs != integerAttribs.end()) {
+        m_cache->prefetchModel3Ds(FACCs->second, MODLs->second, FSCs->second, threadPool);
+    }
+}
+
 std::optional<CDBGTModels> CDBGTModels::createFromModelsAttributes(CDBModelsAttributes attributes,
                                                                    CDBGTModelCache *cache)
 {
@@ -434,35 +621,45 @@ std::optional<CDBGTModels> CDBGTModels::createFromModelsAttributes(CDBModelsAttr
 
 CDBGSModels::CDBGSModels(CDBModelsAttributes modelsAttributes,
                          const CDBTile &GSModelTile,
-                         const osg::ref_ptr<osgDB::Archive> &GSModelArchive,
-                         const osg::ref_ptr<osgDB::Options> &options)
-    : m_GSModelArchive{GSModelArchive}
+                         std::shared_ptr<const ZipArchive> GSModelArchive,
+                         const osg::ref_ptr<osgDB::Options> &options,
+                         bool instanceRepeatedModels,
+                         const ModelDiskCache *diskCache,
+                         const std::string &diskCacheKey)
+    : m_GSModelArchive{std::move(GSModelArchive)}
     , m_tile{GSModelTile}
+    , m_modelsAttributes{std::move(modelsAttributes)}
 {
     m_tileFilename = GSModelTile.getRelativePath().filename().string();
-
-    std::unordered_set<std::string> geometryFilenames;
-    osgDB::Archive::FileNameList fileNameList;
-    if (m_GSModelArchive->getFileNames(fileNameList)) {
-        for (osgDB::Archive::FileNameList::iterator itr = fileNameList.begin(); itr != fileNameList.end();
-             ++itr) {
-            geometryFilenames.insert(*itr);
-        }
+    if (diskCache && loadFromDiskCache(*diskCache, diskCacheKey)) {
+        return;
     }
 
-    Core::Ellipsoid ellipsoid = Core::Ellipsoid::WGS84;
-    const auto &cartographicPositions = modelsAttributes.getCartographicPositions();
-    const auto &orientations = modelsAttributes.getOrientations();
-    const auto &scales = modelsAttributes.getScales();
-    const auto &instancesAttribs = modelsAttributes.getInstancesAttributes();
+    const auto &instancesAttribs = m_modelsAttributes->getInstancesAttributes();
     const auto &stringAttribs = instancesAttribs.getStringAttribs();
     const auto &integerAttribs = instancesAttribs.getIntegerAttribs();
     auto FACCs = stringAttribs.find("FACC");
     auto MODLs = stringAttribs.find("MODL");
     auto FSCs = integerAttribs.find("FSC");
 
-    // extract attributes for this tile only
+    // instances of a tile often share a model, so every archive entry is parsed once. Entries that fail to
+    // parse are kept as null nodes
+    std::unordered_map<std::string, osg::ref_ptr<osg::Node>> parsedNodes;
+
+    // count the instances of every model to find the ones worth instancing
     size_t totalInputInstanceCount = instancesAttribs.getInstancesCount();
+    std::unordered_map<std::string, size_t> modelInstanceCounts;
+    std::unordered_map<std::string, size_t> modelToInstancedModel;
+    if (instanceRepeatedModels) {
+        for (size_t i = 0; i < totalInputInstanceCount; ++i) {
+            std::string modelFilename = getModelFilename(FACCs->second[i], MODLs->second[i], FSCs->second[i]);
+            if (m_GSModelArchive->contains(modelFilename)) {
+                ++modelInstanceCounts[modelFilename];
+            }
+        }
+    }
+
+    // extract attributes for this tile only
     std::vector<size_t> extractedInstances;
     extractedInstances.reserve(totalInputInstanceCount);
     int featureID = 0;
@@ -471,27 +668,37 @@ CDBGSModels::CDBGSModels(CDBModelsAttributes modelsAttributes,
         const auto &MODL = MODLs->second[i];
         int FSC = FSCs->second[i];
         std::string modelFilename = getModelFilename(FACC, MODL, FSC);
-        if (geometryFilenames.find(modelFilename) != geometryFilenames.end()) {
-            auto result = m_GSModelArchive->readNode(modelFilename, options.get());
-            if (result.validNode()) {
-                // combine mesh
-                osg::ref_ptr<osg::Node> node = result.takeNode();
-                glm::dvec3 worldPosition = ellipsoid.cartographicToCartesian(cartographicPositions[i]);
-
-                double orientation = 0.0;
-                if (i < orientations.size()) {
-                    orientation = orientations[i];
+        if (m_GSModelArchive->contains(modelFilename)) {
+            auto parsedNode = parsedNodes.find(modelFilename);
+            if (parsedNode == parsedNodes.end()) {
+                osg::ref_ptr<osg::Node> node;
+                auto result = readArchiveEntry(*m_GSModelArchive, modelFilename, options.get(), false);
+                if (result.validNode()) {
+                    node = result.takeNode();
                 }
 
-                glm::dvec3 scale(1.0f);
-                if (i < scales.size()) {
-                    scale = scales[i];
-                }
+                parsedNode = parsedNodes.insert({modelFilename, node}).first;
+            }
 
-                glm::dmat4 transform = glm::scale(calculateModelOrientation(worldPosition, orientation),
-                                                  scale);
+            const osg::ref_ptr<osg::Node> &node = parsedNode->second;
+            auto instanceCount = modelInstanceCounts.find(modelFilename);
+            if (node && instanceCount != modelInstanceCounts.end() && instanceCount->second > 1) {
+                // repeated models are extracted once in model space and placed by each instance
+                auto instancedModel = modelToInstancedModel.find(modelFilename);
+                if (instancedModel == modelToInstancedModel.end()) {
+                    CDBGSInstancedModel model;
+                    model.name = std::filesystem::path(modelFilename).stem().string();
+                    node->accept(model.model3D);
+                    model.model3D.finalize();
+                    size_t modelIdx = m_instancedModels.size();
+                    m_instancedModels.emplace_back(std::move(model));
+                    instancedModel = modelToInstancedModel.insert({modelFilename, modelIdx}).first;
+                }
 
-                m_model3DResult.setTransformationMatrix(transform);
+                m_instancedModels[instancedModel->second].instances.emplace_back(static_cast<int>(i));
+            } else if (node) {
+                // combine mesh
+                m_model3DResult.setTransformationMatrix(calculateInstanceTransform(i));
                 m_model3DResult.setFeatureID(featureID);
                 node->accept(m_model3DResult);
 
@@ -505,21 +712,42 @@ CDBGSModels::CDBGSModels(CDBModelsAttributes modelsAttributes,
     extractInputInstancesAttribs(extractedInstances, instancesAttribs);
 
     m_model3DResult.finalize();
+
+    if (diskCache) {
+        storeToDiskCache(*diskCache, diskCacheKey, extractedInstances);
+    }
 }
 
-CDBGSModels::~CDBGSModels() noexcept
+glm::dmat4 CDBGSModels::calculateInstanceTransform(size_t instanceIdx) const
 {
-    // OSG doesn't close the archive after ref_ptr is released, so we do it ourselves
-    m_GSModelArchive->close();
+    const auto &ellipsoid = Core::Ellipsoid::WGS84;
+    const auto &cartographicPositions = m_modelsAttributes->getCartographicPositions();
+    const auto &orientations = m_modelsAttributes->getOrientations();
+    const auto &scales = m_modelsAttributes->getScales();
+    glm::dvec3 worldPosition = ellipsoid.cartographicToCartesian(cartographicPositions[instanceIdx]);
+
+    double orientation = 0.0;
+    if (instanceIdx < orientations.size()) {
+        orientation = orientations[instanceIdx];
+    }
+
+    glm::dvec3 scale(1.0f);
+    if (instanceIdx < scales.size()) {
+        scale = scales[instanceIdx];
+    }
+
+    return glm::scale(calculateModelOrientation(worldPosition, orientation), scale);
 }
 
 std::string CDBGSModels::getModelFilename(const std::string &FACC, const std::string &MODL, int FSC) const
 {
-    return "/" + m_tileFilename + "_" + FACC + "_" + toStringWithZeroPadding(3, FSC) + "_" + MODL + ".flt";
+    return m_tileFilename + "_" + FACC + "_" + toStringWithZeroPadding(3, FSC) + "_" + MODL + ".flt";
 }
 
 std::optional<CDBGSModels> CDBGSModels::createFromModelsAttributes(CDBModelsAttributes attributes,
-                                                                   const std::filesystem::path &CDBPath)
+                                                                   const std::filesystem::path &CDBPath,
+                                                                   bool instanceRepeatedModels,
+                                                                   const ModelDiskCache *diskCache)
 {
     const auto &instancesAttribs = attributes.getInstancesAttributes();
     const auto &stringAttribs = instancesAttribs.getStringAttribs();
@@ -546,44 +774,157 @@ std::optional<CDBGSModels> CDBGSModels::createFromModelsAttributes(CDBModelsAttr
         return std::nullopt;
     }
 
-    osgDB::ReaderWriter *rw = osgDB::Registry::instance()->getReaderWriterForExtension("zip");
-    if (rw) {
-        // set relative path for GSModel
-        osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
-        options->setObjectCacheHint(osgDB::Options::CACHE_NONE);
-        options->getDatabasePathList().push_front(GSModelZip.parent_path());
-
-        // find GSModelTexture zip file to search for texture
-        CDBTile GSModelTextureTile = CDBTile(attributeTile.getGeoCell(),
-                                             CDBDataset::GSModelTexture,
-                                             1,
-                                             1,
-                                             attributeTile.getLevel(),
-                                             attributeTile.getUREF(),
-                                             attributeTile.getRREF());
-
-        std::filesystem::path GSModelTextureRelPath = GSModelTextureTile.getRelativePath();
-        std::string GSModelTextureTileName = GSModelTextureRelPath.stem().string();
-        std::filesystem::path GSModelTextureZip = CDBPath / (GSModelTextureRelPath.string() + ".zip");
-        osgDB::ReaderWriter::ReadResult GSModelTextureRead = rw->openArchive(GSModelTextureZip,
-                                                                             osgDB::Archive::READ);
-        if (GSModelTextureRead.validArchive()) {
-            osg::ref_ptr<osgDB::Archive> GSModelTextureArchive = GSModelTextureRead.takeArchive();
+    // set relative path for GSModel
+    osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
+    options->setObjectCacheHint(osgDB::Options::CACHE_NONE);
+    options->getDatabasePathList().push_front(GSModelZip.parent_path());
+
+    // find GSModelTexture zip file to search for texture
+    CDBTile GSModelTextureTile = CDBTile(attributeTile.getGeoCell(),
+                                         CDBDataset::GSModelTexture,
+                                         1,
+                                         1,
+                                         attributeTile.getLevel(),
+                                         attributeTile.getUREF(),
+                                         attributeTile.getRREF());
+
+    std::filesystem::path GSModelTextureRelPath = GSModelTextureTile.getRelativePath();
+    std::string GSModelTextureTileName = GSModelTextureRelPath.stem().string();
+    std::filesystem::path GSModelTextureZip = CDBPath / (GSModelTextureRelPath.string() + ".zip");
+
+    // a damaged archive only loses its own tile, the rest of the dataset is still converted
+    try {
+        if (std::filesystem::exists(GSModelTextureZip)) {
+            auto GSModelTextureArchive = std::make_shared<const ZipArchive>(GSModelTextureZip);
             osg::ref_ptr<FindGSModelTexture> findMissingFile = new FindGSModelTexture(GSModelTextureTileName,
                                                                                       GSModelTextureArchive);
             options->setFindFileCallback(findMissingFile);
             options->setReadFileCallback(findMissingFile);
         }
 
+        std::string diskCacheKey;
+        if (diskCache) {
+            diskCacheKey = createDiskCacheKey(attributes,
+                                              GSModelZip,
+                                              GSModelTextureZip,
+                                              instanceRepeatedModels);
+        }
+
         // read GSModel geometry
-        osgDB::ReaderWriter::ReadResult GSModelRead = rw->openArchive(GSModelZip, osgDB::Archive::READ);
-        if (GSModelRead.validArchive()) {
-            osg::ref_ptr<osgDB::Archive> archive = GSModelRead.takeArchive();
-            return CDBGSModels(std::move(attributes), modelTile, archive, options);
+        auto archive = std::make_shared<const ZipArchive>(GSModelZip);
+        return CDBGSModels(std::move(attributes),
+                           modelTile,
+                           std::move(archive),
+                           options,
+                           instanceRepeatedModels,
+                           diskCache,
+                           diskCacheKey);
+    } catch (const std::exception &e) {
+        OSG_WARN << "Skipping GS model tile " << modelTile.getRelativePath().string() << ": " << e.what()
+                 << std::endl;
+        return std::nullopt;
+    }
+}
+
+bool CDBGSModels::loadFromDiskCache(const ModelDiskCache &diskCache, const std::string &diskCacheKey)
+{
+    auto records = diskCache.load(diskCacheKey);
+    if (!records || records->empty()) {
+        return false;
+    }
+
+    // the first record is the merged model, the others are the instanced models
+    const auto &instancesAttribs = m_modelsAttributes->getInstancesAttributes();
+    size_t totalInputInstanceCount = instancesAttribs.getInstancesCount();
+    for (const auto &record : *records) {
+        for (auto instance : record.instances) {
+            if (instance < 0 || static_cast<size_t>(instance) >= totalInputInstanceCount) {
+                return false;
+            }
         }
     }
 
-    return std::nullopt;
+    auto &mergedRecord = records->front();
+    std::vector<size_t> extractedInstances(mergedRecord.instances.begin(), mergedRecord.instances.end());
+    m_model3DResult.setContent(std::move(mergedRecord.meshes),
+                               std::move(mergedRecord.materials),
+                               std::move(mergedRecord.textures),
+                               std::move(mergedRecord.images));
+
+    for (auto record = records->begin() + 1; record != records->end(); ++record) {
+        CDBGSInstancedModel model;
+        model.name = std::move(record->name);
+        model.instances = std::move(record->instances);
+        model.model3D.setContent(std::move(record->meshes),
+                                 std::move(record->materials),
+                                 std::move(record->textures),
+                                 std::move(record->images));
+        m_instancedModels.emplace_back(std::move(model));
+    }
+
+    extractInputInstancesAttribs(extractedInstances, instancesAttribs);
+
+    return true;
+}
+
+void CDBGSModels::storeToDiskCache(const ModelDiskCache &diskCache,
+                                   const std::string &diskCacheKey,
+                                   const std::vector<size_t> &extractedInstancesIdx) const
+{
+    std::vector<ModelDiskCacheRecord> records;
+    records.reserve(m_instancedModels.size() + 1);
+    records.emplace_back(ModelDiskCacheRecord::create(m_tileFilename,
+                                                      m_model3DResult,
+                                                      std::vector<int>(extractedInstancesIdx.begin(),
+                                                                       extractedInstancesIdx.end())));
+    for (const auto &model : m_instancedModels) {
+        records.emplace_back(ModelDiskCacheRecord::create(model.name, model.model3D, model.instances));
+    }
+
+    diskCache.store(diskCacheKey, records);
+}
+
+std::string CDBGSModels::createDiskCacheKey(const CDBModelsAttributes &attributes,
+                                            const std::filesystem::path &GSModelZip,
+                                            const std::filesystem::path &GSModelTextureZip,
+                                            bool instanceRepeatedModels)
+{
+    // instances are merged by state set across the whole tile, so the tile is cached as a whole and its
+    // entry has to change with the archives and with every instance placement
+    std::string key = "GSModel:" + ModelDiskCache::createSourceKey(GSModelZip);
+    if (std::filesystem::exists(GSModelTextureZip)) {
+        key += ":" + ModelDiskCache::createSourceKey(GSModelTextureZip);
+    }
+
+    if (instanceRepeatedModels) {
+        key += ":instanced";
+    }
+
+    const auto &instancesAttribs = attributes.getInstancesAttributes();
+    const auto &FACCs = instancesAttribs.getStringAttribs().at("FACC");
+    const auto &MODLs = instancesAttribs.getStringAttribs().at("MODL");
+    const auto &FSCs = instancesAttribs.getIntegerAttribs().at("FSC");
+    MD5 md5;
+    auto updateMD5 = [&md5](const void *data, size_t byteLength) {
+        md5.update(reinterpret_cast<const uint8_t *>(data), byteLength);
+    };
+
+    for (size_t i = 0; i < instancesAttribs.getInstancesCount(); ++i) {
+        std::string model = FACCs[i] + "_" + MODLs[i] + "_" + std::to_string(FSCs[i]) + ";";
+        updateMD5(model.data(), model.size());
+    }
+
+    for (const auto &position : attributes.getCartographicPositions()) {
+        double values[] = {position.longitude, position.latitude, position.height};
+        updateMD5(values, sizeof(values));
+    }
+
+    const auto &orientations = attributes.getOrientations();
+    const auto &scales = attributes.getScales();
+    updateMD5(orientations.data(), orientations.size() * sizeof(double));
+    updateMD5(scales.data(), scales.size() * sizeof(glm::vec3));
+
+    return key + ":" + MD5::toHex(md5.finalize());
 }
 
 void CDBGSModels::extractInputInstancesAttribs(const std::vector<size_t> &extractedInstancesIdx,
@@ -632,15 +973,26 @@ void CDBGSModels::extractInputInstancesAttribs(const std::vector<size_t> &extrac
 }
 
 CDBGSModels::FindGSModelTexture::FindGSModelTexture(const std::string &GSModelTextureTileName,
-                                                    osg::ref_ptr<osgDB::Archive> archive)
-    : m_archive{archive}
+                                                    std::shared_ptr<const ZipArchive> archive)
+    : m_archive{std::move(archive)}
     , m_GSModelTextureTileName{GSModelTextureTileName}
-{}
-
-CDBGSModels::FindGSModelTexture::~FindGSModelTexture() noexcept
 {
-    // OSG doesn't close the archive after ref_ptr is released, so we do it ourselves
-    m_archive->close();
+    // index the entries once by their normalized stem, without the tile name in front of them
+    std::string tilePrefix = m_GSModelTextureTileName + "_";
+    for (const auto &entry : m_archive->getEntryNames()) {
+        std::string textureName = entry;
+        if (entry.size() > tilePrefix.size() && entry.compare(0, tilePrefix.size(), tilePrefix) == 0) {
+            textureName = entry.substr(tilePrefix.size());
+        }
+
+        if (!m_textureNameToEntry.insert({textureName, entry}).second) {
+            continue;
+        }
+
+        std::filesystem::path texturePath = normalizeTextureName(textureName);
+        m_stemToTextures[texturePath.stem().string()].emplace_back(
+            ArchiveTexture{textureName, texturePath.extension().string(), entry});
+    }
 }
 
 std::string CDBGSModels::FindGSModelTexture::findDataFile(const std::string &filename,
@@ -653,7 +1005,7 @@ std::string CDBGSModels::FindGSModelTexture::findDataFile(const std::string &fil
     // if not found, try to look into the zip archive and return the texture name that will
     // map to zip entry name. If archive doesn't have it, then return empty string
     if (fileFound.empty()) {
-        return searchArchiveTextureName(filename);
+        return searchArchiveTextureName(filename).value_or("");
     }
 
     return fileFound;
@@ -663,12 +1015,28 @@ osgDB::ReaderWriter::ReadResult CDBGSModels::FindGSModelTexture::readImage(const
                                                                            const osgDB::Options *options)
 {
     // look into archive first
-    auto textureFile = m_archiveEntries.find(filename);
-    if (textureFile != m_archiveEntries.end()) {
-        auto imageRead = m_archive->readImage(textureFile->second, options);
+    auto textureFile = m_textureNameToEntry.find(filename);
+    if (textureFile != m_textureNameToEntry.end()) {
+        // models of an archive often share textures, so each one is decoded once
+        std::lock_guard<std::mutex> lock(m_textureNameToImageMutex);
+        auto decodedImage = m_textureNameToImage.find(filename);
+        if (decodedImage != m_textureNameToImage.end()) {
+            return osgDB::ReaderWriter::ReadResult(decodedImage->second.get());
+        }
+
+        // the image is read from within the model reader, so a damaged entry is reported as a failed read
+        osgDB::ReaderWriter::ReadResult imageRead;
+        try {
+            imageRead = readArchiveEntry(*m_archive, textureFile->second, options, true);
+        } catch (const std::exception &e) {
+            OSG_WARN << "Cannot read texture " << textureFile->second << ": " << e.what() << std::endl;
+            return osgDB::ReaderWriter::ReadResult::ERROR_IN_READING_FILE;
+        }
+
         if (imageRead.validImage()) {
             osg::ref_ptr<osg::Image> image = imageRead.takeImage();
             image->setFileName(textureFile->first);
+            m_textureNameToImage.insert({filename, image});
             return osgDB::ReaderWriter::ReadResult(image);
         }
 
@@ -678,41 +1046,76 @@ osgDB::ReaderWriter::ReadResult CDBGSModels::FindGSModelTexture::readImage(const
     return ReadFileCallback::readImage(filename, options);
 }
 
-std::string CDBGSModels::FindGSModelTexture::searchArchiveTextureName(const std::string &filename)
+std::optional<std::string> CDBGSModels::FindGSModelTexture::searchArchiveTextureName(
+    const std::string &filename) const
 {
     if (!m_archive) {
-        return "";
+        return std::nullopt;
     }
 
-    if (!m_archiveEntries.empty()) {
-        for (const auto &entry : m_archiveEntries) {
-            if (filename.find(entry.first) != std::string::npos) {
-                return entry.first;
+    // the file may be referenced with a different case, path or tile name in front of the texture name, so
+    // look the stem up as a whole first, then without each of its leading "_" separated parts
+    std::filesystem::path texturePath = normalizeTextureName(osgDB::getSimpleFileName(filename));
+    std::string stem = texturePath.stem().string();
+    std::string extension = texturePath.extension().string();
+    size_t stemStart = 0;
+    while (stemStart != std::string::npos) {
+        auto textures = m_stemToTextures.find(stem.substr(stemStart));
+        if (textures != m_stemToTextures.end()) {
+            for (const auto &texture : textures->second) {
+                if (texture.extension == extension) {
+                    return texture.textureName;
+                }
             }
+
+            return textures->second.front().textureName;
         }
 
-        return "";
+        stemStart = stem.find('_', stemStart);
+        if (stemStart != std::string::npos) {
+            ++stemStart;
+        }
     }
 
-    std::string fileFound = "";
-    std::vector<std::string> entryList;
-    if (m_archive->getFileNames(entryList)) {
-        for (const auto &entry : entryList) {
-            std::string textureName;
+    return std::nullopt;
+}
 
-            // +2 is because osg adds separator "/" at the beginning for each entry and there is a separator "_" near the end
-            if (entry.size() > m_GSModelTextureTileName.size() + 2) {
-                textureName = entry.substr(m_GSModelTextureTileName.size() + 2);
-                m_archiveEntries.insert({textureName, entry});
-            }
+std::string CDBGSModels::FindGSModelTexture::normalizeTextureName(const std::string &name)
+{
+    std::string normalized = name;
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
 
-            if (filename.find(textureName) != std::string::npos) {
-                fileFound = textureName;
-            }
-        }
+    return normalized;
+}
+
+osgDB::ReaderWriter::ReadResult readArchiveEntry(const ZipArchive &archive,
+                                                 const std::string &entryName,
+                                                 const osgDB::Options *options,
+                                                 bool isImage)
+{
+    auto extension = osgDB::getLowerCaseFileExtension(entryName);
+    auto readerWriter = osgDB::Registry::instance()->getReaderWriterForExtension(extension);
+    if (!readerWriter) {
+        return osgDB::ReaderWriter::ReadResult::FILE_NOT_HANDLED;
     }
 
-    return fileFound;
+    auto content = archive.readEntry(entryName);
+    if (!content) {
+        return osgDB::ReaderWriter::ReadResult::FILE_NOT_FOUND;
+    }
+
+    // readers that resolve files relative to the one they read look the entry name up in the options
+    osg::ref_ptr<osgDB::Options> entryOptions = options ? options->cloneOptions() : new osgDB::Options();
+    entryOptions->setPluginStringData("STREAM_FILENAME", osgDB::getSimpleFileName(entryName));
+
+    std::istringstream stream(std::move(*content));
+    if (isImage) {
+        return readerWriter->readImage(stream, entryOptions.get());
+    }
+
+    return readerWriter->readNode(stream, entryOptions.get());
 }
 
 } // namespace CDBTo3DTiles
@@ -2,13 +2,24 @@
 
 #include "CDBAttributes.h"
 #include "Scene.h"
+#include "ThreadPool.h"
+#include "ZipArchive.h"
 #include "osg/NodeVisitor"
 #include "osg/StateSet"
-#include "osgDB/Archive"
+#include "osgDB/Options"
+#include "osgDB/ReaderWriter"
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stack>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace CDBTo3DTiles {
+class ModelDiskCache;
+
 class GeometryValueVisitor : public osg::ValueVisitor
 {
 public:
@@ -134,6 +145,12 @@ public:
 
     void finalize();
 
+    // replace the converted content, e.g. with one loaded from a ModelDiskCache
+    void setContent(std::vector<Mesh> meshes,
+                    std::vector<Material> materials,
+                    std::vector<Texture> textures,
+                    std::vector<osg::ref_ptr<osg::Image>> images);
+
     inline const std::vector<Mesh> &getMeshes() const noexcept { return m_meshes; }
 
     inline const std::vector<Material> &getMaterials() const noexcept { return m_materials; }
@@ -170,21 +187,55 @@ private:
     std::vector<osg::ref_ptr<osg::Image>> m_images;
 };
 
+// the GT model library is indexed once on construction. Models are loaded on first use, and models that
+// don't exist or fail to load are remembered so that they are never looked up again. Lookups are safe from
+// any number of threads and each model is loaded by exactly one of them
 class CDBGTModelCache
 {
 public:
-    CDBGTModelCache(const std::filesystem::path &CDBPath);
+    // with a disk cache, converted models are taken from it while their OpenFlight file is unchanged
+    CDBGTModelCache(const std::filesystem::path &CDBPath, const ModelDiskCache *diskCache = nullptr);
 
     const CDBModel3DResult *locateModel3D(const std::string &FACC,
                                           const std::string &MODL,
                                           int FSC,
                                           std::string &modelKey) const;
 
+    // load every model referenced by the instance columns that isn't cached yet on the thread pool, and
+    // block until they are all loaded
+    void prefetchModel3Ds(const std::vector<std::string> &FACCs,
+                          const std::vector<std::string> &MODLs,
+                          const std::vector<int> &FSCs,
+                          ThreadPool &threadPool) const;
+
+    inline size_t getIndexedModelCount() const noexcept { return m_keyToPath.size(); }
+
+    // lookups answered from memory, including the ones for models known to be missing
+    inline size_t getHitCount() const noexcept { return m_hitCount; }
+
+    // lookups that had to load a model or found out that it is missing
+    inline size_t getMissCount() const noexcept { return m_missCount; }
+
 private:
+    struct ModelEntry
+    {
+        std::once_flag loaded;
+        std::unique_ptr<CDBModel3DResult> model;
+    };
+
     std::string getModelKey(const std::string &FACC, const std::string &MODL, int FCC) const;
 
+    ModelEntry &getModelEntry(const std::string &key) const;
+
+    std::unique_ptr<CDBModel3DResult> loadModel3D(const std::filesystem::path &modelPath) const;
+
     std::filesystem::path m_CDBPath;
-    mutable std::map<std::string, CDBModel3DResult> m_keyToModel;
+    const ModelDiskCache *m_diskCache;
+    std::unordered_map<std::string, std::filesystem::path> m_keyToPath;
+    mutable std::shared_mutex m_keyToModelMutex;
+    mutable std::unordered_map<std::string, std::unique_ptr<ModelEntry>> m_keyToModel;
+    mutable std::atomic<size_t> m_hitCount;
+    mutable std::atomic<size_t> m_missCount;
 };
 
 class CDBGTModels
@@ -196,6 +247,9 @@ public:
 
     const CDBModel3DResult *locateModel3D(size_t instanceIdx, std::string &modelKey) const;
 
+    // load the models of all instances in parallel, so that locateModel3D() finds them in the cache
+    void prefetchModel3Ds(ThreadPool &threadPool) const;
+
     static std::optional<CDBGTModels> createFromModelsAttributes(CDBModelsAttributes attributes,
                                                                  CDBGTModelCache *cache);
 
@@ -204,32 +258,55 @@ private:
     std::optional<CDBModelsAttributes> m_attributes;
 };
 
+// model of a GS model tile that is referenced by several instances. Its meshes stay in model space, and
+// the instances index the models attributes of the tile
+struct CDBGSInstancedModel
+{
+    std::string name;
+    CDBModel3DResult model3D;
+    std::vector<int> instances;
+};
+
 class CDBGSModels
 {
 public:
+    // with instanceRepeatedModels, models referenced by more than one instance are kept once in
+    // getInstancedModels() instead of being merged into getModel3D(). With a disk cache, the models of the
+    // tile are taken from the entry of diskCacheKey when there is one, and stored in it otherwise
     explicit CDBGSModels(CDBModelsAttributes modelsAttributes,
                          const CDBTile &tile,
-                         const osg::ref_ptr<osgDB::Archive> &GSModelArchive,
-                         const osg::ref_ptr<osgDB::Options> &options);
-
-    ~CDBGSModels() noexcept;
+                         std::shared_ptr<const ZipArchive> GSModelArchive,
+                         const osg::ref_ptr<osgDB::Options> &options,
+                         bool instanceRepeatedModels = false,
+                         const ModelDiskCache *diskCache = nullptr,
+                         const std::string &diskCacheKey = "");
 
     inline const CDBInstancesAttributes &getInstancesAttributes() const noexcept { return m_attributes; }
 
+    inline const CDBModelsAttributes &getModelsAttributes() const noexcept { return *m_modelsAttributes; }
+
     inline const CDBTile &getTile() const noexcept { return *m_tile; }
 
     inline const CDBModel3DResult &getModel3D() const noexcept { return m_model3DResult; }
 
+    inline const std::vector<CDBGSInstancedModel> &getInstancedModels() const noexcept
+    {
+        return m_instancedModels;
+    }
+
+    // world transform of the instance at the given index of the models attributes
+    glm::dmat4 calculateInstanceTransform(size_t instanceIdx) const;
+
     static std::optional<CDBGSModels> createFromModelsAttributes(CDBModelsAttributes attributes,
-                                                                 const std::filesystem::path &CDBPath);
+                                                                 const std::filesystem::path &CDBPath,
+                                                                 bool instanceRepeatedModels = false,
+                                                                 const ModelDiskCache *diskCache = nullptr);
 
-private:
+    // resolves the textures of the models from the GSModelTexture archive of the tile
     class FindGSModelTexture : public osgDB::FindFileCallback, public osgDB::ReadFileCallback
     {
     public:
-        FindGSModelTexture(const std::string &GSModelTextureTileName, osg::ref_ptr<osgDB::Archive> archive);
-
-        ~FindGSModelTexture() noexcept;
+        FindGSModelTexture(const std::string &GSModelTextureTileName, std::shared_ptr<const ZipArchive> archive);
 
         std::string findDataFile(const std::string &filename,
                                  const osgDB::Options *options,
@@ -238,23 +315,50 @@ private:
         osgDB::ReaderWriter::ReadResult readImage(const std::string &filename,
                                                   const osgDB::Options *options) override;
 
-    private:
-        std::string searchArchiveTextureName(const std::string &filename);
+        // name of the archive texture the file refers to, matched by case insensitive stem and extension
+        std::optional<std::string> searchArchiveTextureName(const std::string &filename) const;
 
-        osg::ref_ptr<osgDB::Archive> m_archive;
-        std::map<std::string, std::string> m_archiveEntries;
+    private:
+        struct ArchiveTexture
+        {
+            std::string textureName;
+            std::string extension;
+            std::string entryName;
+        };
+
+        static std::string normalizeTextureName(const std::string &name);
+
+        std::shared_ptr<const ZipArchive> m_archive;
+        std::unordered_map<std::string, std::vector<ArchiveTexture>> m_stemToTextures;
+        std::unordered_map<std::string, std::string> m_textureNameToEntry;
+        std::unordered_map<std::string, osg::ref_ptr<osg::Image>> m_textureNameToImage;
+        std::mutex m_textureNameToImageMutex;
         std::string m_GSModelTextureTileName;
     };
 
+private:
     void extractInputInstancesAttribs(const std::vector<size_t> &extractedInstancesIdx,
                                       const CDBInstancesAttributes &instancesAttribs);
 
+    bool loadFromDiskCache(const ModelDiskCache &diskCache, const std::string &diskCacheKey);
+
+    void storeToDiskCache(const ModelDiskCache &diskCache,
+                          const std::string &diskCacheKey,
+                          const std::vector<size_t> &extractedInstancesIdx) const;
+
+    static std::string createDiskCacheKey(const CDBModelsAttributes &attributes,
+                                          const std::filesystem::path &GSModelZip,
+                                          const std::filesystem::path &GSModelTextureZip,
+                                          bool instanceRepeatedModels);
+
     std::string getModelFilename(const std::string &FACC, const std::string &MODL, int FSC) const;
 
     std::string m_tileFilename;
     CDBModel3DResult m_model3DResult;
-    osg::ref_ptr<osgDB::Archive> m_GSModelArchive;
+    std::vector<CDBGSInstancedModel> m_instancedModels;
+    std::shared_ptr<const ZipArchive> m_GSModelArchive;
     std::optional<CDBTile> m_tile;
+    std::optional<CDBModelsAttributes> m_modelsAttributes;
     CDBInstancesAttributes m_attributes;
 };
 } // namespace CDBTo3DTiles
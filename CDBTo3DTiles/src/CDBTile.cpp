@@ -38,12 +38,15 @@ CDBTile::CDBTile(CDBGeoCell geoCell, CDBDataset dataset, int CS_1, int CS_2, int
     m_level = level;
     m_UREF = UREF;
     m_RREF = RREF;
+    m_hasContentHeights = false;
+    m_hasReplaceRefinement = false;
     m_region = calcBoundRegion(*m_geoCell, m_level, m_UREF, m_RREF);
     m_path = convertToPath();
 }
 
 CDBTile::CDBTile(const CDBTile &other)
     : m_customContentURI{other.m_customContentURI}
+    , m_geometricError{other.m_geometricError}
     , m_region{other.m_region}
     , m_path{other.m_path}
     , m_geoCell{other.m_geoCell}
@@ -53,12 +56,15 @@ CDBTile::CDBTile(const CDBTile &other)
     , m_level{other.m_level}
     , m_UREF{other.m_UREF}
     , m_RREF{other.m_RREF}
+    , m_hasContentHeights{other.m_hasContentHeights}
+    , m_hasReplaceRefinement{other.m_hasReplaceRefinement}
 {}
 
 CDBTile &CDBTile::operator=(const CDBTile &other)
 {
     if (&other != this) {
         m_customContentURI = other.m_customContentURI;
+        m_geometricError = other.m_geometricError;
         m_region = other.m_region;
         m_path = other.m_path;
         m_geoCell = other.m_geoCell;
@@ -68,6 +74,8 @@ CDBTile &CDBTile::operator=(const CDBTile &other)
         m_level = other.m_level;
         m_UREF = other.m_UREF;
         m_RREF = other.m_RREF;
+        m_hasContentHeights = other.m_hasContentHeights;
+        m_hasReplaceRefinement = other.m_hasReplaceRefinement;
     }
 
     return *this;
@@ -83,6 +91,27 @@ void CDBTile::setCustomContentURI(const std::filesystem::path &customContentURI)
     m_customContentURI = customContentURI;
 }
 
+void CDBTile::setGeometricError(double geometricError) noexcept
+{
+    m_geometricError = geometricError;
+}
+
+void CDBTile::setReplaceRefinement(bool replaceRefinement) noexcept
+{
+    m_hasReplaceRefinement = replaceRefinement;
+}
+
+void CDBTile::includeContentHeights(double minimumHeight, double maximumHeight)
+{
+    if (m_hasContentHeights) {
+        minimumHeight = glm::min(minimumHeight, m_region->getMinimumHeight());
+        maximumHeight = glm::max(maximumHeight, m_region->getMaximumHeight());
+    }
+
+    m_region = Core::BoundingRegion(m_region->getRectangle(), minimumHeight, maximumHeight);
+    m_hasContentHeights = true;
+}
+
 std::string CDBTile::retrieveGeoCellDatasetFromTileName(const CDBTile &tile)
 {
     const auto &geoCell = tile.getGeoCell();
@@ -44,6 +44,23 @@ public:
 
     void setCustomContentURI(const std::filesystem::path &customContentURI) noexcept;
 
+    inline bool hasContentHeights() const noexcept { return m_hasContentHeights; }
+
+    // grow the height range of the bounding region to contain the content. The first range replaces the
+    // default range, which is flat on the ellipsoid
+    void includeContentHeights(double minimumHeight, double maximumHeight);
+
+    inline const std::optional<double> &getGeometricError() const noexcept { return m_geometricError; }
+
+    // error in meters measured from the content. Tiles without it get a geometric error from their depth
+    void setGeometricError(double geometricError) noexcept;
+
+    inline bool hasReplaceRefinement() const noexcept { return m_hasReplaceRefinement; }
+
+    // the content of the tile stands for the content of its descendants, so it is replaced when the tile
+    // refines, whatever the refinement of the rest of the tileset is
+    void setReplaceRefinement(bool replaceRefinement) noexcept;
+
     static std::string retrieveGeoCellDatasetFromTileName(const CDBTile &tile);
 
     static std::optional<CDBTile> createParentTile(const CDBTile &tile);
@@ -86,6 +103,7 @@ private:
 
     std::vector<CDBTile *> m_children;
     std::optional<std::filesystem::path> m_customContentURI;
+    std::optional<double> m_geometricError;
     std::optional<Core::BoundingRegion> m_region;
     std::filesystem::path m_path;
     std::optional<CDBGeoCell> m_geoCell;
@@ -95,6 +113,8 @@ private:
     int m_level;
     int m_UREF;
     int m_RREF;
+    bool m_hasContentHeights;
+    bool m_hasReplaceRefinement;
 };
 } // namespace CDBTo3DTiles
 
@@ -6,6 +6,10 @@ namespace CDBTo3DTiles {
 
 static glm::ivec2 getQuadtreeRelativeChild(const CDBTile &tile, const CDBTile &root);
 
+static void propagateContentHeights(CDBTile &tile);
+
+static void propagateGeometricErrors(CDBTile &tile);
+
 CDBTileset::CDBTileset()
     : m_rootLevel{-10}
     , m_rootUREF{0}
@@ -27,6 +31,15 @@ const CDBTile *CDBTileset::getRoot() const
     return m_tiles.front().get();
 }
 
+CDBTile *CDBTileset::getRoot()
+{
+    if (m_tiles.empty()) {
+        return nullptr;
+    }
+
+    return m_tiles.front().get();
+}
+
 CDBTile *CDBTileset::insertTile(const CDBTile &tile)
 {
     if (tile.getLevel() < m_rootLevel) {
@@ -76,6 +89,47 @@ const CDBTile *CDBTileset::getFitTile(Core::Cartographic cartographic) const
     return getFitTile(root, cartographic);
 }
 
+void CDBTileset::propagateContentHeights()
+{
+    if (!m_tiles.empty()) {
+        CDBTo3DTiles::propagateContentHeights(*m_tiles.front());
+    }
+}
+
+void propagateContentHeights(CDBTile &tile)
+{
+    for (auto child : tile.getChildren()) {
+        if (child) {
+            propagateContentHeights(*child);
+            if (child->hasContentHeights()) {
+                const auto &childRegion = child->getBoundRegion();
+                tile.includeContentHeights(childRegion.getMinimumHeight(), childRegion.getMaximumHeight());
+            }
+        }
+    }
+}
+
+void CDBTileset::propagateGeometricErrors()
+{
+    if (!m_tiles.empty()) {
+        CDBTo3DTiles::propagateGeometricErrors(*m_tiles.front());
+    }
+}
+
+void propagateGeometricErrors(CDBTile &tile)
+{
+    for (auto child : tile.getChildren()) {
+        if (child) {
+            propagateGeometricErrors(*child);
+            const auto &childError = child->getGeometricError();
+            const auto &error = tile.getGeometricError();
+            if (childError && (!error || *error < *childError)) {
+                tile.setGeometricError(*childError);
+            }
+        }
+    }
+}
+
 glm::ivec2 getQuadtreeRelativeChild(const CDBTile &tile, const CDBTile &root)
 {
     double powerOf2 = glm::pow(2, tile.getLevel() - root.getLevel() - 1);
@@ -108,6 +162,20 @@ CDBTile *CDBTileset::insertTileRecursively(const CDBTile &insert, CDBTile *subTr
             subTree->setCustomContentURI(*customContentURI);
         }
 
+        const auto &geometricError = insert.getGeometricError();
+        if (geometricError) {
+            subTree->setGeometricError(*geometricError);
+        }
+
+        if (insert.hasReplaceRefinement()) {
+            subTree->setReplaceRefinement(true);
+        }
+
+        if (insert.hasContentHeights()) {
+            const auto &region = insert.getBoundRegion();
+            subTree->includeContentHeights(region.getMinimumHeight(), region.getMaximumHeight());
+        }
+
         return subTree;
     }
 
@@ -17,10 +17,20 @@ public:
 
     const CDBTile *getRoot() const;
 
+    CDBTile *getRoot();
+
     CDBTile *insertTile(const CDBTile &tile);
 
     const CDBTile *getFitTile(Core::Cartographic cartographic) const;
 
+    // grow the heights of every tile to contain the content heights of its descendants, so that parents
+    // bound their whole subtree
+    void propagateContentHeights();
+
+    // raise the measured geometric error of every tile to the largest one of its descendants, so that
+    // errors never grow when refining
+    void propagateGeometricErrors();
+
 private:
     const CDBTile *getFitTile(const CDBTile *root, Core::Cartographic cartographic) const;
 
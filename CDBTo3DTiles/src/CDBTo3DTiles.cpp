@@ -1,11 +1,21 @@
 #include "CDBTo3DTiles.h"
 #include "CDB.h"
+#include "GSModelHLOD.h"
 #include "Gltf.h"
+#include "MD5.h"
 #include "MathHelpers.h"
+#include "ModelDiskCache.h"
+#include "OutputSink.h"
 #include "TileFormatIO.h"
 #include "cpl_conv.h"
+#include "cpl_vsi.h"
 #include "gdal.h"
-#include "osgDB/WriteFile"
+#include "osgDB/FileNameUtils"
+#include "osgDB/Registry"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -16,20 +26,41 @@ struct Converter::TilesetCollection
     std::unordered_map<size_t, CDBTileset> CSToTilesets;
 };
 
+// model texture to resample and encode, away from the converter state
+struct ModelTextureTask
+{
+    std::string key;
+    std::filesystem::path outputPath;
+    osg::ref_ptr<osg::Image> image;
+    osgDB::ReaderWriter *readerWriter;
+    int width;
+    int height;
+    std::string encodedTexture;
+    bool isEncoded;
+};
+
+static void encodeModelTexture(ModelTextureTask &task);
+
 struct Converter::Impl
 {
-    Impl(const std::filesystem::path &cdbInputPath, const std::filesystem::path &output)
+    Impl(const std::filesystem::path &cdbInputPath, std::unique_ptr<OutputSink> sink)
         : elevationNormal{false}
         , elevationLOD{false}
         , elevationDecimateError{0.01f}
         , elevationThresholdIndices{0.3f}
+        , deduplicateContent{false}
+        , gzipOutput{false}
+        , implicitTiling{false}
+        , tightBoundingHeights{false}
+        , measuredGeometricError{false}
+        , GSModelInstancing{false}
+        , GSModelHLODLevel{std::nullopt}
+        , modelCacheDirectory{std::nullopt}
+        , modelTextureMaxSize{std::nullopt}
+        , modelTextureByteBudget{0}
         , cdbPath{cdbInputPath}
-        , outputPath{output}
-    {
-        if (std::filesystem::exists(output)) {
-            std::filesystem::remove_all(output);
-        }
-    }
+        , outputSink{std::move(sink)}
+    {}
 
     void flushTilesetCollection(const CDBGeoCell &geoCell,
                                 std::unordered_map<CDBGeoCell, TilesetCollection> &tilesetCollections,
@@ -65,7 +96,15 @@ struct Converter::Impl
 
     void generateElevationNormal(Mesh &simplifed);
 
-    Texture createImageryTexture(CDBImagery &imagery, const std::filesystem::path &tilesetDirectory) const;
+    void includeContentHeights(const std::vector<glm::dvec3> &positions, CDBTile &cdbTile) const;
+
+    static double computeLargestFeatureSize(const std::vector<Mesh> &meshes);
+
+    static double computeModelRadius(const CDBModel3DResult &model3D,
+                                     const std::vector<glm::vec3> &scales,
+                                     size_t i);
+
+    Texture createImageryTexture(CDBImagery &imagery, const std::filesystem::path &tilesetDirectory);
 
     void addVectorToTilesetCollection(const CDBGeometryVectors &vectors,
                                       const std::filesystem::path &collectionOutputDirectory,
@@ -76,10 +115,35 @@ struct Converter::Impl
                                            const std::filesystem::path &textureSubDir,
                                            const std::filesystem::path &gltfPath);
 
+    // sizes that model textures are resampled to, so that none exceeds the maximum size and together they
+    // fit in the byte budget
+    std::vector<glm::ivec2> computeModelTextureSizes(
+        const std::vector<osg::ref_ptr<osg::Image>> &images) const;
+
     void addGTModelToTilesetCollection(const CDBGTModels &model, const std::filesystem::path &outputDirectory);
 
     void addGSModelToTilesetCollection(const CDBGSModels &model, const std::filesystem::path &outputDirectory);
 
+    void addGSModelHLODContent(const CDBGSModels &model);
+
+    // generate the simplified content of every GS model tile without models of its own, from the root level
+    // of the HLOD down to the stored models
+    void createGSModelHLOD(const CDBGeoCell &geoCell);
+
+    void createGSModelHLOD(CDBTile &tile, const std::filesystem::path &tilesetDirectory, CDBTileset &tileset);
+
+    void coarsenGSModelHLODContent(GSModelHLODContent &content);
+
+    // URIs in tile content are relative to the tileset directory, but implicit tiling moves the content of
+    // positive levels into sub directories
+    std::string getContentRelativeURI(const std::filesystem::path &uri, const CDBTile &cdbTile) const;
+
+    // write the content unless the same bytes were already written, and return the path that holds them.
+    // Content referencing other files by relative URI is only shared within the same directory
+    std::filesystem::path writeUniqueContent(const std::filesystem::path &path,
+                                             const TileWriter &content,
+                                             bool hasRelativeURIs = false);
+
     void createB3DMForTileset(tinygltf::Model &model,
                               CDBTile cdbTile,
                               const CDBInstancesAttributes *instancesAttribs,
@@ -105,19 +169,39 @@ struct Converter::Impl
     static const std::string HYDROGRAPHY_NETWORK_PATH;
     static const std::string GTMODEL_PATH;
     static const std::string GSMODEL_PATH;
+    static const int IMPLICIT_SUBTREE_LEVELS;
+    static const float GS_MODEL_HLOD_INDEX_RATIO;
+    static const float GS_MODEL_HLOD_TARGET_ERROR;
     static const std::unordered_set<std::string> DATASET_PATHS;
 
     bool elevationNormal;
     bool elevationLOD;
     float elevationDecimateError;
     float elevationThresholdIndices;
+    bool deduplicateContent;
+    bool gzipOutput;
+    bool implicitTiling;
+    bool tightBoundingHeights;
+    bool measuredGeometricError;
+    bool GSModelInstancing;
+    std::optional<int> GSModelHLODLevel;
+    std::optional<std::filesystem::path> modelCacheDirectory;
+    std::optional<int> modelTextureMaxSize;
+    size_t modelTextureByteBudget;
+    TilesetJsonSplit tilesetJsonSplit;
+    GltfOptions gltfOptions;
     std::filesystem::path cdbPath;
-    std::filesystem::path outputPath;
-    std::vector<std::filesystem::path> defaultDatasetToCombine;
+    std::unique_ptr<OutputSink> outputSink;
+    std::vector<std::pair<std::filesystem::path, Core::BoundingRegion>> defaultDatasetToCombine;
     std::vector<std::vector<std::string>> requestedDatasetToCombine;
-    std::unordered_set<std::string> processedModelTextures;
+    std::unordered_map<std::string, std::filesystem::path> processedModelTextures;
+    std::unordered_map<std::string, std::filesystem::path> contentToPath;
     std::unordered_map<CDBTile, Texture> processedParentImagery;
     std::unordered_map<std::string, std::filesystem::path> GTModelsToGltf;
+    std::unique_ptr<ThreadPool> GTModelLoadingPool;
+    std::unique_ptr<ThreadPool> modelTexturePool;
+    std::unordered_map<CDBTile, GSModelHLODContent> GSModelHLODContents;
+    std::unordered_map<std::string, osg::ref_ptr<osg::Image>> GSModelHLODImages;
     std::unordered_map<CDBGeoCell, TilesetCollection> elevationTilesets;
     std::unordered_map<CDBGeoCell, TilesetCollection> roadNetworkTilesets;
     std::unordered_map<CDBGeoCell, TilesetCollection> railRoadNetworkTilesets;
@@ -134,6 +218,9 @@ const std::string Converter::Impl::POWERLINE_NETWORK_PATH = "PowerlineNetwork";
 const std::string Converter::Impl::HYDROGRAPHY_NETWORK_PATH = "HydrographyNetwork";
 const std::string Converter::Impl::GTMODEL_PATH = "GTModels";
 const std::string Converter::Impl::GSMODEL_PATH = "GSModels";
+const int Converter::Impl::IMPLICIT_SUBTREE_LEVELS = 6;
+const float Converter::Impl::GS_MODEL_HLOD_INDEX_RATIO = 0.25f;
+const float Converter::Impl::GS_MODEL_HLOD_TARGET_ERROR = 0.02f;
 const std::unordered_set<std::string> Converter::Impl::DATASET_PATHS = {ELEVATIONS_PATH,
                                                                         ROAD_NETWORK_PATH,
                                                                         RAILROAD_NETWORK_PATH,
@@ -149,27 +236,49 @@ void Converter::Impl::flushTilesetCollection(
 {
     auto geoCellCollectionIt = tilesetCollections.find(geoCell);
     if (geoCellCollectionIt != tilesetCollections.end()) {
-        const auto &tilesetCollection = geoCellCollectionIt->second;
+        auto &tilesetCollection = geoCellCollectionIt->second;
         const auto &CSToPaths = tilesetCollection.CSToPaths;
-        for (const auto &CSTotileset : tilesetCollection.CSToTilesets) {
-            const auto &tileset = CSTotileset.second;
+        for (auto &CSTotileset : tilesetCollection.CSToTilesets) {
+            auto &tileset = CSTotileset.second;
             auto root = tileset.getRoot();
             if (!root) {
                 continue;
             }
 
+            if (tightBoundingHeights) {
+                tileset.propagateContentHeights();
+            }
+
+            if (measuredGeometricError) {
+                tileset.propagateGeometricErrors();
+            }
+
             auto tilesetDirectory = CSToPaths.at(CSTotileset.first);
             auto tilesetJsonPath = tilesetDirectory
                                    / (CDBTile::retrieveGeoCellDatasetFromTileName(*root) + ".json");
 
             // write to tileset.json file
-            std::ofstream fs(tilesetJsonPath);
-            writeToTilesetJson(tileset, replace, fs);
+            std::ostringstream tilesetJson;
+            if (implicitTiling) {
+                std::map<std::filesystem::path, TileWriter> subtrees;
+                writeToImplicitTilesetJson(tileset, replace, IMPLICIT_SUBTREE_LEVELS, tilesetJson, subtrees);
+                for (const auto &subtree : subtrees) {
+                    outputSink->write(tilesetDirectory / subtree.first, subtree.second);
+                }
+            } else if (tilesetJsonSplit.isEnabled()) {
+                std::map<std::filesystem::path, std::string> externalTilesets;
+                writeToTilesetJson(tileset, replace, tilesetJsonSplit, tilesetJson, externalTilesets);
+                for (const auto &externalTileset : externalTilesets) {
+                    outputSink->write(tilesetDirectory / externalTileset.first, externalTileset.second);
+                }
+            } else {
+                writeToTilesetJson(tileset, replace, tilesetJson);
+            }
+
+            outputSink->write(tilesetJsonPath, tilesetJson.str());
 
             // add tileset json path to be combined later for multiple geocell
-            // remove the output root path to become relative path
-            tilesetJsonPath = std::filesystem::relative(tilesetJsonPath, outputPath);
-            defaultDatasetToCombine.emplace_back(tilesetJsonPath);
+            defaultDatasetToCombine.emplace_back(tilesetJsonPath, root->getBoundRegion());
         }
 
         tilesetCollections.erase(geoCell);
@@ -246,15 +355,27 @@ void Converter::Impl::addElevationToTileset(CDBElevation &elevation,
     size_t targetIndexCount = static_cast<size_t>(static_cast<float>(mesh.indices.size())
                                                   * elevationThresholdIndices);
     float targetError = elevationDecimateError;
-    Mesh simplifed = elevation.createSimplifiedMesh(targetIndexCount, targetError);
+    double simplifiedError = 0.0;
+    Mesh simplifed = elevation.createSimplifiedMesh(targetIndexCount, targetError, simplifiedError);
     if (simplifed.positionRTCs.empty()) {
         simplifed = mesh;
+        simplifiedError = 0.0;
     }
 
     if (elevationNormal) {
         generateElevationNormal(simplifed);
     }
 
+    CDBTile contentTile = cdbTile;
+    if (tightBoundingHeights) {
+        includeContentHeights(simplifed.positions, contentTile);
+    }
+
+    // the tile misses whatever the simplifier removed and all the detail between its samples
+    if (measuredGeometricError) {
+        contentTile.setGeometricError(simplifiedError + elevation.computeSampleSpacing());
+    }
+
     // create material for mesh if there are imagery
     if (imagery) {
         Material material;
@@ -263,11 +384,13 @@ void Converter::Impl::addElevationToTileset(CDBElevation &elevation,
         material.texture = 0;
         simplifed.material = 0;
 
-        tinygltf::Model gltf = createGltf(simplifed, &material, imagery);
-        createB3DMForTileset(gltf, cdbTile, nullptr, tilesetDirectory, tileset);
+        Texture contentImagery = *imagery;
+        contentImagery.uri = getContentRelativeURI(imagery->uri, cdbTile);
+        tinygltf::Model gltf = createGltf(simplifed, &material, &contentImagery, gltfOptions);
+        createB3DMForTileset(gltf, contentTile, nullptr, tilesetDirectory, tileset);
     } else {
-        tinygltf::Model gltf = createGltf(simplifed, nullptr, nullptr);
-        createB3DMForTileset(gltf, cdbTile, nullptr, tilesetDirectory, tileset);
+        tinygltf::Model gltf = createGltf(simplifed, nullptr, nullptr, gltfOptions);
+        createB3DMForTileset(gltf, contentTile, nullptr, tilesetDirectory, tileset);
     }
 
     if (cdbTile.getLevel() < 0) {
@@ -427,6 +550,62 @@ void Converter::Impl::generateElevationNormal(Mesh &simplifed)
     }
 }
 
+void Converter::Impl::includeContentHeights(const std::vector<glm::dvec3> &positions, CDBTile &cdbTile) const
+{
+    const auto &ellipsoid = Core::Ellipsoid::WGS84;
+    double minimumHeight = std::numeric_limits<double>::max();
+    double maximumHeight = std::numeric_limits<double>::lowest();
+    for (const auto &position : positions) {
+        auto cartographic = ellipsoid.cartesianToCartographic(position);
+        if (cartographic) {
+            minimumHeight = glm::min(minimumHeight, cartographic->height);
+            maximumHeight = glm::max(maximumHeight, cartographic->height);
+        }
+    }
+
+    if (minimumHeight <= maximumHeight) {
+        cdbTile.includeContentHeights(minimumHeight, maximumHeight);
+    }
+}
+
+double Converter::Impl::computeLargestFeatureSize(const std::vector<Mesh> &meshes)
+{
+    // vertices of a feature share its batch ID
+    std::unordered_map<float, AABB> featureAABBs;
+    for (const auto &mesh : meshes) {
+        for (size_t i = 0; i < mesh.positions.size() && i < mesh.batchIDs.size(); ++i) {
+            auto featureAABB = featureAABBs.find(mesh.batchIDs[i]);
+            if (featureAABB == featureAABBs.end()) {
+                featureAABBs.insert({mesh.batchIDs[i], AABB(mesh.positions[i], mesh.positions[i])});
+            } else {
+                featureAABB->second.merge(mesh.positions[i]);
+            }
+        }
+    }
+
+    double largestSize = 0.0;
+    for (const auto &featureAABB : featureAABBs) {
+        largestSize = glm::max(largestSize, glm::distance(featureAABB.second.min, featureAABB.second.max));
+    }
+
+    return largestSize;
+}
+
+double Converter::Impl::computeModelRadius(const CDBModel3DResult &model3D,
+                                           const std::vector<glm::vec3> &scales,
+                                           size_t i)
+{
+    glm::dvec3 scale = i < scales.size() ? glm::dvec3(scales[i]) : glm::dvec3(1.0);
+    double radius = 0.0;
+    for (const auto &mesh : model3D.getMeshes()) {
+        if (mesh.aabb) {
+            radius = glm::max(radius, mesh.aabb->farthestCornerDistance(scale));
+        }
+    }
+
+    return radius;
+}
+
 void Converter::Impl::addSubRegionElevationToTileset(CDBElevation &subRegion,
                                                      const CDB &cdb,
                                                      std::optional<CDBImagery> &subRegionImagery,
@@ -446,26 +625,34 @@ void Converter::Impl::addSubRegionElevationToTileset(CDBElevation &subRegion,
 }
 
 Texture Converter::Impl::createImageryTexture(CDBImagery &imagery,
-                                              const std::filesystem::path &tilesetOutputDirectory) const
+                                              const std::filesystem::path &tilesetOutputDirectory)
 {
     static const std::filesystem::path MODEL_TEXTURE_SUB_DIR = "Textures";
 
     const auto &tile = imagery.getTile();
     auto textureRelativePath = MODEL_TEXTURE_SUB_DIR / (tile.getRelativePath().filename().string() + ".jpeg");
-    auto textureAbsolutePath = tilesetOutputDirectory / textureRelativePath;
-    auto textureDirectory = tilesetOutputDirectory / MODEL_TEXTURE_SUB_DIR;
-    if (!std::filesystem::exists(textureDirectory)) {
-        std::filesystem::create_directories(textureDirectory);
-    }
+    auto textureOutputPath = tilesetOutputDirectory / textureRelativePath;
 
+    // encode the jpeg in GDAL's in-memory file system, so that it can be written to the output sink
     auto driver = (GDALDriver *) GDALGetDriverByName("jpeg");
     if (driver) {
+        std::string jpegMemoryPath = "/vsimem/" + textureOutputPath.generic_string();
         GDALDatasetUniquePtr jpegDataset = GDALDatasetUniquePtr(driver->CreateCopy(
-            textureAbsolutePath.string().c_str(), &imagery.getData(), false, nullptr, nullptr, nullptr));
+            jpegMemoryPath.c_str(), &imagery.getData(), false, nullptr, nullptr, nullptr));
+        jpegDataset.reset();
+
+        vsi_l_offset jpegByteLength = 0;
+        GByte *jpeg = VSIGetMemFileBuffer(jpegMemoryPath.c_str(), &jpegByteLength, TRUE);
+        if (jpeg) {
+            TileWriter content;
+            content.addSegment(jpeg, static_cast<size_t>(jpegByteLength));
+            textureOutputPath = writeUniqueContent(textureOutputPath, content);
+            VSIFree(jpeg);
+        }
     }
 
     Texture texture;
-    texture.uri = textureRelativePath;
+    texture.uri = textureOutputPath.lexically_relative(tilesetOutputDirectory).generic_string();
     texture.magFilter = TextureFilter::LINEAR;
     texture.minFilter = TextureFilter::LINEAR_MIPMAP_NEAREST;
 
@@ -487,8 +674,13 @@ void Converter::Impl::addVectorToTilesetCollection(
     CDBTileset *tileset;
     getTileset(cdbTile, collectionOutputDirectory, tilesetCollections, tileset, tilesetDirectory);
 
-    tinygltf::Model gltf = createGltf(mesh, nullptr, nullptr);
-    createB3DMForTileset(gltf, cdbTile, &vectors.getInstancesAttributes(), tilesetDirectory, *tileset);
+    CDBTile contentTile = cdbTile;
+    if (tightBoundingHeights) {
+        includeContentHeights(mesh.positions, contentTile);
+    }
+
+    tinygltf::Model gltf = createGltf(mesh, nullptr, nullptr, gltfOptions);
+    createB3DMForTileset(gltf, contentTile, &vectors.getInstancesAttributes(), tilesetDirectory, *tileset);
 }
 
 void Converter::Impl::addGTModelToTilesetCollection(const CDBGTModels &model,
@@ -505,11 +697,20 @@ void Converter::Impl::addGTModelToTilesetCollection(const CDBGTModels &model,
 
     // create gltf file
     auto gltfOutputDIr = tilesetDirectory / MODEL_GLTF_SUB_DIR;
-    std::filesystem::create_directories(gltfOutputDIr);
 
     std::map<std::string, std::vector<int>> instances;
     const auto &modelsAttribs = model.getModelsAttributes();
+    const auto &cartographicPositions = modelsAttribs.getCartographicPositions();
+    const auto &scales = modelsAttribs.getScales();
+    double largestInstanceSize = 0.0;
     const auto &instancesAttribs = modelsAttribs.getInstancesAttributes();
+
+    // reading OpenFlight files dominates GT conversion, so load the models of the tile in parallel first
+    if (!GTModelLoadingPool) {
+        GTModelLoadingPool = std::make_unique<ThreadPool>(ThreadPool::getDefaultThreadCount());
+    }
+    model.prefetchModel3Ds(*GTModelLoadingPool);
+
     for (size_t i = 0; i < instancesAttribs.getInstancesCount(); ++i) {
         std::string modelKey;
         auto model3D = model.locateModel3D(i, modelKey);
@@ -522,33 +723,55 @@ void Converter::Impl::addGTModelToTilesetCollection(const CDBGTModels &model,
                                                   gltfOutputDIr);
 
                 // create gltf for the instance
-                tinygltf::Model gltf = createGltf(model3D->getMeshes(), model3D->getMaterials(), textures);
+                tinygltf::Model gltf = createGltf(model3D->getMeshes(),
+                                                  model3D->getMaterials(),
+                                                  textures,
+                                                  gltfOptions);
 
                 // write to glb
-                tinygltf::TinyGLTF loader;
-                std::filesystem::path modelGltfURI = MODEL_GLTF_SUB_DIR / (modelKey + ".glb");
-                loader.WriteGltfSceneToFile(&gltf, tilesetDirectory / modelGltfURI, false, false, false, true);
-                GTModelsToGltf.insert({modelKey, modelGltfURI});
+                auto modelGltfPath = tilesetDirectory / MODEL_GLTF_SUB_DIR / (modelKey + ".glb");
+                compressGltfWithMeshopt(gltf, gltfOptions);
+                TileWriter glb;
+                glb.addGlb(gltf);
+                modelGltfPath = writeUniqueContent(modelGltfPath, glb, true);
+                GTModelsToGltf.insert({modelKey, modelGltfPath.lexically_relative(tilesetDirectory)});
             }
 
             auto &instance = instances[modelKey];
             instance.emplace_back(i);
+
+            // instances can be rotated freely, so bound each one by a sphere around its position
+            if (tightBoundingHeights || measuredGeometricError) {
+                double radius = computeModelRadius(*model3D, scales, i);
+                if (tightBoundingHeights) {
+                    double height = cartographicPositions[i].height;
+                    cdbTile.includeContentHeights(height - radius, height + radius);
+                }
+
+                largestInstanceSize = glm::max(largestInstanceSize, 2.0 * radius);
+            }
         }
     }
 
+    // skipping the tile loses at most its largest model
+    if (measuredGeometricError) {
+        cdbTile.setGeometricError(largestInstanceSize);
+    }
+
     // write i3dm to cmpt
     std::string cdbTileFilename = cdbTile.getRelativePath().filename().string();
     std::filesystem::path cmpt = cdbTileFilename + std::string(".cmpt");
-    std::filesystem::path cmptFullPath = tilesetDirectory / cmpt;
-    std::ofstream fs(cmptFullPath, std::ios::binary);
-    auto instance = instances.begin();
-    writeToCMPT(static_cast<uint32_t>(instances.size()), fs, [&](std::ofstream &os, size_t) {
-        const auto &GltfURI = GTModelsToGltf[instance->first];
-        const auto &instanceIndices = instance->second;
-        size_t totalWrite = writeToI3DM(GltfURI, modelsAttribs, instanceIndices, os);
-        instance = std::next(instance);
-        return totalWrite;
-    });
+    if (implicitTiling) {
+        cmpt = getImplicitTilingContentURI(cdbTile, ".cmpt");
+    }
+    std::vector<TileWriter> i3dms;
+    i3dms.reserve(instances.size());
+    for (const auto &instance : instances) {
+        auto GltfURI = getContentRelativeURI(GTModelsToGltf[instance.first], cdbTile);
+        i3dms.emplace_back(createI3DM(GltfURI, modelsAttribs, instance.second));
+    }
+
+    outputSink->write(tilesetDirectory / cmpt, createCMPT(std::move(i3dms)));
 
     // add it to tileset
     cdbTile.setCustomContentURI(cmpt);
@@ -558,6 +781,7 @@ void Converter::Impl::addGTModelToTilesetCollection(const CDBGTModels &model,
 void Converter::Impl::addGSModelToTilesetCollection(const CDBGSModels &model,
                                                     const std::filesystem::path &collectionOutputDirectory)
 {
+    static const std::filesystem::path MODEL_GLTF_SUB_DIR = "Gltf";
     static const std::filesystem::path MODEL_TEXTURE_SUB_DIR = "Textures";
 
     const auto &cdbTile = model.getTile();
@@ -567,13 +791,226 @@ void Converter::Impl::addGSModelToTilesetCollection(const CDBGSModels &model,
     CDBTileset *tileset;
     getTileset(cdbTile, collectionOutputDirectory, GSModelTilesets, tileset, tilesetDirectory);
 
+    if (GSModelHLODLevel) {
+        addGSModelHLODContent(model);
+    }
+
     auto textures = writeModeTextures(model3D.getTextures(),
                                       model3D.getImages(),
                                       MODEL_TEXTURE_SUB_DIR,
                                       tilesetDirectory);
+    for (auto &texture : textures) {
+        texture.uri = getContentRelativeURI(texture.uri, cdbTile);
+    }
+
+    CDBTile contentTile = cdbTile;
+    if (tightBoundingHeights) {
+        for (const auto &mesh : model3D.getMeshes()) {
+            includeContentHeights(mesh.positions, contentTile);
+        }
+    }
+
+    if (measuredGeometricError) {
+        contentTile.setGeometricError(computeLargestFeatureSize(model3D.getMeshes()));
+    }
+
+    auto gltf = createGltf(model3D.getMeshes(), model3D.getMaterials(), textures, gltfOptions);
+    // implicit tiling has a single content URI template for every tile, so once some tiles need a composite
+    // for their instanced models, all of them are written as composites
+    const auto &instancedModels = model.getInstancedModels();
+    if (instancedModels.empty() && !(implicitTiling && GSModelInstancing)) {
+        createB3DMForTileset(gltf, contentTile, &model.getInstancesAttributes(), tilesetDirectory, *tileset);
+        return;
+    }
+
+    // repeated models are written once and placed by an i3dm each, next to a b3dm with the other models
+    std::vector<TileWriter> tiles;
+    tiles.reserve(instancedModels.size() + 1);
+    if (!model3D.getMeshes().empty()) {
+        compressGltfWithMeshopt(gltf, gltfOptions);
+        tiles.emplace_back(createB3DM(gltf, &model.getInstancesAttributes()));
+    }
+
+    std::string cdbTileFilename = cdbTile.getRelativePath().filename().string();
+    const auto &modelsAttribs = model.getModelsAttributes();
+    const auto &cartographicPositions = modelsAttribs.getCartographicPositions();
+    const auto &scales = modelsAttribs.getScales();
+    auto gltfOutputDir = tilesetDirectory / MODEL_GLTF_SUB_DIR;
+    double largestInstanceSize = 0.0;
+    for (const auto &instancedModel : instancedModels) {
+        const auto &instancedModel3D = instancedModel.model3D;
+        auto instancedTextures = writeModeTextures(instancedModel3D.getTextures(),
+                                                   instancedModel3D.getImages(),
+                                                   MODEL_TEXTURE_SUB_DIR,
+                                                   gltfOutputDir);
+
+        tinygltf::Model instancedGltf = createGltf(instancedModel3D.getMeshes(),
+                                                   instancedModel3D.getMaterials(),
+                                                   instancedTextures,
+                                                   gltfOptions);
+
+        auto modelGltfPath = gltfOutputDir / (cdbTileFilename + "_" + instancedModel.name + ".glb");
+        compressGltfWithMeshopt(instancedGltf, gltfOptions);
+        TileWriter glb;
+        glb.addGlb(instancedGltf);
+        modelGltfPath = writeUniqueContent(modelGltfPath, glb, true);
+
+        auto GltfURI = getContentRelativeURI(modelGltfPath.lexically_relative(tilesetDirectory), cdbTile);
+        tiles.emplace_back(createI3DM(GltfURI, modelsAttribs, instancedModel.instances));
+
+        if (tightBoundingHeights || measuredGeometricError) {
+            for (auto instance : instancedModel.instances) {
+                size_t i = static_cast<size_t>(instance);
+                double radius = computeModelRadius(instancedModel3D, scales, i);
+                if (tightBoundingHeights) {
+                    double height = cartographicPositions[i].height;
+                    contentTile.includeContentHeights(height - radius, height + radius);
+                }
+
+                largestInstanceSize = glm::max(largestInstanceSize, 2.0 * radius);
+            }
+        }
+    }
+
+    if (measuredGeometricError) {
+        double largestFeatureSize = contentTile.getGeometricError().value_or(0.0);
+        contentTile.setGeometricError(glm::max(largestFeatureSize, largestInstanceSize));
+    }
+
+    std::filesystem::path cmpt = cdbTileFilename + std::string(".cmpt");
+    if (implicitTiling) {
+        cmpt = getImplicitTilingContentURI(cdbTile, ".cmpt");
+    }
+
+    outputSink->write(tilesetDirectory / cmpt, createCMPT(std::move(tiles)));
+    contentTile.setCustomContentURI(cmpt);
+    tileset->insertTile(contentTile);
+}
+
+void Converter::Impl::addGSModelHLODContent(const CDBGSModels &model)
+{
+    GSModelHLODContent content{};
+    appendGSModelHLODContent(model.getModel3D(), nullptr, content);
+    for (const auto &instancedModel : model.getInstancedModels()) {
+        for (auto instance : instancedModel.instances) {
+            auto transform = model.calculateInstanceTransform(static_cast<size_t>(instance));
+            appendGSModelHLODContent(instancedModel.model3D, &transform, content);
+        }
+    }
+
+    coarsenGSModelHLODContent(content);
+    GSModelHLODContents[model.getTile()] = std::move(content);
+}
 
-    auto gltf = createGltf(model3D.getMeshes(), model3D.getMaterials(), textures);
-    createB3DMForTileset(gltf, cdbTile, &model.getInstancesAttributes(), tilesetDirectory, *tileset);
+void Converter::Impl::createGSModelHLOD(const CDBGeoCell &geoCell)
+{
+    auto tilesetCollection = GSModelTilesets.find(geoCell);
+    if (tilesetCollection != GSModelTilesets.end()) {
+        const auto &CSToPaths = tilesetCollection->second.CSToPaths;
+        for (auto &CSToTileset : tilesetCollection->second.CSToTilesets) {
+            auto root = CSToTileset.second.getRoot();
+            if (root) {
+                createGSModelHLOD(*root, CSToPaths.at(CSToTileset.first), CSToTileset.second);
+            }
+        }
+    }
+
+    GSModelHLODContents.clear();
+    GSModelHLODImages.clear();
+}
+
+void Converter::Impl::createGSModelHLOD(CDBTile &tile,
+                                        const std::filesystem::path &tilesetDirectory,
+                                        CDBTileset &tileset)
+{
+    static const std::filesystem::path MODEL_TEXTURE_SUB_DIR = "Textures";
+
+    // children come first, so that their simplified content is ready
+    GSModelHLODContent content{};
+    for (auto child : tile.getChildren()) {
+        if (child) {
+            createGSModelHLOD(*child, tilesetDirectory, tileset);
+            auto childContent = GSModelHLODContents.find(*child);
+            if (childContent != GSModelHLODContents.end()) {
+                mergeGSModelHLODContent(childContent->second, content);
+                GSModelHLODContents.erase(childContent);
+            }
+        }
+    }
+
+    // tiles with models of their own keep them, and carry the content of their descendants up to the next
+    // generated tile
+    if (tile.getCustomContentURI()) {
+        mergeGSModelHLODContent(content, GSModelHLODContents[tile]);
+        return;
+    }
+
+    if (content.meshes.empty() || tile.getLevel() < *GSModelHLODLevel) {
+        return;
+    }
+
+    std::vector<Texture> textures = content.textures;
+    for (size_t i = 0; i < textures.size(); ++i) {
+        const auto &image = content.images[i];
+        textures[i].uri = std::filesystem::path(textures[i].uri).stem().string() + "_"
+                          + std::to_string(image->s()) + "x" + std::to_string(image->t()) + ".png";
+    }
+
+    textures = writeModeTextures(textures, content.images, MODEL_TEXTURE_SUB_DIR, tilesetDirectory);
+
+    for (auto &mesh : content.meshes) {
+        AABB aabb;
+        for (const auto &position : mesh.positions) {
+            aabb.merge(position);
+        }
+
+        auto center = aabb.center();
+        mesh.aabb = aabb;
+        mesh.positionRTCs.clear();
+        mesh.positionRTCs.reserve(mesh.positions.size());
+        for (const auto &position : mesh.positions) {
+            mesh.positionRTCs.emplace_back(position - center);
+        }
+    }
+
+    // the content stands for the whole subtree, so it is replaced instead of drawn below the children
+    CDBTile HLODTile = tile;
+    HLODTile.setReplaceRefinement(true);
+    if (measuredGeometricError) {
+        HLODTile.setGeometricError(content.geometricError);
+    }
+
+    auto gltf = createGltf(content.meshes, content.materials, textures, gltfOptions);
+    createB3DMForTileset(gltf, HLODTile, nullptr, tilesetDirectory, tileset);
+
+    coarsenGSModelHLODContent(content);
+    GSModelHLODContents[tile] = std::move(content);
+}
+
+void Converter::Impl::coarsenGSModelHLODContent(GSModelHLODContent &content)
+{
+    simplifyGSModelHLODMeshes(content, GS_MODEL_HLOD_INDEX_RATIO, GS_MODEL_HLOD_TARGET_ERROR);
+
+    // textures are shared by many tiles, so each one is halved once per size
+    for (size_t i = 0; i < content.images.size(); ++i) {
+        auto &image = content.images[i];
+        if (!image || image->isCompressed() || (image->s() <= 1 && image->t() <= 1)) {
+            continue;
+        }
+
+        int width = glm::max(image->s() / 2, 1);
+        int height = glm::max(image->t() / 2, 1);
+        std::string imageKey = std::filesystem::path(content.textures[i].uri).stem().string() + "_"
+                               + std::to_string(width) + "x" + std::to_string(height);
+        auto halvedImage = GSModelHLODImages.find(imageKey);
+        if (halvedImage == GSModelHLODImages.end()) {
+            osg::ref_ptr<osg::Image> scaledImage = new osg::Image(*image, osg::CopyOp::DEEP_COPY_ALL);
+            scaledImage->scaleImage(width, height, image->r());
+            halvedImage = GSModelHLODImages.insert({imageKey, scaledImage}).first;
+        }
+
+        image = halvedImage->second;
+    }
 }
 
 std::vector<Texture> Converter::Impl::writeModeTextures(const std::vector<Texture> &modelTextures,
@@ -581,24 +1018,199 @@ std::vector<Texture> Converter::Impl::writeModeTextures(const std::vector<Textur
                                                         const std::filesystem::path &textureSubDir,
                                                         const std::filesystem::path &gltfPath)
 {
-    auto textureDirectory = gltfPath / textureSubDir;
-    if (!std::filesystem::exists(textureDirectory)) {
-        std::filesystem::create_directories(textureDirectory);
+    auto textureSizes = computeModelTextureSizes(images);
+    std::vector<std::string> textureKeys(modelTextures.size());
+    std::vector<ModelTextureTask> tasks;
+    std::unordered_set<std::string> queuedKeys;
+    for (size_t i = 0; i < modelTextures.size(); ++i) {
+        const auto &image = images[i];
+        auto textureOutputPath = gltfPath / textureSubDir / modelTextures[i].uri;
+        std::string textureKey = textureOutputPath.string();
+
+        // tiles may resample a texture to different sizes, so resampled textures are shared by content within
+        // the texture directory. The layout is hashed too, so images with the same bytes stay apart
+        if (textureSizes[i] != glm::ivec2(image->s(), image->t())) {
+            const int32_t layout[] = {image->s(),
+                                      image->t(),
+                                      image->r(),
+                                      static_cast<int32_t>(image->getPixelFormat()),
+                                      static_cast<int32_t>(image->getDataType())};
+            MD5 md5;
+            md5.update(reinterpret_cast<const uint8_t *>(layout), sizeof(layout));
+            md5.update(image->data(), image->getTotalSizeInBytes());
+            std::string sizeSuffix = "_" + std::to_string(textureSizes[i].x) + "x"
+                                     + std::to_string(textureSizes[i].y);
+            std::string contentHash = MD5::toHex(md5.finalize());
+            textureKey = (gltfPath / textureSubDir).generic_string() + "/" + contentHash + sizeSuffix
+                         + textureOutputPath.extension().string();
+            textureOutputPath.replace_filename(textureOutputPath.stem().string() + sizeSuffix + "_"
+                                               + contentHash.substr(0, 8)
+                                               + textureOutputPath.extension().string());
+        }
+
+        // textures are shared by models, so each one is encoded once
+        textureKeys[i] = textureKey;
+        if (processedModelTextures.find(textureKey) != processedModelTextures.end()
+            || !queuedKeys.insert(textureKey).second) {
+            continue;
+        }
+
+        auto textureExtension = osgDB::getLowerCaseFileExtension(textureOutputPath.string());
+        ModelTextureTask task;
+        task.key = textureKey;
+        task.outputPath = textureOutputPath;
+        task.image = image;
+        task.readerWriter = osgDB::Registry::instance()->getReaderWriterForExtension(textureExtension);
+        task.width = textureSizes[i].x;
+        task.height = textureSizes[i].y;
+        task.isEncoded = false;
+        tasks.emplace_back(std::move(task));
+    }
+
+    // resampling and encoding dominate, so they run in parallel, then the textures are written in order
+    if (!modelTexturePool) {
+        modelTexturePool = std::make_unique<ThreadPool>(ThreadPool::getDefaultThreadCount());
+    }
+
+    for (auto &task : tasks) {
+        modelTexturePool->enqueue([&task]() { encodeModelTexture(task); });
+    }
+    modelTexturePool->wait();
+
+    for (const auto &task : tasks) {
+        std::filesystem::path texturePath = task.outputPath;
+        if (task.isEncoded) {
+            TileWriter content;
+            content.addSegment(reinterpret_cast<const uint8_t *>(task.encodedTexture.data()),
+                               task.encodedTexture.size());
+            texturePath = writeUniqueContent(task.outputPath, content);
+        }
+
+        processedModelTextures.insert({task.key, texturePath});
     }
 
     auto textures = modelTextures;
     for (size_t i = 0; i < modelTextures.size(); ++i) {
-        auto textureRelativePath = textureSubDir / modelTextures[i].uri;
-        auto textureAbsolutePath = gltfPath / textureSubDir / modelTextures[i].uri;
+        const auto &texturePath = processedModelTextures.at(textureKeys[i]);
+        textures[i].uri = texturePath.lexically_relative(gltfPath).generic_string();
+    }
 
-        if (processedModelTextures.find(textureAbsolutePath) == processedModelTextures.end()) {
-            osgDB::writeImageFile(*images[i], textureAbsolutePath.string(), nullptr);
+    return textures;
+}
+
+std::vector<glm::ivec2> Converter::Impl::computeModelTextureSizes(
+    const std::vector<osg::ref_ptr<osg::Image>> &images) const
+{
+    std::vector<glm::ivec2> sizes;
+    std::vector<size_t> resizableTextures;
+    sizes.reserve(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        const auto &image = images[i];
+        sizes.emplace_back(image->s(), image->t());
+        if (image->isCompressed() || image->r() != 1) {
+            continue;
         }
 
-        textures[i].uri = textureRelativePath.string();
+        resizableTextures.emplace_back(i);
+        int largestSide = glm::max(image->s(), image->t());
+        if (modelTextureMaxSize && largestSide > *modelTextureMaxSize) {
+            double scale = static_cast<double>(*modelTextureMaxSize) / static_cast<double>(largestSide);
+            sizes[i].x = glm::max(static_cast<int>(std::lround(image->s() * scale)), 1);
+            sizes[i].y = glm::max(static_cast<int>(std::lround(image->t() * scale)), 1);
+        }
     }
 
-    return textures;
+    if (modelTextureByteBudget == 0) {
+        return sizes;
+    }
+
+    // the budget bounds the decoded size, which is what the textures occupy once loaded by a client
+    auto getByteLength = [&](size_t i) {
+        return static_cast<size_t>(sizes[i].x) * static_cast<size_t>(sizes[i].y)
+               * images[i]->getPixelSizeInBits() / 8;
+    };
+
+    size_t totalByteLength = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+        totalByteLength += getByteLength(i);
+    }
+
+    // halve the largest texture until they fit, or until none can be halved
+    while (totalByteLength > modelTextureByteBudget) {
+        auto largestTexture = std::max_element(resizableTextures.begin(),
+                                               resizableTextures.end(),
+                                               [&](size_t lhs, size_t rhs) {
+                                                   return getByteLength(lhs) < getByteLength(rhs);
+                                               });
+        if (largestTexture == resizableTextures.end() || sizes[*largestTexture] == glm::ivec2(1)) {
+            break;
+        }
+
+        size_t i = *largestTexture;
+        totalByteLength -= getByteLength(i);
+        sizes[i] = glm::max(sizes[i] / 2, glm::ivec2(1));
+        totalByteLength += getByteLength(i);
+    }
+
+    return sizes;
+}
+
+void encodeModelTexture(ModelTextureTask &task)
+{
+    osg::ref_ptr<osg::Image> image = task.image;
+    if (image->s() != task.width || image->t() != task.height) {
+        image = new osg::Image(*task.image, osg::CopyOp::DEEP_COPY_ALL);
+        image->scaleImage(task.width, task.height, image->r());
+    }
+
+    std::ostringstream textureStream;
+    if (task.readerWriter && task.readerWriter->writeImage(*image, textureStream).success()) {
+        task.encodedTexture = textureStream.str();
+        task.isEncoded = true;
+    }
+}
+
+std::string Converter::Impl::getContentRelativeURI(const std::filesystem::path &uri,
+                                                   const CDBTile &cdbTile) const
+{
+    if (!implicitTiling) {
+        return uri.generic_string();
+    }
+
+    auto contentDirectory = getImplicitTilingContentURI(cdbTile, "").parent_path();
+    if (contentDirectory.empty()) {
+        return uri.generic_string();
+    }
+
+    return uri.lexically_relative(contentDirectory).generic_string();
+}
+
+std::filesystem::path Converter::Impl::writeUniqueContent(const std::filesystem::path &path,
+                                                          const TileWriter &content,
+                                                          bool hasRelativeURIs)
+{
+    if (!deduplicateContent) {
+        outputSink->write(path, content);
+        return path;
+    }
+
+    MD5 md5;
+    for (const auto &segment : content.getSegments()) {
+        md5.update(segment.data, segment.byteLength);
+    }
+
+    auto digest = md5.finalize();
+    std::string contentKey = MD5::toHex(digest) + "_" + std::to_string(content.getByteLength());
+    if (hasRelativeURIs) {
+        contentKey = path.parent_path().generic_string() + "/" + contentKey;
+    }
+
+    auto inserted = contentToPath.insert({contentKey, path});
+    if (inserted.second) {
+        outputSink->write(path, content);
+    }
+
+    return inserted.first->second;
 }
 
 void Converter::Impl::createB3DMForTileset(tinygltf::Model &gltf,
@@ -610,11 +1222,13 @@ void Converter::Impl::createB3DMForTileset(tinygltf::Model &gltf,
     // create b3dm file
     std::string cdbTileFilename = cdbTile.getRelativePath().filename().string();
     std::filesystem::path b3dm = cdbTileFilename + std::string(".b3dm");
-    std::filesystem::path b3dmFullPath = outputDirectory / b3dm;
+    if (implicitTiling) {
+        b3dm = getImplicitTilingContentURI(cdbTile, ".b3dm");
+    }
 
     // write to b3dm
-    std::ofstream fs(b3dmFullPath, std::ios::binary);
-    writeToB3DM(&gltf, instancesAttribs, fs);
+    compressGltfWithMeshopt(gltf, gltfOptions);
+    outputSink->write(outputDirectory / b3dm, createB3DM(gltf, instancesAttribs));
     cdbTile.setCustomContentURI(b3dm);
 
     tileset.insertTile(cdbTile);
@@ -650,7 +1264,6 @@ void Converter::Impl::getTileset(const CDBTile &cdbTile,
     auto CSPathIt = CSToPaths.find(CSHash);
     if (CSPathIt == CSToPaths.end()) {
         path = getTilesetDirectory(cdbTile.getCS_1(), cdbTile.getCS_2(), collectionOutputDirectory);
-        std::filesystem::create_directories(path);
         CSToPaths.insert({CSHash, path});
     } else {
         path = CSPathIt->second;
@@ -661,11 +1274,34 @@ void Converter::Impl::getTileset(const CDBTile &cdbTile,
 
 Converter::Converter(const std::filesystem::path &CDBPath, const std::filesystem::path &outputPath)
 {
-    m_impl = std::make_unique<Impl>(CDBPath, outputPath);
+    if (std::filesystem::exists(outputPath)) {
+        std::filesystem::remove_all(outputPath);
+    }
+
+    // a .3tz output path writes every file to a single indexed archive
+    std::unique_ptr<OutputSink> outputSink;
+    if (outputPath.extension() == ".3tz") {
+        outputSink = std::make_unique<ArchiveSink>(outputPath, true);
+    } else {
+        outputSink = std::make_unique<FileSystemSink>(outputPath);
+    }
+
+    m_impl = std::make_unique<Impl>(CDBPath, std::move(outputSink));
+}
+
+Converter::Converter(const std::filesystem::path &CDBPath, std::unique_ptr<OutputSink> outputSink)
+{
+    m_impl = std::make_unique<Impl>(CDBPath, std::move(outputSink));
 }
 
 Converter::~Converter() noexcept {}
 
+std::unique_ptr<Converter> createConverter(const std::filesystem::path &CDBPath,
+                                           std::unique_ptr<OutputSink> outputSink)
+{
+    return std::unique_ptr<Converter>(new Converter(CDBPath, std::move(outputSink)));
+}
+
 void Converter::combineDataset(const std::vector<std::string> &datasets)
 {
     // Only combine when we have more than 1 tileset. Less than that, it means
@@ -732,24 +1368,135 @@ void Converter::setElevationDecimateError(float elevationDecimateError)
     m_impl->elevationDecimateError = elevationDecimateError;
 }
 
+void Converter::setNormalQuantizationBits(int normalBits)
+{
+    m_impl->gltfOptions.normalBits = normalBits;
+}
+
+void Converter::setPositionQuantizationBits(int positionBits)
+{
+    m_impl->gltfOptions.positionBits = positionBits;
+}
+
+void Converter::setUVQuantizationBits(int UVBits)
+{
+    m_impl->gltfOptions.UVBits = UVBits;
+}
+
+void Converter::setMeshoptCompression(bool meshoptCompression)
+{
+    m_impl->gltfOptions.meshoptCompression = meshoptCompression;
+}
+
+void Converter::setMeshoptFallback(bool meshoptFallback)
+{
+    m_impl->gltfOptions.meshoptFallback = meshoptFallback ? MeshoptFallback::Uncompressed
+                                                          : MeshoptFallback::None;
+}
+
+void Converter::setOptimizeMeshes(bool optimizeMeshes)
+{
+    m_impl->gltfOptions.optimizeMeshes = optimizeMeshes;
+}
+
+void Converter::setDeduplicateContent(bool deduplicateContent)
+{
+    m_impl->deduplicateContent = deduplicateContent;
+}
+
+void Converter::setGzipOutput(bool gzipOutput)
+{
+    m_impl->gzipOutput = gzipOutput;
+}
+
+void Converter::setImplicitTiling(bool implicitTiling)
+{
+    m_impl->implicitTiling = implicitTiling;
+}
+
+void Converter::setTightBoundingHeights(bool tightBoundingHeights)
+{
+    m_impl->tightBoundingHeights = tightBoundingHeights;
+}
+
+void Converter::setMeasuredGeometricError(bool measuredGeometricError)
+{
+    m_impl->measuredGeometricError = measuredGeometricError;
+}
+
+void Converter::setGSModelInstancing(bool GSModelInstancing)
+{
+    m_impl->GSModelInstancing = GSModelInstancing;
+}
+
+void Converter::setGSModelHLODLevel(int GSModelHLODLevel)
+{
+    m_impl->GSModelHLODLevel = GSModelHLODLevel;
+}
+
+void Converter::setModelCacheDirectory(const std::filesystem::path &modelCacheDirectory)
+{
+    m_impl->modelCacheDirectory = modelCacheDirectory;
+}
+
+void Converter::setModelTextureMaxSize(int modelTextureMaxSize)
+{
+    m_impl->modelTextureMaxSize = modelTextureMaxSize;
+}
+
+void Converter::setModelTextureByteBudget(size_t modelTextureByteBudget)
+{
+    m_impl->modelTextureByteBudget = modelTextureByteBudget;
+}
+
+void Converter::setExternalTilesetLevel(int externalTilesetLevel)
+{
+    m_impl->tilesetJsonSplit.externalTilesetLevel = externalTilesetLevel;
+}
+
+void Converter::setMaxTilesetByteLength(size_t maxTilesetByteLength)
+{
+    m_impl->tilesetJsonSplit.maxTilesetByteLength = maxTilesetByteLength;
+}
+
 void Converter::convert()
 {
-    CDB cdb(m_impl->cdbPath);
+    if (m_impl->GSModelHLODLevel && m_impl->implicitTiling) {
+        throw std::invalid_argument("GSModel HLOD can't be generated with implicit tiling");
+    }
+
+    // readers open a .3tz archive at its tileset.json, so it always needs one
+    bool isArchiveOutput = dynamic_cast<ArchiveSink *>(m_impl->outputSink.get()) != nullptr;
+
+    // .gz files inside an archive would never be served, so archives deflate their entries instead
+    if (m_impl->gzipOutput && isArchiveOutput) {
+        static_cast<ArchiveSink *>(m_impl->outputSink.get())->setCompressEntries(true);
+    } else if (m_impl->gzipOutput) {
+        m_impl->outputSink = std::make_unique<GzipSink>(std::move(m_impl->outputSink),
+                                                        ThreadPool::getDefaultThreadCount());
+        m_impl->gzipOutput = false;
+    }
+
+    std::unique_ptr<ModelDiskCache> modelDiskCache;
+    if (m_impl->modelCacheDirectory) {
+        modelDiskCache = std::make_unique<ModelDiskCache>(*m_impl->modelCacheDirectory);
+    }
+
+    CDB cdb(m_impl->cdbPath, modelDiskCache.get());
     std::map<std::string, std::vector<std::filesystem::path>> combinedTilesets;
     std::map<std::string, std::vector<Core::BoundingRegion>> combinedTilesetsRegions;
     std::map<std::string, Core::BoundingRegion> aggregateTilesetsRegion;
 
     cdb.forEachGeoCell([&](CDBGeoCell geoCell) {
-        // create directories for converted GeoCell
+        // output directories for converted GeoCell, relative to the output root
         std::filesystem::path geoCellRelativePath = geoCell.getRelativePath();
-        std::filesystem::path geoCellAbsolutePath = m_impl->outputPath / geoCellRelativePath;
-        std::filesystem::path elevationDir = geoCellAbsolutePath / Impl::ELEVATIONS_PATH;
-        std::filesystem::path GTModelDir = geoCellAbsolutePath / Impl::GTMODEL_PATH;
-        std::filesystem::path GSModelDir = geoCellAbsolutePath / Impl::GSMODEL_PATH;
-        std::filesystem::path roadNetworkDir = geoCellAbsolutePath / Impl::ROAD_NETWORK_PATH;
-        std::filesystem::path railRoadNetworkDir = geoCellAbsolutePath / Impl::RAILROAD_NETWORK_PATH;
-        std::filesystem::path powerlineNetworkDir = geoCellAbsolutePath / Impl::POWERLINE_NETWORK_PATH;
-        std::filesystem::path hydrographyNetworkDir = geoCellAbsolutePath / Impl::HYDROGRAPHY_NETWORK_PATH;
+        std::filesystem::path elevationDir = geoCellRelativePath / Impl::ELEVATIONS_PATH;
+        std::filesystem::path GTModelDir = geoCellRelativePath / Impl::GTMODEL_PATH;
+        std::filesystem::path GSModelDir = geoCellRelativePath / Impl::GSMODEL_PATH;
+        std::filesystem::path roadNetworkDir = geoCellRelativePath / Impl::ROAD_NETWORK_PATH;
+        std::filesystem::path railRoadNetworkDir = geoCellRelativePath / Impl::RAILROAD_NETWORK_PATH;
+        std::filesystem::path powerlineNetworkDir = geoCellRelativePath / Impl::POWERLINE_NETWORK_PATH;
+        std::filesystem::path hydrographyNetworkDir = geoCellRelativePath / Impl::HYDROGRAPHY_NETWORK_PATH;
 
         // process elevation
         cdb.forEachElevationTile(geoCell, [&](CDBElevation elevation) {
@@ -795,34 +1542,41 @@ void Converter::convert()
         m_impl->flushTilesetCollection(geoCell, m_impl->GTModelTilesets);
 
         // process GSModel
-        cdb.forEachGSModelTile(geoCell, [&](CDBGSModels GSModel) {
-            m_impl->addGSModelToTilesetCollection(GSModel, GSModelDir);
-        });
+        cdb.forEachGSModelTile(
+            geoCell,
+            [&](CDBGSModels GSModel) { m_impl->addGSModelToTilesetCollection(GSModel, GSModelDir); },
+            m_impl->GSModelInstancing);
+        if (m_impl->GSModelHLODLevel) {
+            m_impl->createGSModelHLOD(geoCell);
+        }
         m_impl->flushTilesetCollection(geoCell, m_impl->GSModelTilesets, false);
 
         // get the converted dataset in each geocell to be combine at the end
-        Core::BoundingRegion geoCellRegion = CDBTile::calcBoundRegion(geoCell, -10, 0, 0);
-        for (auto tilesetJsonPath : m_impl->defaultDatasetToCombine) {
+        for (const auto &tilesetToCombine : m_impl->defaultDatasetToCombine) {
+            const auto &tilesetJsonPath = tilesetToCombine.first;
+            const auto &tilesetRegion = tilesetToCombine.second;
             auto componentSelectors = tilesetJsonPath.parent_path().filename().string();
             auto dataset = tilesetJsonPath.parent_path().parent_path().filename().string();
             auto combinedTilesetName = dataset + "_" + componentSelectors;
 
             combinedTilesets[combinedTilesetName].emplace_back(tilesetJsonPath);
-            combinedTilesetsRegions[combinedTilesetName].emplace_back(geoCellRegion);
+            combinedTilesetsRegions[combinedTilesetName].emplace_back(tilesetRegion);
             auto tilesetAggregateRegion = aggregateTilesetsRegion.find(combinedTilesetName);
             if (tilesetAggregateRegion == aggregateTilesetsRegion.end()) {
-                aggregateTilesetsRegion.insert({combinedTilesetName, geoCellRegion});
+                aggregateTilesetsRegion.insert({combinedTilesetName, tilesetRegion});
             } else {
-                tilesetAggregateRegion->second = tilesetAggregateRegion->second.computeUnion(geoCellRegion);
+                tilesetAggregateRegion->second = tilesetAggregateRegion->second.computeUnion(tilesetRegion);
             }
         }
-        std::vector<std::filesystem::path>().swap(m_impl->defaultDatasetToCombine);
+        std::vector<std::pair<std::filesystem::path, Core::BoundingRegion>>().swap(
+            m_impl->defaultDatasetToCombine);
     });
 
     // combine all the default tileset in each geocell into a global one
     for (auto tileset : combinedTilesets) {
-        std::ofstream fs(m_impl->outputPath / (tileset.first + ".json"));
-        combineTilesetJson(tileset.second, combinedTilesetsRegions[tileset.first], fs);
+        std::ostringstream tilesetJson;
+        combineTilesetJson(tileset.second, combinedTilesetsRegions[tileset.first], tilesetJson);
+        m_impl->outputSink->write(tileset.first + ".json", tilesetJson.str());
     }
 
     // combine the requested tilesets
@@ -848,14 +1602,32 @@ void Converter::convert()
             }
         }
 
-        std::ofstream fs(m_impl->outputPath / combinedTilesetName);
-        combineTilesetJson(existTilesets, regions, fs);
+        std::ostringstream tilesetJson;
+        combineTilesetJson(existTilesets, regions, tilesetJson);
+        m_impl->outputSink->write(combinedTilesetName, tilesetJson.str());
+    }
+
+    // without a single requested combination, the root of an archive combines every converted dataset
+    if (isArchiveOutput && m_impl->requestedDatasetToCombine.size() != 1
+        && !aggregateTilesetsRegion.empty()) {
+        std::vector<std::filesystem::path> existTilesets;
+        std::vector<Core::BoundingRegion> regions;
+        regions.reserve(aggregateTilesetsRegion.size());
+        for (const auto &tilesetRegion : aggregateTilesetsRegion) {
+            existTilesets.emplace_back(tilesetRegion.first + ".json");
+            regions.emplace_back(tilesetRegion.second);
+        }
+
+        std::ostringstream tilesetJson;
+        combineTilesetJson(existTilesets, regions, tilesetJson);
+        m_impl->outputSink->write("tileset.json", tilesetJson.str());
     }
+
+    m_impl->outputSink->close();
 }
 
 USE_OSGPLUGIN(png)
 USE_OSGPLUGIN(jpeg)
-USE_OSGPLUGIN(zip)
 USE_OSGPLUGIN(rgb)
 USE_OSGPLUGIN(OpenFlight)
 
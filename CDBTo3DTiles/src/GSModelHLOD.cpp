@@ -0,0 +1,132 @@
+#include "GSModelHLOD.h"
+#include <algorithm>
+
+namespace CDBTo3DTiles {
+static bool isSameMaterial(const Material &lhs, const Material &rhs);
+
+void appendGSModelHLODContent(const CDBModel3DResult &model3D,
+                              const glm::dmat4 *transform,
+                              GSModelHLODContent &content)
+{
+    GSModelHLODContent source{};
+    source.materials = model3D.getMaterials();
+    source.textures = model3D.getTextures();
+    source.images = model3D.getImages();
+    source.meshes.reserve(model3D.getMeshes().size());
+    for (const auto &mesh : model3D.getMeshes()) {
+        Mesh HLODMesh;
+        HLODMesh.material = mesh.material;
+        HLODMesh.primitiveType = mesh.primitiveType;
+        HLODMesh.indices = mesh.indices;
+        HLODMesh.UVs = mesh.UVs;
+        if (transform) {
+            HLODMesh.positions.reserve(mesh.positions.size());
+            for (const auto &position : mesh.positions) {
+                HLODMesh.positions.emplace_back(*transform * glm::dvec4(position, 1.0));
+            }
+        } else {
+            HLODMesh.positions = mesh.positions;
+        }
+
+        source.meshes.emplace_back(std::move(HLODMesh));
+    }
+
+    mergeGSModelHLODContent(source, content);
+}
+
+void mergeGSModelHLODContent(const GSModelHLODContent &source, GSModelHLODContent &destination)
+{
+    std::vector<int> textureRemap(source.textures.size());
+    for (size_t i = 0; i < source.textures.size(); ++i) {
+        const auto &uri = source.textures[i].uri;
+        auto texture = std::find_if(destination.textures.begin(),
+                                    destination.textures.end(),
+                                    [&](const Texture &other) { return other.uri == uri; });
+        if (texture == destination.textures.end()) {
+            destination.textures.emplace_back(source.textures[i]);
+            destination.images.emplace_back(source.images[i]);
+            texture = destination.textures.end() - 1;
+        }
+
+        textureRemap[i] = static_cast<int>(texture - destination.textures.begin());
+    }
+
+    // meshes of the same material are merged, so that a tile doesn't end up with a mesh per model
+    std::vector<int> materialRemap(source.materials.size());
+    for (size_t i = 0; i < source.materials.size(); ++i) {
+        Material material = source.materials[i];
+        if (material.texture >= 0) {
+            material.texture = textureRemap[static_cast<size_t>(material.texture)];
+        }
+
+        auto sameMaterial = std::find_if(
+            destination.materials.begin(), destination.materials.end(), [&](const Material &other) {
+                return isSameMaterial(material, other);
+            });
+        if (sameMaterial == destination.materials.end()) {
+            destination.materials.emplace_back(material);
+            sameMaterial = destination.materials.end() - 1;
+        }
+
+        materialRemap[i] = static_cast<int>(sameMaterial - destination.materials.begin());
+    }
+
+    // normals are dropped, since simplified meshes only need flat shading from a distance
+    for (const auto &mesh : source.meshes) {
+        if (mesh.material < 0 || mesh.primitiveType != PrimitiveType::Triangles || mesh.indices.empty()) {
+            continue;
+        }
+
+        int materialIdx = materialRemap[static_cast<size_t>(mesh.material)];
+        auto HLODMesh = std::find_if(destination.meshes.begin(),
+                                     destination.meshes.end(),
+                                     [&](const Mesh &other) { return other.material == materialIdx; });
+        if (HLODMesh == destination.meshes.end()) {
+            Mesh newMesh;
+            newMesh.material = materialIdx;
+            newMesh.aabb = AABB();
+            destination.meshes.emplace_back(std::move(newMesh));
+            HLODMesh = destination.meshes.end() - 1;
+        }
+
+        auto vertexOffset = static_cast<uint32_t>(HLODMesh->positions.size());
+        for (auto index : mesh.indices) {
+            HLODMesh->indices.emplace_back(index + vertexOffset);
+        }
+
+        HLODMesh->positions.insert(HLODMesh->positions.end(), mesh.positions.begin(), mesh.positions.end());
+        if (destination.materials[static_cast<size_t>(materialIdx)].texture >= 0) {
+            if (mesh.UVs.size() == mesh.positions.size()) {
+                HLODMesh->UVs.insert(HLODMesh->UVs.end(), mesh.UVs.begin(), mesh.UVs.end());
+            } else {
+                HLODMesh->UVs.resize(HLODMesh->positions.size(), glm::vec2(0.0f));
+            }
+        }
+    }
+
+    destination.geometricError = glm::max(destination.geometricError, source.geometricError);
+}
+
+void simplifyGSModelHLODMeshes(GSModelHLODContent &content, float indexRatio, float targetError)
+{
+    double simplifiedError = 0.0;
+    for (auto &mesh : content.meshes) {
+        size_t targetIndexCount = static_cast<size_t>(static_cast<float>(mesh.indices.size()) * indexRatio);
+        targetIndexCount -= targetIndexCount % 3;
+        simplifiedError = glm::max(simplifiedError, simplifyMesh(mesh, targetIndexCount, targetError));
+    }
+
+    content.meshes.erase(std::remove_if(content.meshes.begin(),
+                                        content.meshes.end(),
+                                        [](const Mesh &mesh) { return mesh.indices.empty(); }),
+                         content.meshes.end());
+    content.geometricError += simplifiedError;
+}
+
+bool isSameMaterial(const Material &lhs, const Material &rhs)
+{
+    return lhs.texture == rhs.texture && lhs.ambient == rhs.ambient && lhs.diffuse == rhs.diffuse
+           && lhs.specular == rhs.specular && lhs.emission == rhs.emission && lhs.shininess == rhs.shininess
+           && lhs.alpha == rhs.alpha && lhs.unlit == rhs.unlit && lhs.doubleSided == rhs.doubleSided;
+}
+} // namespace CDBTo3DTiles
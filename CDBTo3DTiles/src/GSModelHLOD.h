@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CDBModels.h"
+#include <vector>
+
+namespace CDBTo3DTiles {
+// GS model content of a tile, simplified and with halved textures, kept until its parent is generated
+struct GSModelHLODContent
+{
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+    std::vector<Texture> textures;
+    std::vector<osg::ref_ptr<osg::Image>> images;
+    double geometricError;
+};
+
+// add the triangles of a model to the content, placed by the transform when there is one
+void appendGSModelHLODContent(const CDBModel3DResult &model3D,
+                              const glm::dmat4 *transform,
+                              GSModelHLODContent &content);
+
+// add the content of a child tile. Textures with the same URI and identical materials are shared, and the
+// meshes of each material are merged into one. Normals and batch IDs are dropped
+void mergeGSModelHLODContent(const GSModelHLODContent &source, GSModelHLODContent &destination);
+
+// simplify every mesh down to indexRatio of its indices, within targetError relative to the mesh extents.
+// Meshes that collapse entirely are removed, and the largest error is added to the content geometric error
+void simplifyGSModelHLODMeshes(GSModelHLODContent &content, float indexRatio, float targetError);
+} // namespace CDBTo3DTiles
@@ -0,0 +1,551 @@
+#include "GlbWriter.h"
+#include "JsonWriter.h"
+#include "Utility.h"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace CDBTo3DTiles {
+static const uint32_t GLB_MAGIC = 0x46546C67;
+static const uint32_t GLB_VERSION = 2;
+static const uint32_t GLB_JSON_CHUNK = 0x4E4F534A;
+static const uint32_t GLB_BIN_CHUNK = 0x004E4942;
+static const uint8_t GLB_PADDING[4] = {0, 0, 0, 0};
+
+static void writeGltfJson(const tinygltf::Model &gltf, JsonWriter &writer);
+
+static void writeNodes(const std::vector<tinygltf::Node> &nodes, JsonWriter &writer);
+
+static void writeMeshes(const std::vector<tinygltf::Mesh> &meshes, JsonWriter &writer);
+
+static void writeAccessors(const std::vector<tinygltf::Accessor> &accessors, JsonWriter &writer);
+
+static void writeBufferViews(const std::vector<tinygltf::BufferView> &bufferViews, JsonWriter &writer);
+
+static void writeBuffers(const std::vector<tinygltf::Buffer> &buffers, JsonWriter &writer);
+
+static void writeMaterials(const std::vector<tinygltf::Material> &materials, JsonWriter &writer);
+
+static void writeTexturesAndImages(const tinygltf::Model &gltf, JsonWriter &writer);
+
+static void writeSamplers(const std::vector<tinygltf::Sampler> &samplers, JsonWriter &writer);
+
+static void writeExtensions(const tinygltf::ExtensionMap &extensions, JsonWriter &writer);
+
+static void writeValue(const tinygltf::Value &value, JsonWriter &writer);
+
+static const char *accessorTypeToString(int type);
+
+GlbWriter::GlbWriter(const tinygltf::Model &gltf)
+    : m_header{}
+    , m_binChunkHeader{}
+    , m_byteLength{0}
+{
+    JsonWriter writer(m_json);
+    writeGltfJson(gltf, writer);
+    m_json.resize(roundUp(m_json.size(), 4), ' ');
+
+    // only the first buffer can be stored in the binary chunk
+    const std::vector<unsigned char> *bin = nullptr;
+    if (!gltf.buffers.empty() && gltf.buffers.front().uri.empty()) {
+        bin = &gltf.buffers.front().data;
+    }
+
+    size_t binChunkLength = bin ? roundUp(bin->size(), 4) : 0;
+    size_t glbLength = m_header.size() + m_json.size();
+    if (bin) {
+        glbLength += m_binChunkHeader.size() + binChunkLength;
+    }
+
+    if (glbLength > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("GLB cannot be larger than 4GB");
+    }
+
+    uint32_t glbLength32 = static_cast<uint32_t>(glbLength);
+    uint32_t jsonChunkLength = static_cast<uint32_t>(m_json.size());
+    std::memcpy(m_header.data(), &GLB_MAGIC, sizeof(uint32_t));
+    std::memcpy(m_header.data() + 4, &GLB_VERSION, sizeof(uint32_t));
+    std::memcpy(m_header.data() + 8, &glbLength32, sizeof(uint32_t));
+    std::memcpy(m_header.data() + 12, &jsonChunkLength, sizeof(uint32_t));
+    std::memcpy(m_header.data() + 16, &GLB_JSON_CHUNK, sizeof(uint32_t));
+
+    addSegment(m_header.data(), m_header.size());
+    addSegment(reinterpret_cast<const uint8_t *>(m_json.data()), m_json.size());
+    if (bin) {
+        uint32_t binChunkLength32 = static_cast<uint32_t>(binChunkLength);
+        std::memcpy(m_binChunkHeader.data(), &binChunkLength32, sizeof(uint32_t));
+        std::memcpy(m_binChunkHeader.data() + 4, &GLB_BIN_CHUNK, sizeof(uint32_t));
+
+        addSegment(m_binChunkHeader.data(), m_binChunkHeader.size());
+        addSegment(bin->data(), bin->size());
+        addSegment(GLB_PADDING, binChunkLength - bin->size());
+    }
+}
+
+void GlbWriter::write(uint8_t *destination) const
+{
+    for (const auto &segment : m_segments) {
+        std::memcpy(destination, segment.data, segment.byteLength);
+        destination += segment.byteLength;
+    }
+}
+
+void GlbWriter::write(std::ostream &stream) const
+{
+    for (const auto &segment : m_segments) {
+        stream.write(reinterpret_cast<const char *>(segment.data),
+                     static_cast<std::streamsize>(segment.byteLength));
+    }
+}
+
+void GlbWriter::addSegment(const uint8_t *data, size_t byteLength)
+{
+    if (byteLength == 0) {
+        return;
+    }
+
+    m_segments.emplace_back(GlbSegment{data, byteLength});
+    m_byteLength += byteLength;
+}
+
+void writeGltfJson(const tinygltf::Model &gltf, JsonWriter &writer)
+{
+    writer.startObject();
+
+    writer.key("asset");
+    writer.startObject();
+    writer.property("version", gltf.asset.version);
+    if (!gltf.asset.generator.empty()) {
+        writer.property("generator", gltf.asset.generator);
+    }
+    writer.endObject();
+
+    if (!gltf.extensionsUsed.empty()) {
+        writer.arrayProperty("extensionsUsed", gltf.extensionsUsed);
+    }
+
+    if (!gltf.extensionsRequired.empty()) {
+        writer.arrayProperty("extensionsRequired", gltf.extensionsRequired);
+    }
+
+    if (gltf.defaultScene >= 0) {
+        writer.property("scene", gltf.defaultScene);
+    }
+
+    if (!gltf.scenes.empty()) {
+        writer.key("scenes");
+        writer.startArray();
+        for (const auto &scene : gltf.scenes) {
+            writer.startObject();
+            if (!scene.name.empty()) {
+                writer.property("name", scene.name);
+            }
+            writer.arrayProperty("nodes", scene.nodes);
+            writer.endObject();
+        }
+        writer.endArray();
+    }
+
+    writeNodes(gltf.nodes, writer);
+    writeMeshes(gltf.meshes, writer);
+    writeAccessors(gltf.accessors, writer);
+    writeBufferViews(gltf.bufferViews, writer);
+    writeBuffers(gltf.buffers, writer);
+    writeMaterials(gltf.materials, writer);
+    writeTexturesAndImages(gltf, writer);
+    writeSamplers(gltf.samplers, writer);
+
+    writer.endObject();
+}
+
+void writeNodes(const std::vector<tinygltf::Node> &nodes, JsonWriter &writer)
+{
+    if (nodes.empty()) {
+        return;
+    }
+
+    writer.key("nodes");
+    writer.startArray();
+    for (const auto &node : nodes) {
+        writer.startObject();
+        if (!node.name.empty()) {
+            writer.property("name", node.name);
+        }
+
+        if (node.mesh >= 0) {
+            writer.property("mesh", node.mesh);
+        }
+
+        if (!node.children.empty()) {
+            writer.arrayProperty("children", node.children);
+        }
+
+        if (!node.matrix.empty()) {
+            writer.arrayProperty("matrix", node.matrix);
+        }
+
+        if (!node.translation.empty()) {
+            writer.arrayProperty("translation", node.translation);
+        }
+
+        if (!node.rotation.empty()) {
+            writer.arrayProperty("rotation", node.rotation);
+        }
+
+        if (!node.scale.empty()) {
+            writer.arrayProperty("scale", node.scale);
+        }
+
+        writeExtensions(node.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeMeshes(const std::vector<tinygltf::Mesh> &meshes, JsonWriter &writer)
+{
+    if (meshes.empty()) {
+        return;
+    }
+
+    writer.key("meshes");
+    writer.startArray();
+    for (const auto &mesh : meshes) {
+        writer.startObject();
+        if (!mesh.name.empty()) {
+            writer.property("name", mesh.name);
+        }
+
+        writer.key("primitives");
+        writer.startArray();
+        for (const auto &primitive : mesh.primitives) {
+            writer.startObject();
+            writer.key("attributes");
+            writer.startObject();
+            for (const auto &attribute : primitive.attributes) {
+                writer.property(attribute.first, attribute.second);
+            }
+            writer.endObject();
+
+            if (primitive.indices >= 0) {
+                writer.property("indices", primitive.indices);
+            }
+
+            if (primitive.material >= 0) {
+                writer.property("material", primitive.material);
+            }
+
+            if (primitive.mode >= 0) {
+                writer.property("mode", primitive.mode);
+            }
+
+            writeExtensions(primitive.extensions, writer);
+            writer.endObject();
+        }
+        writer.endArray();
+
+        writeExtensions(mesh.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeAccessors(const std::vector<tinygltf::Accessor> &accessors, JsonWriter &writer)
+{
+    if (accessors.empty()) {
+        return;
+    }
+
+    writer.key("accessors");
+    writer.startArray();
+    for (const auto &accessor : accessors) {
+        writer.startObject();
+        if (accessor.bufferView >= 0) {
+            writer.property("bufferView", accessor.bufferView);
+        }
+
+        if (accessor.byteOffset != 0) {
+            writer.property("byteOffset", accessor.byteOffset);
+        }
+
+        writer.property("componentType", accessor.componentType);
+        writer.property("count", accessor.count);
+        writer.property("type", accessorTypeToString(accessor.type));
+        if (accessor.normalized) {
+            writer.property("normalized", true);
+        }
+
+        if (!accessor.minValues.empty()) {
+            writer.arrayProperty("min", accessor.minValues);
+        }
+
+        if (!accessor.maxValues.empty()) {
+            writer.arrayProperty("max", accessor.maxValues);
+        }
+
+        writeExtensions(accessor.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeBufferViews(const std::vector<tinygltf::BufferView> &bufferViews, JsonWriter &writer)
+{
+    if (bufferViews.empty()) {
+        return;
+    }
+
+    writer.key("bufferViews");
+    writer.startArray();
+    for (const auto &bufferView : bufferViews) {
+        writer.startObject();
+        writer.property("buffer", bufferView.buffer);
+        if (bufferView.byteOffset != 0) {
+            writer.property("byteOffset", bufferView.byteOffset);
+        }
+
+        writer.property("byteLength", bufferView.byteLength);
+        if (bufferView.byteStride != 0) {
+            writer.property("byteStride", bufferView.byteStride);
+        }
+
+        if (bufferView.target != 0) {
+            writer.property("target", bufferView.target);
+        }
+
+        writeExtensions(bufferView.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeBuffers(const std::vector<tinygltf::Buffer> &buffers, JsonWriter &writer)
+{
+    if (buffers.empty()) {
+        return;
+    }
+
+    // only the first buffer is stored in the binary chunk. Buffers after it without uri just describe their
+    // length, like the EXT_meshopt_compression fallback buffer
+    writer.key("buffers");
+    writer.startArray();
+    for (const auto &buffer : buffers) {
+        writer.startObject();
+        writer.property("byteLength", buffer.data.size());
+        if (!buffer.uri.empty()) {
+            writer.property("uri", buffer.uri);
+        }
+
+        writeExtensions(buffer.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeMaterials(const std::vector<tinygltf::Material> &materials, JsonWriter &writer)
+{
+    if (materials.empty()) {
+        return;
+    }
+
+    writer.key("materials");
+    writer.startArray();
+    for (const auto &material : materials) {
+        writer.startObject();
+        if (!material.name.empty()) {
+            writer.property("name", material.name);
+        }
+
+        const auto &pbr = material.pbrMetallicRoughness;
+        writer.key("pbrMetallicRoughness");
+        writer.startObject();
+        if (pbr.baseColorFactor.size() == 4
+            && pbr.baseColorFactor != std::vector<double>{1.0, 1.0, 1.0, 1.0}) {
+            writer.arrayProperty("baseColorFactor", pbr.baseColorFactor);
+        }
+
+        if (pbr.baseColorTexture.index >= 0) {
+            writer.key("baseColorTexture");
+            writer.startObject();
+            writer.property("index", pbr.baseColorTexture.index);
+            if (pbr.baseColorTexture.texCoord != 0) {
+                writer.property("texCoord", pbr.baseColorTexture.texCoord);
+            }
+            writer.endObject();
+        }
+
+        writer.property("metallicFactor", pbr.metallicFactor);
+        writer.property("roughnessFactor", pbr.roughnessFactor);
+        writer.endObject();
+
+        if (material.emissiveFactor.size() == 3
+            && material.emissiveFactor != std::vector<double>{0.0, 0.0, 0.0}) {
+            writer.arrayProperty("emissiveFactor", material.emissiveFactor);
+        }
+
+        if (!material.alphaMode.empty() && material.alphaMode != "OPAQUE") {
+            writer.property("alphaMode", material.alphaMode);
+        }
+
+        if (material.alphaMode == "MASK" && material.alphaCutoff != 0.5) {
+            writer.property("alphaCutoff", material.alphaCutoff);
+        }
+
+        if (material.doubleSided) {
+            writer.property("doubleSided", true);
+        }
+
+        writeExtensions(material.extensions, writer);
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeTexturesAndImages(const tinygltf::Model &gltf, JsonWriter &writer)
+{
+    if (!gltf.textures.empty()) {
+        writer.key("textures");
+        writer.startArray();
+        for (const auto &texture : gltf.textures) {
+            writer.startObject();
+            if (texture.sampler >= 0) {
+                writer.property("sampler", texture.sampler);
+            }
+
+            if (texture.source >= 0) {
+                writer.property("source", texture.source);
+            }
+            writer.endObject();
+        }
+        writer.endArray();
+    }
+
+    if (!gltf.images.empty()) {
+        writer.key("images");
+        writer.startArray();
+        for (const auto &image : gltf.images) {
+            writer.startObject();
+            if (!image.name.empty()) {
+                writer.property("name", image.name);
+            }
+
+            if (!image.uri.empty()) {
+                writer.property("uri", image.uri);
+            }
+
+            if (image.bufferView >= 0) {
+                writer.property("bufferView", image.bufferView);
+            }
+
+            if (!image.mimeType.empty()) {
+                writer.property("mimeType", image.mimeType);
+            }
+            writer.endObject();
+        }
+        writer.endArray();
+    }
+}
+
+void writeSamplers(const std::vector<tinygltf::Sampler> &samplers, JsonWriter &writer)
+{
+    static const int REPEAT = 10497;
+
+    if (samplers.empty()) {
+        return;
+    }
+
+    writer.key("samplers");
+    writer.startArray();
+    for (const auto &sampler : samplers) {
+        writer.startObject();
+        if (sampler.magFilter >= 0) {
+            writer.property("magFilter", sampler.magFilter);
+        }
+
+        if (sampler.minFilter >= 0) {
+            writer.property("minFilter", sampler.minFilter);
+        }
+
+        if (sampler.wrapS != REPEAT) {
+            writer.property("wrapS", sampler.wrapS);
+        }
+
+        if (sampler.wrapT != REPEAT) {
+            writer.property("wrapT", sampler.wrapT);
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+}
+
+void writeExtensions(const tinygltf::ExtensionMap &extensions, JsonWriter &writer)
+{
+    if (extensions.empty()) {
+        return;
+    }
+
+    // an extension without properties, like KHR_materials_unlit, is still an object
+    writer.key("extensions");
+    writer.startObject();
+    for (const auto &extension : extensions) {
+        writer.key(extension.first);
+        if (extension.second.IsObject()) {
+            writeValue(extension.second, writer);
+        } else {
+            writer.startObject();
+            writer.endObject();
+        }
+    }
+    writer.endObject();
+}
+
+void writeValue(const tinygltf::Value &value, JsonWriter &writer)
+{
+    if (value.IsObject()) {
+        writer.startObject();
+        for (const auto &property : value.Get<tinygltf::Value::Object>()) {
+            writer.key(property.first);
+            writeValue(property.second, writer);
+        }
+        writer.endObject();
+    } else if (value.IsArray()) {
+        writer.startArray();
+        for (const auto &element : value.Get<tinygltf::Value::Array>()) {
+            writeValue(element, writer);
+        }
+        writer.endArray();
+    } else if (value.IsString()) {
+        writer.value(value.Get<std::string>());
+    } else if (value.IsBool()) {
+        writer.value(value.Get<bool>());
+    } else if (value.IsInt()) {
+        writer.value(value.Get<int>());
+    } else if (value.IsReal()) {
+        writer.value(value.Get<double>());
+    } else {
+        writer.null();
+    }
+}
+
+const char *accessorTypeToString(int type)
+{
+    switch (type) {
+    case TINYGLTF_TYPE_SCALAR:
+        return "SCALAR";
+    case TINYGLTF_TYPE_VEC2:
+        return "VEC2";
+    case TINYGLTF_TYPE_VEC3:
+        return "VEC3";
+    case TINYGLTF_TYPE_VEC4:
+        return "VEC4";
+    case TINYGLTF_TYPE_MAT2:
+        return "MAT2";
+    case TINYGLTF_TYPE_MAT3:
+        return "MAT3";
+    case TINYGLTF_TYPE_MAT4:
+        return "MAT4";
+    default:
+        throw std::invalid_argument("Unknown glTF accessor type");
+    }
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "tiny_gltf.h"
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace CDBTo3DTiles {
+struct GlbSegment
+{
+    const uint8_t *data;
+    size_t byteLength;
+};
+
+// serialize a glTF model to GLB without building a JSON document or copying the binary buffer. The GLB is
+// a list of segments pointing into the JSON chunk owned by the writer and into the first buffer of the
+// model, so the model has to outlive the writer
+class GlbWriter
+{
+public:
+    explicit GlbWriter(const tinygltf::Model &gltf);
+
+    // segments point into the header arrays of this writer, so it can be neither copied nor moved
+    GlbWriter(const GlbWriter &) = delete;
+
+    GlbWriter(GlbWriter &&) = delete;
+
+    GlbWriter &operator=(const GlbWriter &) = delete;
+
+    GlbWriter &operator=(GlbWriter &&) = delete;
+
+    inline size_t getByteLength() const noexcept { return m_byteLength; }
+
+    inline const std::vector<GlbSegment> &getSegments() const noexcept { return m_segments; }
+
+    // destination must have space for getByteLength() bytes
+    void write(uint8_t *destination) const;
+
+    void write(std::ostream &stream) const;
+
+private:
+    void addSegment(const uint8_t *data, size_t byteLength);
+
+    std::string m_json;
+    std::array<uint8_t, 20> m_header;
+    std::array<uint8_t, 8> m_binChunkHeader;
+    std::vector<GlbSegment> m_segments;
+    size_t m_byteLength;
+};
+} // namespace CDBTo3DTiles
@@ -3,7 +3,10 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "Gltf.h"
+#include "GlbWriter.h"
 #include "Utility.h"
+#include "meshoptimizer.h"
+#include <mutex>
 
 namespace std {
 template<>
@@ -25,6 +28,9 @@ struct hash<tinygltf::Sampler>
 
 namespace CDBTo3DTiles {
 
+// the largest index is kept below 65535, which WebGL 2 always treats as primitive restart for short indices
+static const size_t MAX_SHORT_INDEX_VERTICES = 65535;
+
 static void createGltfTexture(const Texture &texture,
                               tinygltf::Model &gltf,
                               std::unordered_map<tinygltf::Sampler, unsigned> *samplerCache);
@@ -33,10 +39,46 @@ static void createGltfMaterial(const Material &material, tinygltf::Model &gltf);
 
 static size_t createGltfMesh(const Mesh &mesh,
                              size_t rootIndex,
+                             const GltfOptions &options,
                              tinygltf::Model &gltf,
                              std::vector<unsigned char> &bufferData,
                              size_t bufferOffset);
 
+static size_t createGltfPrimitive(const Mesh &mesh,
+                                  const glm::dvec3 &center,
+                                  const glm::dvec3 &quantizedPositionMin,
+                                  double quantizedPositionScale,
+                                  const GltfOptions &options,
+                                  tinygltf::Model &gltf,
+                                  std::vector<unsigned char> &bufferData,
+                                  size_t bufferOffset,
+                                  tinygltf::Mesh &meshGltf);
+
+static std::vector<Mesh> splitMeshForShortIndices(const Mesh &mesh, const GltfOptions &options);
+
+static size_t calcGltfVertexSize(const Mesh &mesh, const GltfOptions &options);
+
+static size_t calcGltfMeshBufferSize(const Mesh &mesh, const GltfOptions &options);
+
+static void validateGltfOptions(const GltfOptions &options);
+
+static void addExtension(const std::string &extension, bool required, tinygltf::Model &gltf);
+
+template<typename T>
+static std::vector<T> quantizeNormals(const std::vector<glm::vec3> &normals);
+
+template<typename T>
+static std::vector<T> quantizePositions(const std::vector<glm::vec3> &positions,
+                                        const glm::dvec3 &positionMin,
+                                        double positionScale,
+                                        int bits,
+                                        glm::dvec3 &quantizedMin,
+                                        glm::dvec3 &quantizedMax);
+
+static std::vector<uint16_t> quantizeUVs(const std::vector<glm::vec2> &UVs, int bits);
+
+static bool isUVsInUnitRange(const std::vector<glm::vec2> &UVs);
+
 static int primitiveTypeToGltfMode(PrimitiveType type);
 
 static void createBufferAndAccessor(tinygltf::Model &modelGltf,
@@ -52,10 +94,24 @@ static void createBufferAndAccessor(tinygltf::Model &modelGltf,
 
 static int convertToGltfFilterMode(TextureFilter mode);
 
-tinygltf::Model createGltf(const Mesh &mesh, const Material *material, const Texture *texture)
+GltfOptions::GltfOptions()
+    : normalBits{0}
+    , positionBits{0}
+    , UVBits{0}
+    , meshoptCompression{false}
+    , meshoptFallback{MeshoptFallback::None}
+    , optimizeMeshes{false}
+{}
+
+tinygltf::Model createGltf(const Mesh &mesh,
+                           const Material *material,
+                           const Texture *texture,
+                           const GltfOptions &options)
 {
     static const std::filesystem::path TEXTURE_SUB_DIR = "Textures";
 
+    validateGltfOptions(options);
+
     tinygltf::Model gltf;
     gltf.asset.version = "2.0";
     if (material && material->unlit) {
@@ -67,10 +123,16 @@ tinygltf::Model createGltf(const Mesh &mesh, const Material *material, const Tex
     rootNodeGltf.matrix = {1, 0, 0, 0, 0, 0, -1, 0, 0, 1, 0, 0, 0, 0, 0, 1};
     gltf.nodes.emplace_back(rootNodeGltf);
 
+    std::optional<Mesh> optimizedMesh;
+    if (options.optimizeMeshes) {
+        optimizedMesh = mesh;
+        optimizeMesh(*optimizedMesh);
+    }
+
+    const Mesh &meshToWrite = optimizedMesh ? *optimizedMesh : mesh;
+
     // create buffer
-    size_t totalBufferSize = mesh.indices.size() * sizeof(uint32_t) + mesh.batchIDs.size() * sizeof(float)
-                             + mesh.positionRTCs.size() * sizeof(glm::vec3)
-                             + mesh.normals.size() * sizeof(glm::vec3) + mesh.UVs.size() * sizeof(glm::vec2);
+    size_t totalBufferSize = calcGltfMeshBufferSize(meshToWrite, options);
 
     tinygltf::Buffer bufferGltf;
     auto &bufferData = bufferGltf.data;
@@ -78,7 +140,8 @@ tinygltf::Model createGltf(const Mesh &mesh, const Material *material, const Tex
 
     // add mesh
     size_t bufferOffset = 0;
-    createGltfMesh(mesh, 0, gltf, bufferData, bufferOffset);
+    bufferOffset += createGltfMesh(meshToWrite, 0, options, gltf, bufferData, bufferOffset);
+    bufferData.resize(bufferOffset);
 
     // add material
     if (material) {
@@ -110,10 +173,13 @@ tinygltf::Model createGltf(const Mesh &mesh, const Material *material, const Tex
 
 tinygltf::Model createGltf(const std::vector<Mesh> &meshes,
                            const std::vector<Material> &materials,
-                           const std::vector<Texture> &textures)
+                           const std::vector<Texture> &textures,
+                           const GltfOptions &options)
 {
     static const std::filesystem::path TEXTURE_SUB_DIR = "Textures";
 
+    validateGltfOptions(options);
+
     tinygltf::Model gltf;
     gltf.asset.version = "2.0";
 
@@ -146,22 +212,32 @@ tinygltf::Model createGltf(const std::vector<Mesh> &meshes,
         gltf.extensionsUsed.emplace_back("KHR_materials_unlit");
     }
 
+    std::vector<Mesh> optimizedMeshes;
+    if (options.optimizeMeshes) {
+        optimizedMeshes = meshes;
+        for (auto &mesh : optimizedMeshes) {
+            optimizeMesh(mesh);
+        }
+    }
+
+    const std::vector<Mesh> &meshesToWrite = options.optimizeMeshes ? optimizedMeshes : meshes;
+
     // create mesh node
     tinygltf::Buffer bufferGltf;
     size_t totalBufferSize = 0;
-    for (const auto &mesh : meshes) {
-        totalBufferSize += mesh.indices.size() * sizeof(uint32_t) + mesh.batchIDs.size() * sizeof(float)
-                           + mesh.positionRTCs.size() * sizeof(glm::vec3)
-                           + mesh.normals.size() * sizeof(glm::vec3) + mesh.UVs.size() * sizeof(glm::vec2);
+    for (const auto &mesh : meshesToWrite) {
+        totalBufferSize += calcGltfMeshBufferSize(mesh, options);
     }
 
     auto &bufferData = bufferGltf.data;
     bufferData.resize(totalBufferSize);
     size_t bufferOffset = 0;
-    for (const auto &mesh : meshes) {
-        bufferOffset += createGltfMesh(mesh, 0, gltf, bufferData, bufferOffset);
+    for (const auto &mesh : meshesToWrite) {
+        bufferOffset += createGltfMesh(mesh, 0, options, gltf, bufferData, bufferOffset);
     }
 
+    bufferData.resize(bufferOffset);
+
     // add buffer to the model
     gltf.buffers.emplace_back(bufferGltf);
 
@@ -173,6 +249,17 @@ tinygltf::Model createGltf(const std::vector<Mesh> &meshes,
     return gltf;
 }
 
+std::vector<uint8_t> createGlb(tinygltf::Model &gltf, const GltfOptions &options)
+{
+    compressGltfWithMeshopt(gltf, options);
+
+    GlbWriter writer(gltf);
+    std::vector<uint8_t> glb(writer.getByteLength());
+    writer.write(glb.data());
+
+    return glb;
+}
+
 void createGltfTexture(const Texture &texture,
                        tinygltf::Model &gltf,
                        std::unordered_map<tinygltf::Sampler, unsigned> *samplerCache)
@@ -247,12 +334,92 @@ void createGltfMaterial(const Material &material, tinygltf::Model &gltf)
 
 size_t createGltfMesh(const Mesh &mesh,
                       size_t rootIndex,
+                      const GltfOptions &options,
                       tinygltf::Model &gltf,
                       std::vector<unsigned char> &bufferData,
                       size_t offset)
 {
     std::optional<AABB> aabb = mesh.aabb;
     glm::dvec3 center = aabb ? aabb->center() : glm::dvec3(0.0);
+    glm::dvec3 nodeTranslation = center;
+    std::optional<double> nodeScale;
+
+    // quantized positions are offset by the minimum of the bounding box and uniformly scaled, so the node
+    // transform can restore them without distorting the normals. Every primitive of the mesh shares the node
+    glm::dvec3 positionMin(0.0);
+    double positionScale = 1.0;
+    if (!mesh.positionRTCs.empty() && options.positionBits > 0) {
+        glm::dvec3 positionMax(0.0);
+        if (aabb) {
+            positionMin = aabb->min - center;
+            positionMax = aabb->max - center;
+        } else {
+            positionMin = glm::dvec3(std::numeric_limits<double>::max());
+            positionMax = glm::dvec3(std::numeric_limits<double>::lowest());
+            for (const auto &positionRTC : mesh.positionRTCs) {
+                positionMin = glm::min(positionMin, glm::dvec3(positionRTC));
+                positionMax = glm::max(positionMax, glm::dvec3(positionRTC));
+            }
+        }
+
+        glm::dvec3 extent = positionMax - positionMin;
+        double maxExtent = glm::max(extent.x, glm::max(extent.y, extent.z));
+        double maxQuantizedValue = static_cast<double>((1 << options.positionBits) - 1);
+        positionScale = maxExtent > 0.0 ? maxExtent / maxQuantizedValue : 1.0;
+
+        nodeTranslation = center + positionMin;
+        nodeScale = positionScale;
+    }
+
+    // add mesh
+    tinygltf::Mesh meshGltf;
+    size_t totalMeshSize = 0;
+    std::vector<Mesh> subMeshes = splitMeshForShortIndices(mesh, options);
+    if (subMeshes.empty()) {
+        totalMeshSize += createGltfPrimitive(
+            mesh, center, positionMin, positionScale, options, gltf, bufferData, offset, meshGltf);
+    } else {
+        for (const auto &subMesh : subMeshes) {
+            totalMeshSize += createGltfPrimitive(subMesh,
+                                                 center,
+                                                 positionMin,
+                                                 positionScale,
+                                                 options,
+                                                 gltf,
+                                                 bufferData,
+                                                 offset + totalMeshSize,
+                                                 meshGltf);
+        }
+    }
+
+    gltf.meshes.emplace_back(meshGltf);
+
+    // create node
+    tinygltf::Node meshNode;
+    meshNode.mesh = static_cast<int>(gltf.meshes.size() - 1);
+    meshNode.translation = {nodeTranslation.x, nodeTranslation.y, nodeTranslation.z};
+    if (nodeScale) {
+        meshNode.scale = {*nodeScale, *nodeScale, *nodeScale};
+    }
+    gltf.nodes.emplace_back(meshNode);
+
+    // add node to the root
+    gltf.nodes[rootIndex].children.emplace_back(gltf.nodes.size() - 1);
+
+    return totalMeshSize;
+}
+
+size_t createGltfPrimitive(const Mesh &mesh,
+                           const glm::dvec3 &center,
+                           const glm::dvec3 &quantizedPositionMin,
+                           double quantizedPositionScale,
+                           const GltfOptions &options,
+                           tinygltf::Model &gltf,
+                           std::vector<unsigned char> &bufferData,
+                           size_t offset,
+                           tinygltf::Mesh &meshGltf)
+{
+    std::optional<AABB> aabb = mesh.aabb;
     glm::dvec3 positionMin = aabb ? aabb->min - center : glm::dvec3(0.0);
     glm::dvec3 positionMax = aabb ? aabb->max - center : glm::dvec3(0.0);
 
@@ -267,8 +434,32 @@ size_t createGltfMesh(const Mesh &mesh,
     size_t nextSize = 0;
     size_t totalMeshSize = 0;
 
-    // copy indices
-    if (!mesh.indices.empty()) {
+    // copy indices. Short indices are used whenever every vertex can be addressed by them
+    if (!mesh.indices.empty() && mesh.positionRTCs.size() <= MAX_SHORT_INDEX_VERTICES) {
+        std::vector<uint16_t> shortIndices;
+        shortIndices.reserve(mesh.indices.size());
+        for (auto index : mesh.indices) {
+            shortIndices.emplace_back(static_cast<uint16_t>(index));
+        }
+
+        nextSize = shortIndices.size() * sizeof(uint16_t);
+        createBufferAndAccessor(gltf,
+                                bufferData.data() + offset,
+                                shortIndices.data(),
+                                bufferIndex,
+                                offset,
+                                nextSize,
+                                TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER,
+                                shortIndices.size(),
+                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                TINYGLTF_TYPE_SCALAR);
+
+        // pad the indices so that the vertex attributes after them stay 4-byte aligned
+        nextSize = roundUp(nextSize, 4);
+        primitiveGltf.indices = static_cast<int>(gltf.accessors.size() - 1);
+        offset += nextSize;
+        totalMeshSize += nextSize;
+    } else if (!mesh.indices.empty()) {
         nextSize = mesh.indices.size() * sizeof(uint32_t);
         createBufferAndAccessor(gltf,
                                 bufferData.data() + offset,
@@ -306,7 +497,58 @@ size_t createGltfMesh(const Mesh &mesh,
     }
 
     // copy positions
-    if (!mesh.positionRTCs.empty()) {
+    if (!mesh.positionRTCs.empty() && options.positionBits > 0) {
+        glm::dvec3 quantizedMin;
+        glm::dvec3 quantizedMax;
+        if (options.positionBits <= 8) {
+            auto quantizedPositions = quantizePositions<uint8_t>(mesh.positionRTCs,
+                                                                 quantizedPositionMin,
+                                                                 quantizedPositionScale,
+                                                                 options.positionBits,
+                                                                 quantizedMin,
+                                                                 quantizedMax);
+            nextSize = quantizedPositions.size() * sizeof(uint8_t);
+            createBufferAndAccessor(gltf,
+                                    bufferData.data() + offset,
+                                    quantizedPositions.data(),
+                                    bufferIndex,
+                                    offset,
+                                    nextSize,
+                                    TINYGLTF_TARGET_ARRAY_BUFFER,
+                                    mesh.positionRTCs.size(),
+                                    TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+                                    TINYGLTF_TYPE_VEC3);
+            gltf.bufferViews.back().byteStride = 4 * sizeof(uint8_t);
+        } else {
+            auto quantizedPositions = quantizePositions<uint16_t>(mesh.positionRTCs,
+                                                                  quantizedPositionMin,
+                                                                  quantizedPositionScale,
+                                                                  options.positionBits,
+                                                                  quantizedMin,
+                                                                  quantizedMax);
+            nextSize = quantizedPositions.size() * sizeof(uint16_t);
+            createBufferAndAccessor(gltf,
+                                    bufferData.data() + offset,
+                                    quantizedPositions.data(),
+                                    bufferIndex,
+                                    offset,
+                                    nextSize,
+                                    TINYGLTF_TARGET_ARRAY_BUFFER,
+                                    mesh.positionRTCs.size(),
+                                    TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                    TINYGLTF_TYPE_VEC3);
+            gltf.bufferViews.back().byteStride = 4 * sizeof(uint16_t);
+        }
+
+        auto &positionsAccessor = gltf.accessors.back();
+        positionsAccessor.minValues = {quantizedMin.x, quantizedMin.y, quantizedMin.z};
+        positionsAccessor.maxValues = {quantizedMax.x, quantizedMax.y, quantizedMax.z};
+        addExtension("KHR_mesh_quantization", true, gltf);
+
+        primitiveGltf.attributes["POSITION"] = static_cast<int>(gltf.accessors.size() - 1);
+        offset += nextSize;
+        totalMeshSize += nextSize;
+    } else if (!mesh.positionRTCs.empty()) {
         nextSize = mesh.positionRTCs.size() * sizeof(glm::vec3);
         createBufferAndAccessor(gltf,
                                 bufferData.data() + offset,
@@ -329,7 +571,49 @@ size_t createGltfMesh(const Mesh &mesh,
     }
 
     // copy normals
-    if (!mesh.normals.empty()) {
+    if (!mesh.normals.empty() && options.normalBits == 8) {
+        auto quantizedNormals = quantizeNormals<int8_t>(mesh.normals);
+        nextSize = quantizedNormals.size() * sizeof(int8_t);
+        createBufferAndAccessor(gltf,
+                                bufferData.data() + offset,
+                                quantizedNormals.data(),
+                                bufferIndex,
+                                offset,
+                                nextSize,
+                                TINYGLTF_TARGET_ARRAY_BUFFER,
+                                mesh.normals.size(),
+                                TINYGLTF_COMPONENT_TYPE_BYTE,
+                                TINYGLTF_TYPE_VEC3);
+
+        gltf.bufferViews.back().byteStride = 4 * sizeof(int8_t);
+        gltf.accessors.back().normalized = true;
+        addExtension("KHR_mesh_quantization", true, gltf);
+
+        primitiveGltf.attributes["NORMAL"] = static_cast<int>(gltf.accessors.size() - 1);
+        offset += nextSize;
+        totalMeshSize += nextSize;
+    } else if (!mesh.normals.empty() && options.normalBits == 16) {
+        auto quantizedNormals = quantizeNormals<int16_t>(mesh.normals);
+        nextSize = quantizedNormals.size() * sizeof(int16_t);
+        createBufferAndAccessor(gltf,
+                                bufferData.data() + offset,
+                                quantizedNormals.data(),
+                                bufferIndex,
+                                offset,
+                                nextSize,
+                                TINYGLTF_TARGET_ARRAY_BUFFER,
+                                mesh.normals.size(),
+                                TINYGLTF_COMPONENT_TYPE_SHORT,
+                                TINYGLTF_TYPE_VEC3);
+
+        gltf.bufferViews.back().byteStride = 4 * sizeof(int16_t);
+        gltf.accessors.back().normalized = true;
+        addExtension("KHR_mesh_quantization", true, gltf);
+
+        primitiveGltf.attributes["NORMAL"] = static_cast<int>(gltf.accessors.size() - 1);
+        offset += nextSize;
+        totalMeshSize += nextSize;
+    } else if (!mesh.normals.empty()) {
         nextSize = mesh.normals.size() * sizeof(glm::vec3);
         createBufferAndAccessor(gltf,
                                 bufferData.data() + offset,
@@ -347,8 +631,27 @@ size_t createGltfMesh(const Mesh &mesh,
         totalMeshSize += nextSize;
     }
 
-    // copy uv
-    if (!mesh.UVs.empty()) {
+    // copy uv. Normalized unsigned short can only represent UVs in the range [0, 1]
+    if (!mesh.UVs.empty() && options.UVBits > 0 && isUVsInUnitRange(mesh.UVs)) {
+        auto quantizedUVs = quantizeUVs(mesh.UVs, options.UVBits);
+        nextSize = quantizedUVs.size() * sizeof(uint16_t);
+        createBufferAndAccessor(gltf,
+                                bufferData.data() + offset,
+                                quantizedUVs.data(),
+                                bufferIndex,
+                                offset,
+                                nextSize,
+                                TINYGLTF_TARGET_ARRAY_BUFFER,
+                                mesh.UVs.size(),
+                                TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT,
+                                TINYGLTF_TYPE_VEC2);
+
+        gltf.accessors.back().normalized = true;
+
+        primitiveGltf.attributes["TEXCOORD_0"] = static_cast<int>(gltf.accessors.size() - 1);
+        offset += nextSize;
+        totalMeshSize += nextSize;
+    } else if (!mesh.UVs.empty()) {
         nextSize = mesh.UVs.size() * sizeof(glm::vec2);
         createBufferAndAccessor(gltf,
                                 bufferData.data() + offset,
@@ -366,21 +669,512 @@ size_t createGltfMesh(const Mesh &mesh,
         totalMeshSize += nextSize;
     }
 
-    // add mesh
-    tinygltf::Mesh meshGltf;
     meshGltf.primitives.emplace_back(primitiveGltf);
-    gltf.meshes.emplace_back(meshGltf);
 
-    // create node
-    tinygltf::Node meshNode;
-    meshNode.mesh = static_cast<int>(gltf.meshes.size() - 1);
-    meshNode.translation = {center.x, center.y, center.z};
-    gltf.nodes.emplace_back(meshNode);
+    return totalMeshSize;
+}
 
-    // add node to the root
-    gltf.nodes[rootIndex].children.emplace_back(gltf.nodes.size() - 1);
+std::vector<Mesh> splitMeshForShortIndices(const Mesh &mesh, const GltfOptions &options)
+{
+    static const uint32_t INVALID_CHUNK = std::numeric_limits<uint32_t>::max();
 
-    return totalMeshSize;
+    size_t vertexCount = mesh.positionRTCs.size();
+    if (mesh.indices.empty() || vertexCount <= MAX_SHORT_INDEX_VERTICES) {
+        return {};
+    }
+
+    size_t primitiveSize = 0;
+    if (mesh.primitiveType == PrimitiveType::Triangles) {
+        primitiveSize = 3;
+    } else if (mesh.primitiveType == PrimitiveType::Lines) {
+        primitiveSize = 2;
+    } else {
+        return {};
+    }
+
+    if (mesh.indices.size() % primitiveSize != 0 || mesh.positions.size() != vertexCount
+        || (!mesh.UVs.empty() && mesh.UVs.size() != vertexCount)
+        || (!mesh.normals.empty() && mesh.normals.size() != vertexCount)
+        || (!mesh.batchIDs.empty() && mesh.batchIDs.size() != vertexCount)) {
+        return {};
+    }
+
+    // greedily group consecutive primitives into chunks that can use short indices. Vertices shared between
+    // chunks are duplicated
+    std::vector<uint32_t> vertexChunks(vertexCount, INVALID_CHUNK);
+    std::vector<size_t> chunkIndexEnds;
+    std::vector<size_t> chunkVertexCounts;
+    size_t chunkVertexCount = 0;
+    for (size_t i = 0; i < mesh.indices.size(); i += primitiveSize) {
+        uint32_t chunk = static_cast<uint32_t>(chunkIndexEnds.size());
+        size_t newVertexCount = 0;
+        for (size_t j = 0; j < primitiveSize; ++j) {
+            uint32_t index = mesh.indices[i + j];
+            if (index >= vertexCount) {
+                return {};
+            }
+
+            if (vertexChunks[index] != chunk) {
+                ++newVertexCount;
+            }
+        }
+
+        if (chunkVertexCount + newVertexCount > MAX_SHORT_INDEX_VERTICES) {
+            chunkIndexEnds.emplace_back(i);
+            chunkVertexCounts.emplace_back(chunkVertexCount);
+            chunkVertexCount = 0;
+            ++chunk;
+        }
+
+        for (size_t j = 0; j < primitiveSize; ++j) {
+            uint32_t index = mesh.indices[i + j];
+            if (vertexChunks[index] != chunk) {
+                vertexChunks[index] = chunk;
+                ++chunkVertexCount;
+            }
+        }
+    }
+
+    chunkIndexEnds.emplace_back(mesh.indices.size());
+    chunkVertexCounts.emplace_back(chunkVertexCount);
+
+    // only split when halving the index size outweighs the duplicated vertices
+    size_t vertexSize = calcGltfVertexSize(mesh, options);
+    size_t splitSize = 0;
+    size_t chunkIndexBegin = 0;
+    for (size_t i = 0; i < chunkIndexEnds.size(); ++i) {
+        splitSize += roundUp((chunkIndexEnds[i] - chunkIndexBegin) * sizeof(uint16_t), 4);
+        splitSize += chunkVertexCounts[i] * vertexSize;
+        chunkIndexBegin = chunkIndexEnds[i];
+    }
+
+    size_t unsplitSize = mesh.indices.size() * sizeof(uint32_t) + vertexCount * vertexSize;
+    if (splitSize >= unsplitSize) {
+        return {};
+    }
+
+    std::vector<Mesh> subMeshes;
+    subMeshes.reserve(chunkIndexEnds.size());
+    std::vector<uint32_t> remap(vertexCount, INVALID_CHUNK);
+    chunkIndexBegin = 0;
+    for (size_t i = 0; i < chunkIndexEnds.size(); ++i) {
+        Mesh subMesh;
+        subMesh.primitiveType = mesh.primitiveType;
+        subMesh.material = mesh.material;
+        if (mesh.aabb) {
+            subMesh.aabb = AABB();
+        }
+
+        std::vector<uint32_t> subMeshVertices;
+        subMeshVertices.reserve(chunkVertexCounts[i]);
+        subMesh.indices.reserve(chunkIndexEnds[i] - chunkIndexBegin);
+        for (size_t j = chunkIndexBegin; j < chunkIndexEnds[i]; ++j) {
+            uint32_t index = mesh.indices[j];
+            if (remap[index] == INVALID_CHUNK) {
+                remap[index] = static_cast<uint32_t>(subMeshVertices.size());
+                subMeshVertices.emplace_back(index);
+            }
+
+            subMesh.indices.emplace_back(remap[index]);
+        }
+
+        for (auto vertex : subMeshVertices) {
+            subMesh.positions.emplace_back(mesh.positions[vertex]);
+            subMesh.positionRTCs.emplace_back(mesh.positionRTCs[vertex]);
+            if (!mesh.normals.empty()) {
+                subMesh.normals.emplace_back(mesh.normals[vertex]);
+            }
+
+            if (!mesh.UVs.empty()) {
+                subMesh.UVs.emplace_back(mesh.UVs[vertex]);
+            }
+
+            if (!mesh.batchIDs.empty()) {
+                subMesh.batchIDs.emplace_back(mesh.batchIDs[vertex]);
+            }
+
+            if (subMesh.aabb) {
+                subMesh.aabb->merge(mesh.positions[vertex]);
+            }
+
+            remap[vertex] = INVALID_CHUNK;
+        }
+
+        subMeshes.emplace_back(std::move(subMesh));
+        chunkIndexBegin = chunkIndexEnds[i];
+    }
+
+    return subMeshes;
+}
+
+size_t calcGltfVertexSize(const Mesh &mesh, const GltfOptions &options)
+{
+    // quantized positions and normals are padded to 4 components so that each vertex stays 4-byte aligned
+    size_t vertexSize = 0;
+    if (!mesh.positionRTCs.empty() && options.positionBits > 8) {
+        vertexSize += 4 * sizeof(uint16_t);
+    } else if (!mesh.positionRTCs.empty() && options.positionBits > 0) {
+        vertexSize += 4 * sizeof(uint8_t);
+    } else if (!mesh.positionRTCs.empty()) {
+        vertexSize += sizeof(glm::vec3);
+    }
+
+    if (!mesh.normals.empty() && options.normalBits == 8) {
+        vertexSize += 4 * sizeof(int8_t);
+    } else if (!mesh.normals.empty() && options.normalBits == 16) {
+        vertexSize += 4 * sizeof(int16_t);
+    } else if (!mesh.normals.empty()) {
+        vertexSize += sizeof(glm::vec3);
+    }
+
+    if (!mesh.UVs.empty() && options.UVBits > 0 && isUVsInUnitRange(mesh.UVs)) {
+        vertexSize += 2 * sizeof(uint16_t);
+    } else if (!mesh.UVs.empty()) {
+        vertexSize += sizeof(glm::vec2);
+    }
+
+    if (!mesh.batchIDs.empty()) {
+        vertexSize += sizeof(float);
+    }
+
+    return vertexSize;
+}
+
+size_t calcGltfMeshBufferSize(const Mesh &mesh, const GltfOptions &options)
+{
+    // the size is an upper bound. Short indices and split meshes are only used when they take less space.
+    // Quantized positions and normals are padded to 4 components so that each vertex stays 4-byte aligned
+    size_t positionSize = sizeof(glm::vec3);
+    if (options.positionBits > 8) {
+        positionSize = 4 * sizeof(uint16_t);
+    } else if (options.positionBits > 0) {
+        positionSize = 4 * sizeof(uint8_t);
+    }
+
+    size_t normalSize = sizeof(glm::vec3);
+    if (options.normalBits == 8) {
+        normalSize = 4 * sizeof(int8_t);
+    } else if (options.normalBits == 16) {
+        normalSize = 4 * sizeof(int16_t);
+    }
+
+    size_t UVSize = sizeof(glm::vec2);
+    if (options.UVBits > 0 && isUVsInUnitRange(mesh.UVs)) {
+        UVSize = 2 * sizeof(uint16_t);
+    }
+
+    return mesh.indices.size() * sizeof(uint32_t) + mesh.batchIDs.size() * sizeof(float)
+           + mesh.positionRTCs.size() * positionSize + mesh.normals.size() * normalSize
+           + mesh.UVs.size() * UVSize;
+}
+
+void validateGltfOptions(const GltfOptions &options)
+{
+    if (options.normalBits != 0 && options.normalBits != 8 && options.normalBits != 16) {
+        throw std::invalid_argument("Normal quantization bits must be 0, 8, or 16");
+    }
+
+    if (options.positionBits < 0 || options.positionBits > 16) {
+        throw std::invalid_argument("Position quantization bits must be in the range [0, 16]");
+    }
+
+    if (options.UVBits < 0 || options.UVBits > 16) {
+        throw std::invalid_argument("UV quantization bits must be in the range [0, 16]");
+    }
+}
+
+void addExtension(const std::string &extension, bool required, tinygltf::Model &gltf)
+{
+    auto &used = gltf.extensionsUsed;
+    if (std::find(used.begin(), used.end(), extension) == used.end()) {
+        used.emplace_back(extension);
+    }
+
+    auto &requiredExtensions = gltf.extensionsRequired;
+    if (required
+        && std::find(requiredExtensions.begin(), requiredExtensions.end(), extension)
+               == requiredExtensions.end()) {
+        requiredExtensions.emplace_back(extension);
+    }
+}
+
+void compressGltfWithMeshopt(tinygltf::Model &gltf, const GltfOptions &options)
+{
+    static const std::string EXTENSION = "EXT_meshopt_compression";
+
+    if (!options.meshoptCompression) {
+        return;
+    }
+
+    // EXT_meshopt_compression is specified against vertex codec 0 and index codec 1
+    static std::once_flag codecVersionFlag;
+    std::call_once(codecVersionFlag, []() {
+        meshopt_encodeVertexVersion(0);
+        meshopt_encodeIndexVersion(1);
+    });
+
+    // only models with the single buffer written by createGltf are compressed, and only once
+    if (gltf.buffers.size() != 1 || gltf.bufferViews.empty()) {
+        return;
+    }
+
+    for (const auto &bufferView : gltf.bufferViews) {
+        if (bufferView.extensions.find(EXTENSION) != bufferView.extensions.end()) {
+            return;
+        }
+    }
+
+    // find out how each buffer view is used. Only triangle indices and vertex attributes with a stride
+    // divisible by 4 can be encoded
+    enum class ViewMode
+    {
+        Unknown,
+        Attributes,
+        Triangles
+    };
+
+    struct ViewUsage
+    {
+        ViewMode mode = ViewMode::Unknown;
+        size_t count = 0;
+        size_t byteStride = 0;
+        int componentType = 0;
+        bool octahedral = false;
+    };
+
+    auto &bufferViews = gltf.bufferViews;
+    std::vector<ViewUsage> usages(bufferViews.size());
+    for (const auto &accessor : gltf.accessors) {
+        if (accessor.bufferView < 0 || accessor.byteOffset != 0) {
+            continue;
+        }
+
+        const auto &view = bufferViews[static_cast<size_t>(accessor.bufferView)];
+        size_t componentSize = static_cast<size_t>(
+            tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType)));
+        size_t componentCount = static_cast<size_t>(
+            tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type)));
+
+        auto &usage = usages[static_cast<size_t>(accessor.bufferView)];
+        usage.mode = ViewMode::Attributes;
+        usage.count = accessor.count;
+        usage.byteStride = view.byteStride != 0 ? view.byteStride : componentSize * componentCount;
+        usage.componentType = accessor.componentType;
+    }
+
+    for (const auto &mesh : gltf.meshes) {
+        for (const auto &primitive : mesh.primitives) {
+            if (primitive.indices >= 0) {
+                const auto &accessor = gltf.accessors[static_cast<size_t>(primitive.indices)];
+                int mode = primitive.mode >= 0 ? primitive.mode : TINYGLTF_MODE_TRIANGLES;
+                auto &usage = usages[static_cast<size_t>(accessor.bufferView)];
+                bool isTriangles = mode == TINYGLTF_MODE_TRIANGLES && usage.count % 3 == 0;
+                usage.mode = isTriangles ? ViewMode::Triangles : ViewMode::Unknown;
+            }
+
+            auto normal = primitive.attributes.find("NORMAL");
+            if (normal != primitive.attributes.end()) {
+                const auto &accessor = gltf.accessors[static_cast<size_t>(normal->second)];
+                auto &usage = usages[static_cast<size_t>(accessor.bufferView)];
+                usage.octahedral = accessor.normalized
+                                   && (usage.componentType == TINYGLTF_COMPONENT_TYPE_BYTE
+                                       || usage.componentType == TINYGLTF_COMPONENT_TYPE_SHORT);
+            }
+        }
+    }
+
+    // compress each buffer view. Keep the view uncompressed if the encoded stream is not smaller.
+    // Without fallback, the uncompressed data moves to the fallback buffer, which is never written out.
+    // The new layout is staged and only replaces the model once a view is compressed
+    bool isRequired = options.meshoptFallback == MeshoptFallback::None;
+    std::vector<unsigned char> &bin = gltf.buffers.front().data;
+    std::vector<unsigned char> newBin;
+    size_t newBinOffset = isRequired ? 0 : bin.size();
+    std::vector<tinygltf::BufferView> newBufferViews = bufferViews;
+
+    bool isCompressed = false;
+    for (size_t i = 0; i < newBufferViews.size(); ++i) {
+        auto &view = newBufferViews[i];
+        const auto &usage = usages[i];
+        size_t byteOffset = view.byteOffset;
+        size_t byteLength = view.byteLength;
+        if (view.buffer != 0) {
+            continue;
+        }
+
+        std::vector<uint8_t> encoded;
+        const uint8_t *viewData = bin.data() + byteOffset;
+        if (usage.mode == ViewMode::Attributes && usage.count > 0 && usage.byteStride % 4 == 0
+            && usage.byteStride <= 256 && usage.count * usage.byteStride == byteLength) {
+            std::vector<uint8_t> filtered;
+            if (usage.octahedral) {
+                // re-encode the quantized normals with the octahedral filter so they compress better
+                bool isByte = usage.componentType == TINYGLTF_COMPONENT_TYPE_BYTE;
+                float maxValue = isByte ? 127.0f : 32767.0f;
+                std::vector<float> normals(usage.count * 4);
+                for (size_t j = 0; j < usage.count; ++j) {
+                    for (size_t k = 0; k < 3; ++k) {
+                        if (isByte) {
+                            int8_t value;
+                            std::memcpy(&value, viewData + j * usage.byteStride + k, sizeof(int8_t));
+                            normals[j * 4 + k] = static_cast<float>(value) / maxValue;
+                        } else {
+                            int16_t value;
+                            std::memcpy(&value, viewData + j * usage.byteStride + k * 2, sizeof(int16_t));
+                            normals[j * 4 + k] = static_cast<float>(value) / maxValue;
+                        }
+                    }
+                }
+
+                filtered.resize(byteLength);
+                meshopt_encodeFilterOct(
+                    filtered.data(), usage.count, usage.byteStride, isByte ? 8 : 16, normals.data());
+                viewData = filtered.data();
+            }
+
+            encoded.resize(meshopt_encodeVertexBufferBound(usage.count, usage.byteStride));
+            encoded.resize(meshopt_encodeVertexBuffer(
+                encoded.data(), encoded.size(), viewData, usage.count, usage.byteStride));
+        } else if (usage.mode == ViewMode::Triangles && usage.count > 0
+                   && usage.count * usage.byteStride == byteLength) {
+            if (usage.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+                std::vector<uint32_t> indices(usage.count);
+                std::memcpy(indices.data(), viewData, byteLength);
+                size_t vertexCount = *std::max_element(indices.begin(), indices.end()) + 1;
+                encoded.resize(meshopt_encodeIndexBufferBound(usage.count, vertexCount));
+                encoded.resize(
+                    meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), indices.data(), usage.count));
+            } else if (usage.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                std::vector<uint16_t> indices(usage.count);
+                std::memcpy(indices.data(), viewData, byteLength);
+                size_t vertexCount = *std::max_element(indices.begin(), indices.end()) + 1u;
+                encoded.resize(meshopt_encodeIndexBufferBound(usage.count, vertexCount));
+                encoded.resize(
+                    meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), indices.data(), usage.count));
+            }
+        }
+
+        if (!encoded.empty() && encoded.size() < byteLength) {
+            size_t encodedOffset = newBinOffset + newBin.size();
+            newBin.insert(newBin.end(), encoded.begin(), encoded.end());
+            newBin.resize(roundUp(newBin.size(), 4), 0);
+
+            tinygltf::Value::Object extension;
+            extension["buffer"] = tinygltf::Value(0);
+            extension["byteOffset"] = tinygltf::Value(static_cast<int>(encodedOffset));
+            extension["byteLength"] = tinygltf::Value(static_cast<int>(encoded.size()));
+            extension["byteStride"] = tinygltf::Value(static_cast<int>(usage.byteStride));
+            extension["count"] = tinygltf::Value(static_cast<int>(usage.count));
+            extension["mode"] = tinygltf::Value(
+                std::string(usage.mode == ViewMode::Triangles ? "TRIANGLES" : "ATTRIBUTES"));
+            if (usage.octahedral) {
+                extension["filter"] = tinygltf::Value(std::string("OCTAHEDRAL"));
+            }
+
+            view.extensions[EXTENSION] = tinygltf::Value(extension);
+            if (isRequired) {
+                view.buffer = 1;
+            }
+
+            isCompressed = true;
+        } else if (isRequired) {
+            // the view has to stay in the binary chunk since the fallback buffer has no data
+            view.byteOffset = newBin.size();
+            auto viewBegin = bin.begin() + static_cast<std::ptrdiff_t>(byteOffset);
+            newBin.insert(newBin.end(), viewBegin, viewBegin + static_cast<std::ptrdiff_t>(byteLength));
+            newBin.resize(roundUp(newBin.size(), 4), 0);
+        }
+    }
+
+    if (!isCompressed) {
+        return;
+    }
+
+    bufferViews = std::move(newBufferViews);
+    if (isRequired) {
+        tinygltf::Value::Object fallback;
+        fallback["fallback"] = tinygltf::Value(true);
+
+        tinygltf::Buffer fallbackBuffer;
+        fallbackBuffer.data = std::move(bin);
+        fallbackBuffer.extensions[EXTENSION] = tinygltf::Value(fallback);
+        gltf.buffers.front().data = std::move(newBin);
+        gltf.buffers.emplace_back(std::move(fallbackBuffer));
+    } else {
+        bin.insert(bin.end(), newBin.begin(), newBin.end());
+    }
+
+    addExtension(EXTENSION, isRequired, gltf);
+}
+
+template<typename T>
+std::vector<T> quantizeNormals(const std::vector<glm::vec3> &normals)
+{
+    float maxValue = static_cast<float>(std::numeric_limits<T>::max());
+    std::vector<T> quantized;
+    quantized.reserve(normals.size() * 4);
+    for (const auto &normal : normals) {
+        glm::vec3 scaled = glm::round(glm::clamp(normal, -1.0f, 1.0f) * maxValue);
+        quantized.emplace_back(static_cast<T>(scaled.x));
+        quantized.emplace_back(static_cast<T>(scaled.y));
+        quantized.emplace_back(static_cast<T>(scaled.z));
+        quantized.emplace_back(static_cast<T>(0));
+    }
+
+    return quantized;
+}
+
+template<typename T>
+std::vector<T> quantizePositions(const std::vector<glm::vec3> &positions,
+                                 const glm::dvec3 &positionMin,
+                                 double positionScale,
+                                 int bits,
+                                 glm::dvec3 &quantizedMin,
+                                 glm::dvec3 &quantizedMax)
+{
+    double maxValue = static_cast<double>((1 << bits) - 1);
+    quantizedMin = glm::dvec3(maxValue);
+    quantizedMax = glm::dvec3(0.0);
+
+    std::vector<T> quantized;
+    quantized.reserve(positions.size() * 4);
+    for (const auto &position : positions) {
+        glm::dvec3 scaled = glm::round((glm::dvec3(position) - positionMin) / positionScale);
+        scaled = glm::clamp(scaled, 0.0, maxValue);
+        quantizedMin = glm::min(quantizedMin, scaled);
+        quantizedMax = glm::max(quantizedMax, scaled);
+
+        quantized.emplace_back(static_cast<T>(scaled.x));
+        quantized.emplace_back(static_cast<T>(scaled.y));
+        quantized.emplace_back(static_cast<T>(scaled.z));
+        quantized.emplace_back(static_cast<T>(0));
+    }
+
+    return quantized;
+}
+
+std::vector<uint16_t> quantizeUVs(const std::vector<glm::vec2> &UVs, int bits)
+{
+    // round to the bit budget first, then expand to the full range of the normalized unsigned short
+    double maxValue = static_cast<double>((1 << bits) - 1);
+    double normalizedScale = static_cast<double>(std::numeric_limits<uint16_t>::max()) / maxValue;
+
+    std::vector<uint16_t> quantized;
+    quantized.reserve(UVs.size() * 2);
+    for (const auto &UV : UVs) {
+        glm::dvec2 scaled = glm::round(glm::round(glm::dvec2(UV) * maxValue) * normalizedScale);
+        quantized.emplace_back(static_cast<uint16_t>(scaled.x));
+        quantized.emplace_back(static_cast<uint16_t>(scaled.y));
+    }
+
+    return quantized;
+}
+
+bool isUVsInUnitRange(const std::vector<glm::vec2> &UVs)
+{
+    return std::all_of(UVs.begin(), UVs.end(), [](const glm::vec2 &UV) {
+        return UV.x >= 0.0f && UV.x <= 1.0f && UV.y >= 0.0f && UV.y <= 1.0f;
+    });
 }
 
 int primitiveTypeToGltfMode(PrimitiveType type)
@@ -8,11 +8,52 @@
 #include <vector>
 
 namespace CDBTo3DTiles {
+enum class MeshoptFallback
+{
+    // compressed buffer views have no uncompressed data. EXT_meshopt_compression becomes a required extension
+    None,
 
-tinygltf::Model createGltf(const Mesh &mesh, const Material *material, const Texture *texture);
+    // uncompressed buffer views are kept alongside the compressed ones for clients without the extension
+    Uncompressed
+};
+
+struct GltfOptions
+{
+    GltfOptions();
+
+    // 0 keeps float normals. 8 or 16 stores normalized integer normals using KHR_mesh_quantization
+    int normalBits;
+
+    // 0 keeps float positions. Otherwise positions are quantized to unsigned integers within the mesh
+    // bounding box using KHR_mesh_quantization
+    int positionBits;
+
+    // 0 keeps float UVs. Otherwise UVs in the range [0, 1] are stored as normalized unsigned short
+    int UVBits;
+
+    // compress buffer views with EXT_meshopt_compression before the model is written to GLB
+    bool meshoptCompression;
+
+    MeshoptFallback meshoptFallback;
+
+    // reorder mesh indices and vertices with optimizeMesh before the buffers are written
+    bool optimizeMeshes;
+};
+
+tinygltf::Model createGltf(const Mesh &mesh,
+                           const Material *material,
+                           const Texture *texture,
+                           const GltfOptions &options = GltfOptions());
 
 tinygltf::Model createGltf(const std::vector<Mesh> &meshes,
                            const std::vector<Material> &materials,
-                           const std::vector<Texture> &textures);
+                           const std::vector<Texture> &textures,
+                           const GltfOptions &options = GltfOptions());
+
+// encode the buffer views in place when the options ask for EXT_meshopt_compression. The extension is only
+// added to the model when at least one buffer view gets smaller, otherwise the model is left untouched
+void compressGltfWithMeshopt(tinygltf::Model &gltf, const GltfOptions &options);
+
+std::vector<uint8_t> createGlb(tinygltf::Model &gltf, const GltfOptions &options = GltfOptions());
 
 } // namespace CDBTo3DTiles
@@ -0,0 +1,154 @@
+#include "JsonWriter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace CDBTo3DTiles {
+JsonWriter::JsonWriter(std::string &output)
+    : m_output{output}
+    , m_isAfterKey{false}
+{}
+
+void JsonWriter::startObject()
+{
+    writeSeparator();
+    m_output += '{';
+    m_isScopeEmpty.emplace_back(true);
+}
+
+void JsonWriter::endObject()
+{
+    m_isScopeEmpty.pop_back();
+    m_output += '}';
+}
+
+void JsonWriter::startArray()
+{
+    writeSeparator();
+    m_output += '[';
+    m_isScopeEmpty.emplace_back(true);
+}
+
+void JsonWriter::endArray()
+{
+    m_isScopeEmpty.pop_back();
+    m_output += ']';
+}
+
+void JsonWriter::key(const std::string &name)
+{
+    writeSeparator();
+    writeString(name);
+    m_output += ':';
+    m_isAfterKey = true;
+}
+
+void JsonWriter::value(const std::string &str)
+{
+    writeSeparator();
+    writeString(str);
+}
+
+void JsonWriter::value(const char *str)
+{
+    writeSeparator();
+    writeString(str);
+}
+
+void JsonWriter::value(bool boolean)
+{
+    writeSeparator();
+    m_output += boolean ? "true" : "false";
+}
+
+void JsonWriter::value(double number)
+{
+    // JSON has no representation for infinity and NaN
+    if (!std::isfinite(number)) {
+        null();
+        return;
+    }
+
+    // use the shortest precision that reads back to the same number
+    char buffer[32];
+    for (int precision = 15; precision <= 17; ++precision) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+        if (std::strtod(buffer, nullptr) == number) {
+            break;
+        }
+    }
+
+    writeSeparator();
+    m_output += buffer;
+}
+
+void JsonWriter::null()
+{
+    writeSeparator();
+    m_output += "null";
+}
+
+void JsonWriter::rawValue(const std::string &json)
+{
+    writeSeparator();
+    m_output += json;
+}
+
+void JsonWriter::writeSeparator()
+{
+    if (m_isAfterKey) {
+        m_isAfterKey = false;
+        return;
+    }
+
+    if (!m_isScopeEmpty.empty()) {
+        if (!m_isScopeEmpty.back()) {
+            m_output += ',';
+        }
+
+        m_isScopeEmpty.back() = false;
+    }
+}
+
+void JsonWriter::writeString(const std::string &str)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    m_output += '"';
+    for (char c : str) {
+        switch (c) {
+        case '"':
+            m_output += "\\\"";
+            break;
+        case '\\':
+            m_output += "\\\\";
+            break;
+        case '\b':
+            m_output += "\\b";
+            break;
+        case '\f':
+            m_output += "\\f";
+            break;
+        case '\n':
+            m_output += "\\n";
+            break;
+        case '\r':
+            m_output += "\\r";
+            break;
+        case '\t':
+            m_output += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                m_output += "\\u00";
+                m_output += HEX_DIGITS[static_cast<unsigned char>(c) >> 4];
+                m_output += HEX_DIGITS[static_cast<unsigned char>(c) & 0xF];
+            } else {
+                m_output += c;
+            }
+            break;
+        }
+    }
+    m_output += '"';
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace CDBTo3DTiles {
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string &output);
+
+    void startObject();
+
+    void endObject();
+
+    void startArray();
+
+    void endArray();
+
+    void key(const std::string &name);
+
+    void value(const std::string &str);
+
+    void value(const char *str);
+
+    void value(bool boolean);
+
+    void value(double number);
+
+    template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    void value(T number)
+    {
+        writeSeparator();
+        m_output += std::to_string(number);
+    }
+
+    void null();
+
+    // write a value that is already serialized JSON
+    void rawValue(const std::string &json);
+
+    template<typename T>
+    void property(const std::string &name, const T &propertyValue)
+    {
+        key(name);
+        value(propertyValue);
+    }
+
+    template<typename T>
+    void arrayProperty(const std::string &name, const std::vector<T> &values)
+    {
+        key(name);
+        startArray();
+        for (const auto &element : values) {
+            value(element);
+        }
+        endArray();
+    }
+
+private:
+    void writeSeparator();
+
+    void writeString(const std::string &str);
+
+    std::string &m_output;
+    std::vector<bool> m_isScopeEmpty;
+    bool m_isAfterKey;
+};
+} // namespace CDBTo3DTiles
@@ -0,0 +1,153 @@
+#include "MD5.h"
+#include <algorithm>
+#include <cstring>
+
+namespace CDBTo3DTiles {
+static const uint32_t MD5_SINES[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint32_t MD5_SHIFTS[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+    5, 9,  14, 20, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21,
+    6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+MD5::MD5()
+    : m_state{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476}
+    , m_buffer{}
+    , m_byteLength{0}
+{}
+
+void MD5::update(const uint8_t *data, size_t byteLength)
+{
+    size_t bufferLength = static_cast<size_t>(m_byteLength % m_buffer.size());
+    m_byteLength += byteLength;
+
+    // fill up the block left from the previous update first
+    if (bufferLength > 0) {
+        size_t fillLength = std::min(byteLength, m_buffer.size() - bufferLength);
+        std::memcpy(m_buffer.data() + bufferLength, data, fillLength);
+        data += fillLength;
+        byteLength -= fillLength;
+        bufferLength += fillLength;
+        if (bufferLength < m_buffer.size()) {
+            return;
+        }
+
+        processBlock(m_buffer.data());
+    }
+
+    while (byteLength >= m_buffer.size()) {
+        processBlock(data);
+        data += m_buffer.size();
+        byteLength -= m_buffer.size();
+    }
+
+    if (byteLength > 0) {
+        std::memcpy(m_buffer.data(), data, byteLength);
+    }
+}
+
+std::array<uint8_t, 16> MD5::finalize()
+{
+    uint64_t bitLength = m_byteLength * 8;
+
+    // pad with a single 1 bit, then zeros up to 56 bytes modulo 64, then the message length in bits
+    static const uint8_t PADDING[64] = {0x80};
+    size_t bufferLength = static_cast<size_t>(m_byteLength % m_buffer.size());
+    size_t paddingLength = bufferLength < 56 ? 56 - bufferLength : 120 - bufferLength;
+    update(PADDING, paddingLength);
+
+    uint8_t length[8];
+    for (size_t i = 0; i < 8; ++i) {
+        length[i] = static_cast<uint8_t>(bitLength >> (8 * i));
+    }
+    update(length, sizeof(length));
+
+    std::array<uint8_t, 16> digest;
+    for (size_t i = 0; i < m_state.size(); ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            digest[i * 4 + j] = static_cast<uint8_t>(m_state[i] >> (8 * j));
+        }
+    }
+
+    return digest;
+}
+
+std::array<uint8_t, 16> MD5::hash(const uint8_t *data, size_t byteLength)
+{
+    MD5 md5;
+    md5.update(data, byteLength);
+    return md5.finalize();
+}
+
+std::array<uint8_t, 16> MD5::hash(const std::string &str)
+{
+    return hash(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+std::string MD5::toHex(const std::array<uint8_t, 16> &digest)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (auto byte : digest) {
+        hex += HEX_DIGITS[byte >> 4];
+        hex += HEX_DIGITS[byte & 0xF];
+    }
+
+    return hex;
+}
+
+void MD5::processBlock(const uint8_t *block)
+{
+    uint32_t words[16];
+    for (size_t i = 0; i < 16; ++i) {
+        words[i] = static_cast<uint32_t>(block[i * 4]) | (static_cast<uint32_t>(block[i * 4 + 1]) << 8)
+                   | (static_cast<uint32_t>(block[i * 4 + 2]) << 16)
+                   | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+    }
+
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+    for (size_t i = 0; i < 64; ++i) {
+        uint32_t f;
+        size_t wordIdx;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            wordIdx = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            wordIdx = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            wordIdx = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            wordIdx = (7 * i) % 16;
+        }
+
+        uint32_t rotate = a + f + MD5_SINES[i] + words[wordIdx];
+        a = d;
+        d = c;
+        c = b;
+        b = b + ((rotate << MD5_SHIFTS[i]) | (rotate >> (32 - MD5_SHIFTS[i])));
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace CDBTo3DTiles {
+// incremental MD5 hash as described in RFC 1321
+class MD5
+{
+public:
+    MD5();
+
+    void update(const uint8_t *data, size_t byteLength);
+
+    std::array<uint8_t, 16> finalize();
+
+    static std::array<uint8_t, 16> hash(const uint8_t *data, size_t byteLength);
+
+    static std::array<uint8_t, 16> hash(const std::string &str);
+
+    static std::string toHex(const std::array<uint8_t, 16> &digest);
+
+private:
+    void processBlock(const uint8_t *block);
+
+    std::array<uint32_t, 4> m_state;
+    std::array<uint8_t, 64> m_buffer;
+    uint64_t m_byteLength;
+};
+} // namespace CDBTo3DTiles
@@ -0,0 +1,47 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CDBTo3DTiles {
+MappedFile::MappedFile(const std::filesystem::path &path)
+    : m_data{nullptr}
+    , m_byteLength{0}
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path.string());
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot read " + path.string());
+    }
+
+    // empty files can't be mapped, and have nothing to read anyway
+    m_byteLength = static_cast<size_t>(fileStat.st_size);
+    if (m_byteLength == 0) {
+        ::close(fd);
+        return;
+    }
+
+    // the mapping stays valid after the file descriptor is closed
+    void *data = ::mmap(nullptr, m_byteLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + path.string());
+    }
+
+    m_data = static_cast<const uint8_t *>(data);
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    if (m_data) {
+        ::munmap(const_cast<uint8_t *>(m_data), m_byteLength);
+    }
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace CDBTo3DTiles {
+// read only memory mapping of a whole file. The mapping is released on destruction
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path &path);
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() noexcept;
+
+    inline const uint8_t *data() const noexcept { return m_data; }
+
+    inline size_t size() const noexcept { return m_byteLength; }
+
+private:
+    const uint8_t *m_data;
+    size_t m_byteLength;
+};
+} // namespace CDBTo3DTiles
@@ -0,0 +1,341 @@
+#include "ModelDiskCache.h"
+#include "MD5.h"
+#include "MappedFile.h"
+#include "osg/Notify"
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+
+namespace CDBTo3DTiles {
+static const char MODEL_DISK_CACHE_MAGIC[8] = {'C', 'D', 'B', 'M', 'O', 'D', 'E', 'L'};
+static const uint32_t MODEL_DISK_CACHE_VERSION = 1;
+
+template<typename T>
+static void appendValue(std::vector<uint8_t> &buffer, const T &value);
+
+template<typename T>
+static void appendVector(std::vector<uint8_t> &buffer, const std::vector<T> &values);
+
+static void appendString(std::vector<uint8_t> &buffer, const std::string &str);
+
+static void appendRecord(std::vector<uint8_t> &buffer, const ModelDiskCacheRecord &record);
+
+template<typename T>
+static T readValue(const uint8_t *data, size_t byteLength, size_t &offset);
+
+template<typename T>
+static std::vector<T> readVector(const uint8_t *data, size_t byteLength, size_t &offset);
+
+static std::string readString(const uint8_t *data, size_t byteLength, size_t &offset);
+
+static ModelDiskCacheRecord readRecord(const uint8_t *data, size_t byteLength, size_t &offset);
+
+ModelDiskCacheRecord ModelDiskCacheRecord::create(const std::string &name,
+                                                  const CDBModel3DResult &model3D,
+                                                  std::vector<int> instances)
+{
+    ModelDiskCacheRecord record;
+    record.name = name;
+    record.instances = std::move(instances);
+    record.meshes = model3D.getMeshes();
+    record.materials = model3D.getMaterials();
+    record.textures = model3D.getTextures();
+    record.images = model3D.getImages();
+    return record;
+}
+
+ModelDiskCache::ModelDiskCache(const std::filesystem::path &directory)
+    : m_directory{directory}
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+std::optional<std::vector<ModelDiskCacheRecord>> ModelDiskCache::load(const std::string &key) const
+{
+    auto entryPath = getEntryPath(key);
+    if (!std::filesystem::exists(entryPath)) {
+        return std::nullopt;
+    }
+
+    try {
+        MappedFile file(entryPath);
+        const uint8_t *data = file.data();
+        size_t byteLength = file.size();
+        size_t offset = 0;
+
+        char magic[sizeof(MODEL_DISK_CACHE_MAGIC)];
+        for (auto &c : magic) {
+            c = readValue<char>(data, byteLength, offset);
+        }
+
+        // entries of other versions and keys with the same hash are left for store() to replace
+        if (std::memcmp(magic, MODEL_DISK_CACHE_MAGIC, sizeof(magic)) != 0
+            || readValue<uint32_t>(data, byteLength, offset) != MODEL_DISK_CACHE_VERSION
+            || readString(data, byteLength, offset) != key) {
+            return std::nullopt;
+        }
+
+        auto recordCount = readValue<uint64_t>(data, byteLength, offset);
+        std::vector<ModelDiskCacheRecord> records;
+        for (uint64_t i = 0; i < recordCount; ++i) {
+            records.emplace_back(readRecord(data, byteLength, offset));
+        }
+
+        return records;
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
+
+void ModelDiskCache::store(const std::string &key, const std::vector<ModelDiskCacheRecord> &records) const
+{
+    std::vector<uint8_t> buffer;
+    buffer.insert(buffer.end(), std::begin(MODEL_DISK_CACHE_MAGIC), std::end(MODEL_DISK_CACHE_MAGIC));
+    appendValue(buffer, MODEL_DISK_CACHE_VERSION);
+    appendString(buffer, key);
+    appendValue(buffer, static_cast<uint64_t>(records.size()));
+    for (const auto &record : records) {
+        appendRecord(buffer, record);
+    }
+
+    // readers never see a partially written entry, since the rename replaces it at once
+    static std::atomic<uint64_t> temporaryCount{0};
+    auto entryPath = getEntryPath(key);
+    auto temporaryPath = entryPath;
+    temporaryPath += ".tmp" + std::to_string(::getpid()) + "_" + std::to_string(temporaryCount++);
+    bool isWritten = false;
+    {
+        std::ofstream fs(temporaryPath, std::ios::binary);
+        fs.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        fs.close();
+        isWritten = static_cast<bool>(fs);
+    }
+
+    // storing is best effort, a failure only costs converting the models again next time
+    std::error_code error;
+    if (isWritten) {
+        std::filesystem::rename(temporaryPath, entryPath, error);
+    } else {
+        error = std::make_error_code(std::errc::io_error);
+    }
+
+    if (error) {
+        OSG_WARN << "Cannot store model cache entry " << entryPath.string() << ": " << error.message()
+                 << std::endl;
+        std::error_code removeError;
+        std::filesystem::remove(temporaryPath, removeError);
+    }
+}
+
+std::string ModelDiskCache::createSourceKey(const std::filesystem::path &sourcePath)
+{
+    auto path = std::filesystem::absolute(sourcePath).lexically_normal();
+    auto modifiedTime = std::filesystem::last_write_time(path).time_since_epoch().count();
+    return path.generic_string() + ":" + std::to_string(std::filesystem::file_size(path)) + ":"
+           + std::to_string(modifiedTime);
+}
+
+std::filesystem::path ModelDiskCache::getEntryPath(const std::string &key) const
+{
+    return m_directory / (MD5::toHex(MD5::hash(key)) + ".model");
+}
+
+template<typename T>
+void appendValue(std::vector<uint8_t> &buffer, const T &value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be cached");
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+void appendVector(std::vector<uint8_t> &buffer, const std::vector<T> &values)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be cached");
+    appendValue(buffer, static_cast<uint64_t>(values.size()));
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(values.data());
+    buffer.insert(buffer.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+void appendString(std::vector<uint8_t> &buffer, const std::string &str)
+{
+    appendValue(buffer, static_cast<uint64_t>(str.size()));
+    buffer.insert(buffer.end(), str.begin(), str.end());
+}
+
+void appendRecord(std::vector<uint8_t> &buffer, const ModelDiskCacheRecord &record)
+{
+    appendString(buffer, record.name);
+    appendVector(buffer, record.instances);
+    appendValue(buffer, static_cast<uint64_t>(record.meshes.size()));
+    for (const auto &mesh : record.meshes) {
+        appendValue(buffer, mesh.material);
+        appendValue(buffer, mesh.primitiveType);
+        appendValue(buffer, static_cast<uint8_t>(mesh.aabb.has_value()));
+        if (mesh.aabb) {
+            appendValue(buffer, mesh.aabb->min);
+            appendValue(buffer, mesh.aabb->max);
+        }
+
+        appendVector(buffer, mesh.indices);
+        appendVector(buffer, mesh.positions);
+        appendVector(buffer, mesh.positionRTCs);
+        appendVector(buffer, mesh.UVs);
+        appendVector(buffer, mesh.normals);
+        appendVector(buffer, mesh.batchIDs);
+    }
+
+    appendValue(buffer, static_cast<uint64_t>(record.materials.size()));
+    for (const auto &material : record.materials) {
+        appendValue(buffer, material.texture);
+        appendValue(buffer, material.ambient);
+        appendValue(buffer, material.diffuse);
+        appendValue(buffer, material.specular);
+        appendValue(buffer, material.emission);
+        appendValue(buffer, material.shininess);
+        appendValue(buffer, material.alpha);
+        appendValue(buffer, static_cast<uint8_t>(material.unlit));
+        appendValue(buffer, static_cast<uint8_t>(material.doubleSided));
+    }
+
+    // images are kept decoded, so that loading them doesn't depend on the archives they were read from
+    const auto &textures = record.textures;
+    const auto &images = record.images;
+    appendValue(buffer, static_cast<uint64_t>(textures.size()));
+    for (size_t i = 0; i < textures.size(); ++i) {
+        appendString(buffer, textures[i].uri);
+        appendValue(buffer, textures[i].minFilter);
+        appendValue(buffer, textures[i].magFilter);
+
+        const osg::Image *image = i < images.size() ? images[i].get() : nullptr;
+        appendValue(buffer, static_cast<uint8_t>(image != nullptr));
+        if (image) {
+            appendString(buffer, image->getFileName());
+            appendValue(buffer, image->s());
+            appendValue(buffer, image->t());
+            appendValue(buffer, image->r());
+            appendValue(buffer, image->getInternalTextureFormat());
+            appendValue(buffer, image->getPixelFormat());
+            appendValue(buffer, image->getDataType());
+            appendValue(buffer, image->getPacking());
+            appendValue(buffer, static_cast<uint64_t>(image->getTotalSizeInBytes()));
+            buffer.insert(buffer.end(), image->data(), image->data() + image->getTotalSizeInBytes());
+        }
+    }
+}
+
+template<typename T>
+T readValue(const uint8_t *data, size_t byteLength, size_t &offset)
+{
+    if (byteLength - offset < sizeof(T)) {
+        throw std::runtime_error("Truncated model cache entry");
+    }
+
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+template<typename T>
+std::vector<T> readVector(const uint8_t *data, size_t byteLength, size_t &offset)
+{
+    auto count = readValue<uint64_t>(data, byteLength, offset);
+    if (count > (byteLength - offset) / sizeof(T)) {
+        throw std::runtime_error("Truncated model cache entry");
+    }
+
+    std::vector<T> values(static_cast<size_t>(count));
+    std::memcpy(values.data(), data + offset, values.size() * sizeof(T));
+    offset += values.size() * sizeof(T);
+    return values;
+}
+
+std::string readString(const uint8_t *data, size_t byteLength, size_t &offset)
+{
+    auto chars = readVector<char>(data, byteLength, offset);
+    return std::string(chars.begin(), chars.end());
+}
+
+ModelDiskCacheRecord readRecord(const uint8_t *data, size_t byteLength, size_t &offset)
+{
+    ModelDiskCacheRecord record;
+    record.name = readString(data, byteLength, offset);
+    record.instances = readVector<int>(data, byteLength, offset);
+
+    auto &meshes = record.meshes;
+    meshes.resize(static_cast<size_t>(readValue<uint64_t>(data, byteLength, offset)));
+    for (auto &mesh : meshes) {
+        mesh.material = readValue<int>(data, byteLength, offset);
+        mesh.primitiveType = readValue<PrimitiveType>(data, byteLength, offset);
+        if (readValue<uint8_t>(data, byteLength, offset)) {
+            auto min = readValue<glm::dvec3>(data, byteLength, offset);
+            auto max = readValue<glm::dvec3>(data, byteLength, offset);
+            mesh.aabb = AABB(min, max);
+        }
+
+        mesh.indices = readVector<uint32_t>(data, byteLength, offset);
+        mesh.positions = readVector<glm::dvec3>(data, byteLength, offset);
+        mesh.positionRTCs = readVector<glm::vec3>(data, byteLength, offset);
+        mesh.UVs = readVector<glm::vec2>(data, byteLength, offset);
+        mesh.normals = readVector<glm::vec3>(data, byteLength, offset);
+        mesh.batchIDs = readVector<float>(data, byteLength, offset);
+    }
+
+    auto &materials = record.materials;
+    materials.resize(static_cast<size_t>(readValue<uint64_t>(data, byteLength, offset)));
+    for (auto &material : materials) {
+        material.texture = readValue<int>(data, byteLength, offset);
+        material.ambient = readValue<glm::vec3>(data, byteLength, offset);
+        material.diffuse = readValue<glm::vec3>(data, byteLength, offset);
+        material.specular = readValue<glm::vec3>(data, byteLength, offset);
+        material.emission = readValue<glm::vec3>(data, byteLength, offset);
+        material.shininess = readValue<float>(data, byteLength, offset);
+        material.alpha = readValue<float>(data, byteLength, offset);
+        material.unlit = readValue<uint8_t>(data, byteLength, offset) != 0;
+        material.doubleSided = readValue<uint8_t>(data, byteLength, offset) != 0;
+    }
+
+    auto &textures = record.textures;
+    auto &images = record.images;
+    textures.resize(static_cast<size_t>(readValue<uint64_t>(data, byteLength, offset)));
+    images.resize(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i) {
+        textures[i].uri = readString(data, byteLength, offset);
+        textures[i].minFilter = readValue<TextureFilter>(data, byteLength, offset);
+        textures[i].magFilter = readValue<TextureFilter>(data, byteLength, offset);
+        if (!readValue<uint8_t>(data, byteLength, offset)) {
+            continue;
+        }
+
+        auto fileName = readString(data, byteLength, offset);
+        auto s = readValue<int>(data, byteLength, offset);
+        auto t = readValue<int>(data, byteLength, offset);
+        auto r = readValue<int>(data, byteLength, offset);
+        auto internalTextureFormat = readValue<GLint>(data, byteLength, offset);
+        auto pixelFormat = readValue<GLenum>(data, byteLength, offset);
+        auto dataType = readValue<GLenum>(data, byteLength, offset);
+        auto packing = readValue<unsigned int>(data, byteLength, offset);
+        auto imageByteLength = readValue<uint64_t>(data, byteLength, offset);
+
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(s, t, r, pixelFormat, dataType, static_cast<int>(packing));
+        if (image->getTotalSizeInBytes() != imageByteLength || byteLength - offset < imageByteLength) {
+            throw std::runtime_error("Invalid image in model cache entry");
+        }
+
+        std::memcpy(image->data(), data + offset, static_cast<size_t>(imageByteLength));
+        offset += static_cast<size_t>(imageByteLength);
+        image->setInternalTextureFormat(internalTextureFormat);
+        image->setFileName(fileName);
+        images[i] = image;
+    }
+
+    return record;
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "CDBModels.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace CDBTo3DTiles {
+// content of a converted model, with the indices of the instances that place it
+struct ModelDiskCacheRecord
+{
+    std::string name;
+    std::vector<int> instances;
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+    std::vector<Texture> textures;
+    std::vector<osg::ref_ptr<osg::Image>> images;
+
+    static ModelDiskCacheRecord create(const std::string &name,
+                                       const CDBModel3DResult &model3D,
+                                       std::vector<int> instances = {});
+};
+
+// converted models kept in a directory across conversions, so that unchanged OpenFlight sources are not
+// parsed again. Every entry is a single file with a compact binary copy of its records, named after the MD5
+// hash of its key and memory mapped on load. Keys have to change whenever the sources they were converted
+// from change, see createSourceKey(). Entries are replaced atomically, so several threads and conversions
+// can share a directory
+class ModelDiskCache
+{
+public:
+    explicit ModelDiskCache(const std::filesystem::path &directory);
+
+    inline const std::filesystem::path &getDirectory() const noexcept { return m_directory; }
+
+    // entries that are missing, written by another version or damaged are reported as missing
+    std::optional<std::vector<ModelDiskCacheRecord>> load(const std::string &key) const;
+
+    // entries that cannot be written are skipped with a warning, leaving no temporary file behind
+    void store(const std::string &key, const std::vector<ModelDiskCacheRecord> &records) const;
+
+    // key of a source file that changes with its path, size and modification time
+    static std::string createSourceKey(const std::filesystem::path &sourcePath);
+
+private:
+    std::filesystem::path getEntryPath(const std::string &key) const;
+
+    std::filesystem::path m_directory;
+};
+} // namespace CDBTo3DTiles
@@ -0,0 +1,524 @@
+#include "OutputSink.h"
+#include "MD5.h"
+#include "zlib.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace CDBTo3DTiles {
+static const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const uint32_t ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+static const uint32_t ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06064b50;
+static const uint32_t ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIGNATURE = 0x07064b50;
+static const uint16_t ZIP_VERSION = 20;
+static const uint16_t ZIP64_VERSION = 45;
+static const uint16_t ZIP_UTF8_FLAG = 0x0800;
+static const uint16_t ZIP_STORED = 0;
+static const uint16_t ZIP_DEFLATED = 8;
+static const uint16_t ZIP_DOS_DATE = (1 << 5) | 1;
+static const uint16_t ZIP64_EXTRA_FIELD = 0x0001;
+static const uint64_t ZIP_MAX_32 = std::numeric_limits<uint32_t>::max();
+static const uint64_t ZIP_MAX_16 = std::numeric_limits<uint16_t>::max();
+static const std::unordered_set<std::string> COMPRESSIBLE_EXTENSIONS
+    = {".json", ".subtree", ".b3dm", ".i3dm", ".cmpt", ".glb"};
+
+template<typename T>
+static void appendLittleEndian(std::vector<uint8_t> &buffer, T value);
+
+static bool isCompressible(const std::filesystem::path &path);
+
+static std::vector<uint8_t> deflateContent(const uint8_t *data, size_t byteLength, int windowBits);
+
+void OutputSink::write(const std::filesystem::path &path, const TileWriter &tile)
+{
+    writeSegments(path, tile.getSegments());
+}
+
+void OutputSink::write(const std::filesystem::path &path, const std::string &content)
+{
+    write(path, reinterpret_cast<const uint8_t *>(content.data()), content.size());
+}
+
+void OutputSink::write(const std::filesystem::path &path, const uint8_t *data, size_t byteLength)
+{
+    std::vector<GlbSegment> segments;
+    if (byteLength > 0) {
+        segments.emplace_back(GlbSegment{data, byteLength});
+    }
+
+    writeSegments(path, segments);
+}
+
+FileSystemSink::FileSystemSink(const std::filesystem::path &outputPath)
+    : m_outputPath{outputPath}
+{}
+
+void FileSystemSink::writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments)
+{
+    auto fullPath = m_outputPath / path;
+    auto directory = fullPath.parent_path();
+    if (m_createdDirectories.find(directory.string()) == m_createdDirectories.end()) {
+        std::filesystem::create_directories(directory);
+        m_createdDirectories.insert(directory.string());
+    }
+
+    std::ofstream fs(fullPath, std::ios::binary);
+    for (const auto &segment : segments) {
+        fs.write(reinterpret_cast<const char *>(segment.data),
+                 static_cast<std::streamsize>(segment.byteLength));
+    }
+}
+
+void FileSystemSink::remove(const std::filesystem::path &path)
+{
+    std::error_code errorCode;
+    std::filesystem::remove(m_outputPath / path, errorCode);
+}
+
+const std::vector<uint8_t> *MemorySink::find(const std::filesystem::path &path) const
+{
+    auto file = m_files.find(path.generic_string());
+    if (file == m_files.end()) {
+        return nullptr;
+    }
+
+    return &file->second;
+}
+
+void MemorySink::writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments)
+{
+    auto &file = m_files[path.generic_string()];
+    file.clear();
+    for (const auto &segment : segments) {
+        file.insert(file.end(), segment.data, segment.data + segment.byteLength);
+    }
+}
+
+void MemorySink::remove(const std::filesystem::path &path)
+{
+    m_files.erase(path.generic_string());
+}
+
+const std::string ArchiveSink::TILES_INDEX_NAME = "@3dtilesIndex1@";
+
+ArchiveSink::ArchiveSink(const std::filesystem::path &archivePath, bool writeTilesIndex)
+    : m_offset{0}
+    , m_writeTilesIndex{writeTilesIndex}
+    , m_compressEntries{false}
+    , m_isClosed{false}
+{
+    if (archivePath.has_parent_path()) {
+        std::filesystem::create_directories(archivePath.parent_path());
+    }
+
+    m_archive.open(archivePath, std::ios::binary);
+    if (!m_archive) {
+        throw std::runtime_error("Cannot open archive " + archivePath.string());
+    }
+}
+
+ArchiveSink::~ArchiveSink() noexcept
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void ArchiveSink::writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments)
+{
+    if (m_isClosed) {
+        throw std::runtime_error("Cannot write " + path.string() + " to a closed archive");
+    }
+
+    Entry entry;
+    entry.name = path.generic_string();
+    entry.compressionMethod = ZIP_STORED;
+    entry.crc32 = static_cast<uint32_t>(crc32(0L, Z_NULL, 0));
+    entry.byteLength = 0;
+    entry.localHeaderOffset = m_offset;
+    for (const auto &segment : segments) {
+        // crc32 takes at most 4GB at a time
+        const uint8_t *data = segment.data;
+        size_t remainLength = segment.byteLength;
+        while (remainLength > 0) {
+            auto length = static_cast<uInt>(std::min<size_t>(remainLength, ZIP_MAX_32));
+            entry.crc32 = static_cast<uint32_t>(crc32(entry.crc32, data, length));
+            data += length;
+            remainLength -= length;
+        }
+
+        entry.byteLength += segment.byteLength;
+    }
+
+    // the tiles index is read by offset, so it always stays stored
+    entry.compressedByteLength = entry.byteLength;
+    std::vector<uint8_t> deflated;
+    if (m_compressEntries && entry.byteLength > 0 && isCompressible(path)) {
+        std::vector<uint8_t> content;
+        content.reserve(entry.byteLength);
+        for (const auto &segment : segments) {
+            content.insert(content.end(), segment.data, segment.data + segment.byteLength);
+        }
+
+        deflated = deflateContent(content.data(), content.size(), -MAX_WBITS);
+        if (deflated.size() < entry.byteLength) {
+            entry.compressionMethod = ZIP_DEFLATED;
+            entry.compressedByteLength = deflated.size();
+        } else {
+            deflated.clear();
+        }
+    }
+
+    // sizes are known before the data is written, so the local header never needs a data descriptor
+    bool isZip64 = entry.byteLength >= ZIP_MAX_32;
+    std::vector<uint8_t> header;
+    appendLittleEndian(header, ZIP_LOCAL_HEADER_SIGNATURE);
+    appendLittleEndian(header, isZip64 ? ZIP64_VERSION : ZIP_VERSION);
+    appendLittleEndian(header, ZIP_UTF8_FLAG);
+    appendLittleEndian(header, entry.compressionMethod);
+    appendLittleEndian(header, static_cast<uint16_t>(0));
+    appendLittleEndian(header, ZIP_DOS_DATE);
+    appendLittleEndian(header, entry.crc32);
+    appendLittleEndian(header, static_cast<uint32_t>(isZip64 ? ZIP_MAX_32 : entry.compressedByteLength));
+    appendLittleEndian(header, static_cast<uint32_t>(isZip64 ? ZIP_MAX_32 : entry.byteLength));
+    appendLittleEndian(header, static_cast<uint16_t>(entry.name.size()));
+    appendLittleEndian(header, static_cast<uint16_t>(isZip64 ? 20 : 0));
+    header.insert(header.end(), entry.name.begin(), entry.name.end());
+    if (isZip64) {
+        appendLittleEndian(header, ZIP64_EXTRA_FIELD);
+        appendLittleEndian(header, static_cast<uint16_t>(16));
+        appendLittleEndian(header, entry.byteLength);
+        appendLittleEndian(header, entry.compressedByteLength);
+    }
+
+    m_archive.write(reinterpret_cast<const char *>(header.data()),
+                    static_cast<std::streamsize>(header.size()));
+    if (entry.compressionMethod == ZIP_DEFLATED) {
+        m_archive.write(reinterpret_cast<const char *>(deflated.data()),
+                        static_cast<std::streamsize>(deflated.size()));
+    } else {
+        for (const auto &segment : segments) {
+            m_archive.write(reinterpret_cast<const char *>(segment.data),
+                            static_cast<std::streamsize>(segment.byteLength));
+        }
+    }
+
+    if (!m_archive) {
+        throw std::runtime_error("Cannot write " + entry.name + " to archive");
+    }
+
+    m_offset += header.size() + entry.compressedByteLength;
+
+    // the archive is append only, so a rewritten file leaves its previous content unreferenced
+    auto existEntry = m_nameToEntry.find(entry.name);
+    if (existEntry == m_nameToEntry.end()) {
+        m_nameToEntry.insert({entry.name, m_entries.size()});
+        m_entries.emplace_back(std::move(entry));
+    } else {
+        m_entries[existEntry->second] = std::move(entry);
+    }
+}
+
+void ArchiveSink::remove(const std::filesystem::path &path)
+{
+    auto existEntry = m_nameToEntry.find(path.generic_string());
+    if (existEntry == m_nameToEntry.end()) {
+        return;
+    }
+
+    // move the last entry into the hole, the central directory doesn't need to follow the write order
+    size_t index = existEntry->second;
+    m_nameToEntry.erase(existEntry);
+    if (index != m_entries.size() - 1) {
+        m_entries[index] = std::move(m_entries.back());
+        m_nameToEntry[m_entries[index].name] = index;
+    }
+
+    m_entries.pop_back();
+}
+
+void ArchiveSink::close()
+{
+    if (m_isClosed) {
+        return;
+    }
+
+    // the index has to be the last entry of the archive
+    if (m_writeTilesIndex) {
+        appendTilesIndex();
+    }
+
+    m_isClosed = true;
+
+    uint64_t centralDirectoryOffset = m_offset;
+    std::vector<uint8_t> centralDirectory;
+    for (const auto &entry : m_entries) {
+        bool isSizeZip64 = entry.byteLength >= ZIP_MAX_32;
+        bool isOffsetZip64 = entry.localHeaderOffset >= ZIP_MAX_32;
+        uint16_t extraLength = static_cast<uint16_t>((isSizeZip64 || isOffsetZip64 ? 4 : 0)
+                                                     + (isSizeZip64 ? 16 : 0) + (isOffsetZip64 ? 8 : 0));
+        uint16_t version = extraLength > 0 ? ZIP64_VERSION : ZIP_VERSION;
+
+        appendLittleEndian(centralDirectory, ZIP_CENTRAL_HEADER_SIGNATURE);
+        appendLittleEndian(centralDirectory, version);
+        appendLittleEndian(centralDirectory, version);
+        appendLittleEndian(centralDirectory, ZIP_UTF8_FLAG);
+        appendLittleEndian(centralDirectory, entry.compressionMethod);
+        appendLittleEndian(centralDirectory, static_cast<uint16_t>(0));
+        appendLittleEndian(centralDirectory, ZIP_DOS_DATE);
+        appendLittleEndian(centralDirectory, entry.crc32);
+        appendLittleEndian(centralDirectory,
+                           static_cast<uint32_t>(isSizeZip64 ? ZIP_MAX_32 : entry.compressedByteLength));
+        appendLittleEndian(centralDirectory,
+                           static_cast<uint32_t>(isSizeZip64 ? ZIP_MAX_32 : entry.byteLength));
+        appendLittleEndian(centralDirectory, static_cast<uint16_t>(entry.name.size()));
+        appendLittleEndian(centralDirectory, extraLength);
+        appendLittleEndian(centralDirectory, static_cast<uint16_t>(0));
+        appendLittleEndian(centralDirectory, static_cast<uint16_t>(0));
+        appendLittleEndian(centralDirectory, static_cast<uint16_t>(0));
+        appendLittleEndian(centralDirectory, static_cast<uint32_t>(0));
+        appendLittleEndian(centralDirectory,
+                           static_cast<uint32_t>(isOffsetZip64 ? ZIP_MAX_32 : entry.localHeaderOffset));
+        centralDirectory.insert(centralDirectory.end(), entry.name.begin(), entry.name.end());
+        if (extraLength > 0) {
+            appendLittleEndian(centralDirectory, ZIP64_EXTRA_FIELD);
+            appendLittleEndian(centralDirectory, static_cast<uint16_t>(extraLength - 4));
+            if (isSizeZip64) {
+                appendLittleEndian(centralDirectory, entry.byteLength);
+                appendLittleEndian(centralDirectory, entry.compressedByteLength);
+            }
+
+            if (isOffsetZip64) {
+                appendLittleEndian(centralDirectory, entry.localHeaderOffset);
+            }
+        }
+    }
+
+    uint64_t centralDirectoryLength = centralDirectory.size();
+    uint64_t entriesCount = m_entries.size();
+    bool isZip64 = entriesCount >= ZIP_MAX_16 || centralDirectoryOffset >= ZIP_MAX_32
+                   || centralDirectoryLength >= ZIP_MAX_32;
+
+    std::vector<uint8_t> end;
+    if (isZip64) {
+        uint64_t zip64EndOffset = centralDirectoryOffset + centralDirectoryLength;
+        appendLittleEndian(end, ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+        appendLittleEndian(end, static_cast<uint64_t>(44));
+        appendLittleEndian(end, ZIP64_VERSION);
+        appendLittleEndian(end, ZIP64_VERSION);
+        appendLittleEndian(end, static_cast<uint32_t>(0));
+        appendLittleEndian(end, static_cast<uint32_t>(0));
+        appendLittleEndian(end, entriesCount);
+        appendLittleEndian(end, entriesCount);
+        appendLittleEndian(end, centralDirectoryLength);
+        appendLittleEndian(end, centralDirectoryOffset);
+
+        appendLittleEndian(end, ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIGNATURE);
+        appendLittleEndian(end, static_cast<uint32_t>(0));
+        appendLittleEndian(end, zip64EndOffset);
+        appendLittleEndian(end, static_cast<uint32_t>(1));
+    }
+
+    appendLittleEndian(end, ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+    appendLittleEndian(end, static_cast<uint16_t>(0));
+    appendLittleEndian(end, static_cast<uint16_t>(0));
+    appendLittleEndian(end, static_cast<uint16_t>(std::min(entriesCount, ZIP_MAX_16)));
+    appendLittleEndian(end, static_cast<uint16_t>(std::min(entriesCount, ZIP_MAX_16)));
+    appendLittleEndian(end, static_cast<uint32_t>(std::min(centralDirectoryLength, ZIP_MAX_32)));
+    appendLittleEndian(end, static_cast<uint32_t>(std::min(centralDirectoryOffset, ZIP_MAX_32)));
+    appendLittleEndian(end, static_cast<uint16_t>(0));
+
+    m_archive.write(reinterpret_cast<const char *>(centralDirectory.data()),
+                    static_cast<std::streamsize>(centralDirectory.size()));
+    m_archive.write(reinterpret_cast<const char *>(end.data()), static_cast<std::streamsize>(end.size()));
+    m_archive.close();
+    if (!m_archive) {
+        throw std::runtime_error("Cannot finish writing archive");
+    }
+}
+
+void ArchiveSink::appendTilesIndex()
+{
+    struct IndexEntry
+    {
+        uint64_t hash[2];
+        uint64_t offset;
+    };
+
+    std::vector<IndexEntry> index;
+    index.reserve(m_entries.size());
+    for (const auto &entry : m_entries) {
+        auto hash = MD5::hash(entry.name);
+        IndexEntry indexEntry;
+        std::memcpy(indexEntry.hash, hash.data(), hash.size());
+        indexEntry.offset = entry.localHeaderOffset;
+        index.emplace_back(indexEntry);
+    }
+
+    // clients binary search the index with the hash read as two little endian 64 bits integers
+    std::sort(index.begin(), index.end(), [](const IndexEntry &lhs, const IndexEntry &rhs) {
+        if (lhs.hash[0] != rhs.hash[0]) {
+            return lhs.hash[0] < rhs.hash[0];
+        }
+
+        return lhs.hash[1] < rhs.hash[1];
+    });
+
+    std::vector<uint8_t> indexBuffer;
+    indexBuffer.reserve(index.size() * sizeof(IndexEntry));
+    for (const auto &indexEntry : index) {
+        appendLittleEndian(indexBuffer, indexEntry.hash[0]);
+        appendLittleEndian(indexBuffer, indexEntry.hash[1]);
+        appendLittleEndian(indexBuffer, indexEntry.offset);
+    }
+
+    write(TILES_INDEX_NAME, indexBuffer.data(), indexBuffer.size());
+}
+
+template<typename T>
+void appendLittleEndian(std::vector<uint8_t> &buffer, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        buffer.emplace_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+bool isCompressible(const std::filesystem::path &path)
+{
+    return COMPRESSIBLE_EXTENSIONS.find(path.extension().string()) != COMPRESSIBLE_EXTENSIONS.end();
+}
+
+GzipSink::GzipSink(std::unique_ptr<OutputSink> sink, size_t threadCount)
+    : m_sink{std::move(sink)}
+    , m_threadPool{threadCount}
+    , m_isClosed{false}
+{}
+
+GzipSink::~GzipSink() noexcept
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void GzipSink::writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments)
+{
+    // a newer version of the file makes any pending or written copy of the previous one stale
+    std::string pathString = path.generic_string();
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+        m_sink->writeSegments(path, segments);
+        version = ++m_gzipCopies[pathString].version;
+    }
+
+    if (!isCompressible(path)) {
+        updateGzipCopy(pathString, version, nullptr);
+        return;
+    }
+
+    // segments may point to data owned by the caller, so the task works on its own copy
+    std::vector<uint8_t> content;
+    for (const auto &segment : segments) {
+        content.insert(content.end(), segment.data, segment.data + segment.byteLength);
+    }
+
+    m_threadPool.enqueue([this, pathString, version, content = std::move(content)]() {
+        auto gzip = compress(content.data(), content.size());
+        updateGzipCopy(pathString, version, gzip.size() < content.size() ? &gzip : nullptr);
+    });
+}
+
+void GzipSink::remove(const std::filesystem::path &path)
+{
+    std::string pathString = path.generic_string();
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+        m_sink->remove(path);
+        version = ++m_gzipCopies[pathString].version;
+    }
+
+    updateGzipCopy(pathString, version, nullptr);
+}
+
+void GzipSink::updateGzipCopy(const std::string &path, uint64_t version, const std::vector<uint8_t> *gzip)
+{
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    auto &gzipCopy = m_gzipCopies[path];
+    if (gzipCopy.version != version) {
+        return;
+    }
+
+    if (gzip) {
+        m_sink->write(path + ".gz", gzip->data(), gzip->size());
+        gzipCopy.isWritten = true;
+    } else if (gzipCopy.isWritten) {
+        m_sink->remove(path + ".gz");
+        gzipCopy.isWritten = false;
+    }
+}
+
+void GzipSink::close()
+{
+    if (m_isClosed) {
+        return;
+    }
+
+    m_isClosed = true;
+    m_threadPool.wait();
+    m_sink->close();
+}
+
+std::vector<uint8_t> GzipSink::compress(const uint8_t *data, size_t byteLength)
+{
+    // adding 16 to the window bits makes zlib write a gzip header and trailer
+    return deflateContent(data, byteLength, MAX_WBITS + 16);
+}
+
+std::vector<uint8_t> deflateContent(const uint8_t *data, size_t byteLength, int windowBits)
+{
+    static const size_t MAX_CHUNK = std::numeric_limits<uInt>::max();
+
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Cannot initialize deflate compression");
+    }
+
+    std::vector<uint8_t> output(deflateBound(&stream, static_cast<uLong>(byteLength)));
+    size_t inputOffset = 0;
+    size_t outputOffset = 0;
+    int result = Z_OK;
+    while (result != Z_STREAM_END) {
+        if (outputOffset == output.size()) {
+            output.resize(output.size() * 2);
+        }
+
+        size_t inputChunk = std::min(byteLength - inputOffset, MAX_CHUNK);
+        size_t outputChunk = std::min(output.size() - outputOffset, MAX_CHUNK);
+        stream.next_in = const_cast<Bytef *>(data + inputOffset);
+        stream.avail_in = static_cast<uInt>(inputChunk);
+        stream.next_out = output.data() + outputOffset;
+        stream.avail_out = static_cast<uInt>(outputChunk);
+
+        int flush = inputOffset + inputChunk == byteLength ? Z_FINISH : Z_NO_FLUSH;
+        result = deflate(&stream, flush);
+        if (result == Z_STREAM_ERROR) {
+            deflateEnd(&stream);
+            throw std::runtime_error("Cannot compress with deflate");
+        }
+
+        inputOffset += inputChunk - stream.avail_in;
+        outputOffset += outputChunk - stream.avail_out;
+    }
+
+    deflateEnd(&stream);
+    output.resize(outputOffset);
+    return output;
+}
+} // namespace CDBTo3DTiles
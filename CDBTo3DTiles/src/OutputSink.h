@@ -0,0 +1,157 @@
+#pragma once
+
+#include "GlbWriter.h"
+#include "ThreadPool.h"
+#include "TileWriter.h"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace CDBTo3DTiles {
+class Converter;
+
+// destination of every file produced by the converter. Paths are relative to the root of the output and
+// writing the same path twice replaces the previous content
+class OutputSink
+{
+public:
+    virtual ~OutputSink() noexcept = default;
+
+    void write(const std::filesystem::path &path, const TileWriter &tile);
+
+    void write(const std::filesystem::path &path, const std::string &content);
+
+    void write(const std::filesystem::path &path, const uint8_t *data, size_t byteLength);
+
+    virtual void writeSegments(const std::filesystem::path &path,
+                               const std::vector<GlbSegment> &segments) = 0;
+
+    // forget a file written before. Paths that were never written are ignored
+    virtual void remove(const std::filesystem::path &path) = 0;
+
+    // called once after the last file is written
+    virtual void close() {}
+};
+
+class FileSystemSink : public OutputSink
+{
+public:
+    explicit FileSystemSink(const std::filesystem::path &outputPath);
+
+    void writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments) override;
+
+    void remove(const std::filesystem::path &path) override;
+
+private:
+    std::filesystem::path m_outputPath;
+    std::unordered_set<std::string> m_createdDirectories;
+};
+
+class MemorySink : public OutputSink
+{
+public:
+    inline const std::map<std::string, std::vector<uint8_t>> &getFiles() const noexcept { return m_files; }
+
+    const std::vector<uint8_t> *find(const std::filesystem::path &path) const;
+
+    void writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments) override;
+
+    void remove(const std::filesystem::path &path) override;
+
+private:
+    std::map<std::string, std::vector<uint8_t>> m_files;
+};
+
+// write every file as an uncompressed entry of a single zip archive. Entries are appended to the archive
+// as they come and the central directory is written at the end by close(). ZIP64 records are used when the
+// archive grows past the limits of the original format. With writeTilesIndex, the archive follows the 3D
+// Tiles archive (.3tz) convention and ends with an @3dtilesIndex1@ entry, which maps the MD5 hash of every
+// path to its local header so that clients can look files up without reading the central directory
+class ArchiveSink : public OutputSink
+{
+public:
+    explicit ArchiveSink(const std::filesystem::path &archivePath, bool writeTilesIndex = false);
+
+    ~ArchiveSink() noexcept;
+
+    // deflate tiles and JSON files when that makes them smaller, instead of storing them
+    inline void setCompressEntries(bool compressEntries) noexcept { m_compressEntries = compressEntries; }
+
+    void writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments) override;
+
+    // the archive is append only, so the content of a removed file stays unreferenced in it
+    void remove(const std::filesystem::path &path) override;
+
+    void close() override;
+
+    static const std::string TILES_INDEX_NAME;
+
+private:
+    void appendTilesIndex();
+
+    struct Entry
+    {
+        std::string name;
+        uint16_t compressionMethod;
+        uint32_t crc32;
+        uint64_t compressedByteLength;
+        uint64_t byteLength;
+        uint64_t localHeaderOffset;
+    };
+
+    std::ofstream m_archive;
+    uint64_t m_offset;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, size_t> m_nameToEntry;
+    bool m_writeTilesIndex;
+    bool m_compressEntries;
+    bool m_isClosed;
+};
+
+// forward every file to another sink and also write a gzip compressed copy with a .gz suffix next to tiles
+// and JSON files, for static servers that deliver pre-compressed files. Compression runs on a thread pool
+// so that writing never waits for zlib, and the copy is skipped when it isn't smaller than the original.
+// Rewriting a file replaces or removes its copy, so copies never get stale. Archives should deflate their
+// entries with ArchiveSink::setCompressEntries() instead
+class GzipSink : public OutputSink
+{
+public:
+    GzipSink(std::unique_ptr<OutputSink> sink, size_t threadCount);
+
+    ~GzipSink() noexcept;
+
+    void writeSegments(const std::filesystem::path &path, const std::vector<GlbSegment> &segments) override;
+
+    void remove(const std::filesystem::path &path) override;
+
+    void close() override;
+
+    static std::vector<uint8_t> compress(const uint8_t *data, size_t byteLength);
+
+private:
+    // only the compression task of the latest version of a file writes or removes its copy
+    struct GzipCopy
+    {
+        uint64_t version;
+        bool isWritten;
+    };
+
+    void updateGzipCopy(const std::string &path, uint64_t version, const std::vector<uint8_t> *gzip);
+
+    std::unique_ptr<OutputSink> m_sink;
+    std::mutex m_sinkMutex;
+    std::unordered_map<std::string, GzipCopy> m_gzipCopies;
+    ThreadPool m_threadPool;
+    bool m_isClosed;
+};
+
+// converter that writes every file to the given sink instead of a directory or .3tz archive
+std::unique_ptr<Converter> createConverter(const std::filesystem::path &CDBPath,
+                                           std::unique_ptr<OutputSink> outputSink);
+} // namespace CDBTo3DTiles
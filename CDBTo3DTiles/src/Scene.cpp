@@ -1,6 +1,12 @@
 #include "Scene.h"
+#include "meshoptimizer.h"
 
 namespace CDBTo3DTiles {
+template<typename T>
+static void remapVertexAttribute(std::vector<T> &attribute,
+                                 const std::vector<unsigned int> &remap,
+                                 size_t uniqueVertexCount);
+
 Mesh::Mesh()
     : material{-1}
     , primitiveType{PrimitiveType::Triangles}
@@ -33,6 +39,11 @@ glm::dvec3 AABB::center() const
     return (min + max) * 0.5;
 }
 
+double AABB::farthestCornerDistance(const glm::dvec3 &scale) const
+{
+    return glm::length(glm::max(glm::abs(min), glm::abs(max)) * glm::abs(scale));
+}
+
 void AABB::merge(const glm::dvec3 &point)
 {
     min = glm::min(point, min);
@@ -44,4 +55,118 @@ Texture::Texture()
     , magFilter{TextureFilter::LINEAR}
 {}
 
+void optimizeMesh(Mesh &mesh)
+{
+    size_t indexCount = mesh.indices.size();
+    size_t vertexCount = mesh.positionRTCs.size();
+    if (indexCount == 0 || vertexCount == 0) {
+        return;
+    }
+
+    if (mesh.positions.size() != vertexCount || (!mesh.UVs.empty() && mesh.UVs.size() != vertexCount)
+        || (!mesh.normals.empty() && mesh.normals.size() != vertexCount)
+        || (!mesh.batchIDs.empty() && mesh.batchIDs.size() != vertexCount)) {
+        throw std::invalid_argument("Mesh vertex attributes must have the same number of elements");
+    }
+
+    // vertex cache and overdraw only make sense for triangles. Vertex fetch works for any indexed primitive
+    if (mesh.primitiveType == PrimitiveType::Triangles) {
+        meshopt_optimizeVertexCache(mesh.indices.data(), mesh.indices.data(), indexCount, vertexCount);
+        meshopt_optimizeOverdraw(mesh.indices.data(),
+                                 mesh.indices.data(),
+                                 indexCount,
+                                 &mesh.positionRTCs[0].x,
+                                 vertexCount,
+                                 sizeof(glm::vec3),
+                                 1.05f);
+    }
+
+    std::vector<unsigned int> remap(vertexCount);
+    size_t uniqueVertexCount = meshopt_optimizeVertexFetchRemap(remap.data(),
+                                                                mesh.indices.data(),
+                                                                indexCount,
+                                                                vertexCount);
+    meshopt_remapIndexBuffer(mesh.indices.data(), mesh.indices.data(), indexCount, remap.data());
+    remapVertexAttribute(mesh.positions, remap, uniqueVertexCount);
+    remapVertexAttribute(mesh.positionRTCs, remap, uniqueVertexCount);
+    remapVertexAttribute(mesh.UVs, remap, uniqueVertexCount);
+    remapVertexAttribute(mesh.normals, remap, uniqueVertexCount);
+    remapVertexAttribute(mesh.batchIDs, remap, uniqueVertexCount);
+
+    // unreferenced vertices are dropped, so the bounding box and the positions relative to its center are
+    // recomputed to keep the accessor bounds tight
+    if (mesh.aabb && uniqueVertexCount < vertexCount) {
+        AABB aabb;
+        for (const auto &position : mesh.positions) {
+            aabb.merge(position);
+        }
+
+        auto center = aabb.center();
+        mesh.aabb = aabb;
+        for (size_t i = 0; i < mesh.positions.size(); ++i) {
+            mesh.positionRTCs[i] = static_cast<glm::vec3>(mesh.positions[i] - center);
+        }
+    }
+}
+
+double simplifyMesh(Mesh &mesh, size_t targetIndexCount, float targetError)
+{
+    if (mesh.primitiveType != PrimitiveType::Triangles || mesh.indices.empty() || mesh.positions.empty()) {
+        return 0.0;
+    }
+
+    // simplify relative to the center, since single precision world positions are too coarse
+    AABB aabb;
+    for (const auto &position : mesh.positions) {
+        aabb.merge(position);
+    }
+
+    auto center = aabb.center();
+    mesh.aabb = aabb;
+    mesh.positionRTCs.clear();
+    mesh.positionRTCs.reserve(mesh.positions.size());
+    for (const auto &position : mesh.positions) {
+        mesh.positionRTCs.emplace_back(position - center);
+    }
+
+    float relativeError = 0.0f;
+    std::vector<unsigned int> lod(mesh.indices.size());
+    lod.resize(meshopt_simplify(lod.data(),
+                                mesh.indices.data(),
+                                mesh.indices.size(),
+                                &mesh.positionRTCs[0].x,
+                                mesh.positionRTCs.size(),
+                                sizeof(glm::vec3),
+                                targetIndexCount,
+                                targetError,
+                                &relativeError));
+    float scale = meshopt_simplifyScale(&mesh.positionRTCs[0].x, mesh.positionRTCs.size(), sizeof(glm::vec3));
+    mesh.indices = std::move(lod);
+    if (mesh.indices.empty()) {
+        mesh.positions.clear();
+        mesh.positionRTCs.clear();
+        mesh.UVs.clear();
+        mesh.normals.clear();
+        mesh.batchIDs.clear();
+    } else {
+        optimizeMesh(mesh);
+    }
+
+    return static_cast<double>(relativeError) * static_cast<double>(scale);
+}
+
+template<typename T>
+void remapVertexAttribute(std::vector<T> &attribute,
+                          const std::vector<unsigned int> &remap,
+                          size_t uniqueVertexCount)
+{
+    if (attribute.empty()) {
+        return;
+    }
+
+    std::vector<T> remapped(uniqueVertexCount);
+    meshopt_remapVertexBuffer(remapped.data(), attribute.data(), attribute.size(), sizeof(T), remap.data());
+    attribute = std::move(remapped);
+}
+
 } // namespace CDBTo3DTiles
@@ -15,6 +15,10 @@ struct AABB
 
     glm::dvec3 center() const;
 
+    // distance from the origin to the farthest corner once the box is scaled, so that a sphere of that
+    // radius contains the box under any rotation around the origin
+    double farthestCornerDistance(const glm::dvec3 &scale = glm::dvec3(1.0)) const;
+
     void merge(const glm::dvec3 &point);
 
     glm::dvec3 min;
@@ -81,4 +85,13 @@ struct Material
     bool unlit;
     bool doubleSided;
 };
+
+// reorder indices and vertices for vertex cache, overdraw and vertex fetch efficiency.
+// Vertices that aren't referenced by any index are removed, and the bounding box is fitted to the others
+void optimizeMesh(Mesh &mesh);
+
+// collapse the triangles of a mesh until it has at most targetIndexCount indices or the error relative to
+// the mesh extents would exceed targetError. Vertices that are no longer referenced are removed. Returns
+// the error in the units of the positions
+double simplifyMesh(Mesh &mesh, size_t targetIndexCount, float targetError);
 } // namespace CDBTo3DTiles
@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace CDBTo3DTiles {
+ThreadPool::ThreadPool(size_t threadCount, size_t maxQueuedTasks)
+    : m_maxQueuedTasks{std::max<size_t>(maxQueuedTasks, 1)}
+    , m_runningTasks{0}
+    , m_isStopped{false}
+{
+    threadCount = std::max<size_t>(threadCount, 1);
+    m_workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back([this]() { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopped = true;
+    }
+
+    // workers drain the queue before they exit
+    m_taskAdded.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_taskDone.wait(lock, [this]() { return m_tasks.size() < m_maxQueuedTasks; });
+        m_tasks.emplace_back(std::move(task));
+    }
+
+    m_taskAdded.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_taskDone.wait(lock, [this]() { return m_tasks.empty() && m_runningTasks == 0; });
+    if (m_exception) {
+        auto exception = m_exception;
+        m_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+size_t ThreadPool::getDefaultThreadCount() noexcept
+{
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskAdded.wait(lock, [this]() { return m_isStopped || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            ++m_runningTasks;
+        }
+
+        // a slot in the queue is free
+        m_taskDone.notify_all();
+
+        std::exception_ptr exception;
+        try {
+            task();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_runningTasks;
+            if (exception && !m_exception) {
+                m_exception = exception;
+            }
+        }
+
+        m_taskDone.notify_all();
+    }
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CDBTo3DTiles {
+// fixed number of worker threads running tasks in the order they are queued. At most maxQueuedTasks tasks
+// wait in the queue, after which enqueue() blocks until a worker frees a slot. The first exception thrown
+// by a task is rethrown by wait()
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount, size_t maxQueuedTasks = 256);
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() noexcept;
+
+    inline size_t getThreadCount() const noexcept { return m_workers.size(); }
+
+    void enqueue(std::function<void()> task);
+
+    // block until every queued task has finished
+    void wait();
+
+    static size_t getDefaultThreadCount() noexcept;
+
+private:
+    void work();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskAdded;
+    std::condition_variable m_taskDone;
+    std::exception_ptr m_exception;
+    size_t m_maxQueuedTasks;
+    size_t m_runningTasks;
+    bool m_isStopped;
+};
+} // namespace CDBTo3DTiles
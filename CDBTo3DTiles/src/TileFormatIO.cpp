@@ -1,21 +1,98 @@
 #include "TileFormatIO.h"
 #include "Ellipsoid.h"
+#include "GlbWriter.h"
+#include "Gltf.h"
+#include "JsonWriter.h"
 #include "glm/gtc/matrix_access.hpp"
 #include "nlohmann/json.hpp"
+#include <algorithm>
+#include <array>
+#include <unordered_set>
 
 namespace CDBTo3DTiles {
 
 static float MAX_GEOMETRIC_ERROR = 300000.0f;
+static const size_t TILESET_JSON_FLUSH_BYTE_LENGTH = 1 << 16;
+
+// room left for the asset, geometric error and refine wrapped around the root tile of a tileset JSON
+static const size_t TILESET_JSON_WRAPPER_BYTE_LENGTH = 128;
+static const std::string IMPLICIT_CONTENT_DIRECTORY = "Content";
+static const std::string IMPLICIT_SUBTREE_DIRECTORY = "Subtrees";
+static const std::string IMPLICIT_TEMPLATE = "{level}/{x}/{y}";
+
+// level, x and y of the root of a subtree
+using ImplicitSubtreeRoot = std::array<int, 3>;
+
+struct ImplicitSubtree
+{
+    std::vector<bool> tileAvailability;
+    std::vector<bool> contentAvailability;
+    std::vector<bool> childSubtreeAvailability;
+};
 
 static void createBatchTable(const CDBInstancesAttributes *instancesAttribs,
                              std::string &batchTableJson,
                              std::vector<uint8_t> &batchTableBuffer);
 
-static void convertTilesetToJson(const CDBTile &tile, float geometricError, nlohmann::json &json);
+template<typename Header>
+static void addHeader(const Header &header, TileWriter &tile);
+
+static void writeTilesetAsset(JsonWriter &writer);
+
+static float getTileGeometricError(const CDBTile &tile, float depthGeometricError);
+
+static const std::string &getTileRefine(const CDBTile &tile, const std::string &refine);
+
+static void writeTileProperties(const CDBTile &tile, float geometricError, JsonWriter &writer);
+
+static void writeTileToJson(const CDBTile &tile,
+                            float geometricError,
+                            const std::string &refine,
+                            const std::string &parentRefine,
+                            JsonWriter &writer,
+                            std::string &output,
+                            std::ostream &fs);
+
+static size_t planSplitTile(const CDBTile &tile,
+                            float geometricError,
+                            const std::string &refine,
+                            const std::string &parentRefine,
+                            const TilesetJsonSplit &split,
+                            std::unordered_set<const CDBTile *> &externalRoots);
+
+static void writeExternalTilesetStub(const CDBTile &tile, float geometricError, JsonWriter &writer);
+
+static void writeSplitTileToJson(const CDBTile &tile,
+                                 float geometricError,
+                                 const std::string &refine,
+                                 const std::string &parentRefine,
+                                 const std::unordered_set<const CDBTile *> &externalRoots,
+                                 JsonWriter &writer,
+                                 std::map<std::filesystem::path, std::string> &externalTilesets);
+
+static void convertImplicitTilesetToJson(const CDBTile &tile,
+                                         float geometricError,
+                                         int subtreeLevels,
+                                         nlohmann::json &json,
+                                         std::map<std::filesystem::path, TileWriter> &subtrees);
+
+static void addImplicitTileAvailability(const CDBTile &tile,
+                                        int subtreeLevels,
+                                        std::map<ImplicitSubtreeRoot, ImplicitSubtree> &implicitSubtrees,
+                                        int &availableLevels,
+                                        std::string &contentExtension);
+
+static ImplicitSubtree &getImplicitSubtree(const ImplicitSubtreeRoot &subtreeRoot,
+                                           int subtreeLevels,
+                                           std::map<ImplicitSubtreeRoot, ImplicitSubtree> &implicitSubtrees);
+
+static TileWriter createSubtree(const ImplicitSubtree &subtree);
+
+static size_t interleaveBits(int x, int y);
 
 void combineTilesetJson(const std::vector<std::filesystem::path> &tilesetJsonPaths,
                         const std::vector<Core::BoundingRegion> &regions,
-                        std::ofstream &fs)
+                        std::ostream &fs)
 {
     nlohmann::json tilesetJson;
     tilesetJson["asset"] = {{"version", "1.0"}};
@@ -63,10 +140,84 @@ void combineTilesetJson(const std::vector<std::filesystem::path> &tilesetJsonPat
     fs << tilesetJson << std::endl;
 }
 
-void writeToTilesetJson(const CDBTileset &tileset, bool replace, std::ofstream &fs)
+TilesetJsonSplit::TilesetJsonSplit()
+    : externalTilesetLevel{std::numeric_limits<int>::max()}
+    , maxTilesetByteLength{0}
+{}
+
+void writeToTilesetJson(const CDBTileset &tileset, bool replace, std::ostream &fs)
+{
+    auto root = tileset.getRoot();
+    if (!root) {
+        return;
+    }
+
+    std::string output;
+    JsonWriter writer(output);
+    writer.startObject();
+    writeTilesetAsset(writer);
+    writer.property("geometricError", getTileGeometricError(*root, MAX_GEOMETRIC_ERROR));
+    writer.key("root");
+    writeTileToJson(*root, MAX_GEOMETRIC_ERROR, replace ? "REPLACE" : "ADD", "", writer, output, fs);
+    writer.endObject();
+    fs << output << std::endl;
+}
+
+void writeToTilesetJson(const CDBTileset &tileset,
+                        bool replace,
+                        const TilesetJsonSplit &split,
+                        std::ostream &fs,
+                        std::map<std::filesystem::path, std::string> &externalTilesets)
+{
+    auto root = tileset.getRoot();
+    if (!root) {
+        return;
+    }
+
+    // subtrees to move out are chosen from the byte length of the tiles first, so that every tileset JSON
+    // is then written in a single pass
+    std::string refine = replace ? "REPLACE" : "ADD";
+    std::unordered_set<const CDBTile *> externalRoots;
+    planSplitTile(*root, MAX_GEOMETRIC_ERROR, refine, "", split, externalRoots);
+
+    std::string output;
+    JsonWriter writer(output);
+    writer.startObject();
+    writeTilesetAsset(writer);
+    writer.property("geometricError", getTileGeometricError(*root, MAX_GEOMETRIC_ERROR));
+    writer.key("root");
+    writeSplitTileToJson(*root, MAX_GEOMETRIC_ERROR, refine, "", externalRoots, writer, externalTilesets);
+    writer.endObject();
+    fs << output << std::endl;
+}
+
+std::filesystem::path getImplicitTilingContentURI(const CDBTile &tile, const std::string &extension)
+{
+    if (tile.getLevel() < 0) {
+        return tile.getRelativePath().filename().string() + extension;
+    }
+
+    return std::filesystem::path(IMPLICIT_CONTENT_DIRECTORY) / std::to_string(tile.getLevel())
+           / std::to_string(tile.getRREF()) / (std::to_string(tile.getUREF()) + extension);
+}
+
+void writeToImplicitTilesetJson(const CDBTileset &tileset,
+                                bool replace,
+                                int subtreeLevels,
+                                std::ostream &fs,
+                                std::map<std::filesystem::path, TileWriter> &subtrees)
 {
+    auto root = tileset.getRoot();
+    if (!root) {
+        return;
+    }
+
+    if (root->getLevel() > 0) {
+        throw std::invalid_argument("Implicit tiling requires a tileset rooted at level 0 or below");
+    }
+
     nlohmann::json tilesetJson;
-    tilesetJson["asset"] = {{"version", "1.0"}};
+    tilesetJson["asset"] = {{"version", "1.1"}};
     tilesetJson["root"] = nlohmann::json::object();
     if (replace) {
         tilesetJson["root"]["refine"] = "REPLACE";
@@ -74,18 +225,14 @@ void writeToTilesetJson(const CDBTileset &tileset, bool replace, std::ofstream &
         tilesetJson["root"]["refine"] = "ADD";
     }
 
-    auto root = tileset.getRoot();
-    if (root) {
-        convertTilesetToJson(*root, MAX_GEOMETRIC_ERROR, tilesetJson["root"]);
-        tilesetJson["geometricError"] = tilesetJson["root"]["geometricError"];
-        fs << tilesetJson << std::endl;
-    }
+    convertImplicitTilesetToJson(*root, MAX_GEOMETRIC_ERROR, subtreeLevels, tilesetJson["root"], subtrees);
+    tilesetJson["geometricError"] = tilesetJson["root"]["geometricError"];
+    fs << tilesetJson << std::endl;
 }
 
-size_t writeToI3DM(std::string GltfURI,
-                   const CDBModelsAttributes &modelsAttribs,
-                   const std::vector<int> &attribIndices,
-                   std::ofstream &fs)
+TileWriter createI3DM(const std::string &GltfURI,
+                      const CDBModelsAttributes &modelsAttribs,
+                      const std::vector<int> &attribIndices)
 {
     const auto &cdbTile = modelsAttribs.getTile();
     const auto &instancesAttribs = modelsAttribs.getInstancesAttributes();
@@ -124,7 +271,11 @@ size_t writeToI3DM(std::string GltfURI,
         glm::dvec3 worldPosition = ellipsoid.cartographicToCartesian(cartographicPositions[instanceIdx]);
         glm::vec3 positionRTC = worldPosition - center;
 
-        glm::dmat4 rotation = calculateModelOrientation(worldPosition, orientation[instanceIdx]);
+        // instances without orientation or scale attributes keep the model as it is
+        double instanceOrientation = instanceIdx < orientation.size() ? orientation[instanceIdx] : 0.0;
+        glm::vec3 instanceScale = instanceIdx < scales.size() ? scales[instanceIdx] : glm::vec3(1.0f);
+
+        glm::dmat4 rotation = calculateModelOrientation(worldPosition, instanceOrientation);
         glm::vec3 normalUp = glm::normalize(glm::column(rotation, 1));
         glm::vec3 normalRight = glm::normalize(glm::column(rotation, 0));
 
@@ -133,7 +284,7 @@ size_t writeToI3DM(std::string GltfURI,
                     sizeof(glm::vec3));
 
         std::memcpy(featureTableBuffer.data() + scaleOffset + i * sizeof(glm::vec3),
-                    &scales[instanceIdx][0],
+                    &instanceScale[0],
                     sizeof(glm::vec3));
 
         std::memcpy(featureTableBuffer.data() + normalUpOffset + i * sizeof(glm::vec3),
@@ -194,15 +345,17 @@ size_t writeToI3DM(std::string GltfURI,
         }
     }
 
-    // create header
+    // compute the size of every section before assembling the tile
     std::string featureTableString = featureTableJson.dump();
-    size_t headerToRoundUp = sizeof(I3dmHeader) + featureTableString.size();
-    featureTableString += std::string(roundUp(headerToRoundUp, 8) - headerToRoundUp, ' ');
+    size_t featureTableJsonByteLength = roundUp(sizeof(I3dmHeader) + featureTableString.size(), 8)
+                                        - sizeof(I3dmHeader);
+    size_t featureTablePadding = featureTableJsonByteLength - featureTableString.size();
 
     std::string batchTableString = batchTableJson.dump();
-    batchTableString += std::string(roundUp(batchTableString.size(), 8) - batchTableString.size(), ' ');
+    size_t batchTableJsonByteLength = roundUp(batchTableString.size(), 8);
+    size_t batchTablePadding = batchTableJsonByteLength - batchTableString.size();
 
-    GltfURI += std::string(roundUp(GltfURI.size(), 8) - GltfURI.size(), ' ');
+    size_t GltfURIByteLength = roundUp(GltfURI.size(), 8);
 
     I3dmHeader header;
     header.magic[0] = 'i';
@@ -211,41 +364,37 @@ size_t writeToI3DM(std::string GltfURI,
     header.magic[3] = 'm';
     header.version = 1;
     header.byteLength = static_cast<uint32_t>(sizeof(header))
-                        + static_cast<uint32_t>(featureTableString.size())
+                        + static_cast<uint32_t>(featureTableJsonByteLength)
                         + static_cast<uint32_t>(featureTableBuffer.size())
-                        + static_cast<uint32_t>(batchTableString.size())
+                        + static_cast<uint32_t>(batchTableJsonByteLength)
                         + static_cast<uint32_t>(batchTableBuffer.size())
-                        + static_cast<uint32_t>(GltfURI.size());
-    header.featureTableJsonByteLength = static_cast<uint32_t>(featureTableString.size());
+                        + static_cast<uint32_t>(GltfURIByteLength);
+    header.featureTableJsonByteLength = static_cast<uint32_t>(featureTableJsonByteLength);
     header.featureTableBinByteLength = static_cast<uint32_t>(featureTableBuffer.size());
-    header.batchTableJsonByteLength = static_cast<uint32_t>(batchTableString.size());
+    header.batchTableJsonByteLength = static_cast<uint32_t>(batchTableJsonByteLength);
     header.batchTableBinByteLength = static_cast<uint32_t>(batchTableBuffer.size());
     header.gltfFormat = 0;
 
-    fs.write(reinterpret_cast<const char *>(&header), sizeof(I3dmHeader));
-    fs.write(featureTableString.data(), static_cast<std::streamsize>(featureTableString.size()));
-    fs.write(reinterpret_cast<const char *>(featureTableBuffer.data()), static_cast<std::streamsize>(featureTableBuffer.size()));
-
-    fs.write(batchTableString.data(), static_cast<std::streamsize>(batchTableString.size()));
-    fs.write(reinterpret_cast<const char *>(batchTableBuffer.data()), static_cast<std::streamsize>(batchTableBuffer.size()));
-
-    fs.write(GltfURI.data(), static_cast<std::streamsize>(GltfURI.size()));
-
-    return header.byteLength;
+    TileWriter tile;
+    addHeader(header, tile);
+    tile.addString(std::move(featureTableString));
+    tile.addPadding(featureTablePadding, ' ');
+    tile.addBuffer(std::move(featureTableBuffer));
+    tile.addString(std::move(batchTableString));
+    tile.addPadding(batchTablePadding, ' ');
+    tile.addBuffer(std::move(batchTableBuffer));
+    tile.addString(GltfURI);
+    tile.addPadding(GltfURIByteLength - GltfURI.size(), ' ');
+    return tile;
 }
 
-void writeToB3DM(tinygltf::Model *gltf, const CDBInstancesAttributes *instancesAttribs, std::ofstream &fs)
+TileWriter createB3DM(tinygltf::Model &gltf, const CDBInstancesAttributes *instancesAttribs)
 {
-    // create glb
-    std::stringstream ss;
-    tinygltf::TinyGLTF gltfIO;
-    gltfIO.WriteGltfSceneToStream(gltf, ss, false, true);
-
-    // put glb into buffer
-    ss.seekp(0, std::ios::end);
-    std::stringstream::pos_type offset = ss.tellp();
-    std::vector<uint8_t> glbBuffer(roundUp(static_cast<size_t>(offset), 8), 0);
-    ss.read(reinterpret_cast<char *>(glbBuffer.data()), static_cast<std::streamsize>(glbBuffer.size()));
+    // the glb is padded to 8 bytes
+    TileWriter glb;
+    glb.addGlb(gltf);
+    size_t glbByteLength = roundUp(glb.getByteLength(), 8);
+    size_t glbPadding = glbByteLength - glb.getByteLength();
 
     // create feature table
     size_t numOfBatchID = 0;
@@ -253,8 +402,9 @@ void writeToB3DM(tinygltf::Model *gltf, const CDBInstancesAttributes *instancesA
         numOfBatchID = instancesAttribs->getInstancesCount();
     }
     std::string featureTableString = "{\"BATCH_LENGTH\":" + std::to_string(numOfBatchID) + "}";
-    size_t headerToRoundUp = sizeof(B3dmHeader) + featureTableString.size();
-    featureTableString += std::string(roundUp(headerToRoundUp, 8) - headerToRoundUp, ' ');
+    size_t featureTableJsonByteLength = roundUp(sizeof(B3dmHeader) + featureTableString.size(), 8)
+                                        - sizeof(B3dmHeader);
+    size_t featureTablePadding = featureTableJsonByteLength - featureTableString.size();
 
     // create batch table
     std::string batchTableHeader;
@@ -269,44 +419,57 @@ void writeToB3DM(tinygltf::Model *gltf, const CDBInstancesAttributes *instancesA
     header.magic[3] = 'm';
     header.version = 1;
     header.byteLength = static_cast<uint32_t>(sizeof(header))
-                        + static_cast<uint32_t>(featureTableString.size())
+                        + static_cast<uint32_t>(featureTableJsonByteLength)
                         + static_cast<uint32_t>(batchTableHeader.size())
                         + static_cast<uint32_t>(batchTableBuffer.size())
-                        + static_cast<uint32_t>(glbBuffer.size());
-    header.featureTableJsonByteLength = static_cast<uint32_t>(featureTableString.size());
+                        + static_cast<uint32_t>(glbByteLength);
+    header.featureTableJsonByteLength = static_cast<uint32_t>(featureTableJsonByteLength);
     header.featureTableBinByteLength = 0;
     header.batchTableJsonByteLength = static_cast<uint32_t>(batchTableHeader.size());
     header.batchTableBinByteLength = static_cast<uint32_t>(batchTableBuffer.size());
 
-    fs.write(reinterpret_cast<const char *>(&header), sizeof(B3dmHeader));
-    fs.write(featureTableString.data(), static_cast<std::streamsize>(featureTableString.size()));
-
-    fs.write(batchTableHeader.data(), static_cast<std::streamsize>(batchTableHeader.size()));
-    fs.write(reinterpret_cast<const char *>(batchTableBuffer.data()), static_cast<std::streamsize>(batchTableBuffer.size()));
-
-    fs.write(reinterpret_cast<const char *>(glbBuffer.data()), static_cast<std::streamsize>(glbBuffer.size()));
+    TileWriter tile;
+    addHeader(header, tile);
+    tile.addString(std::move(featureTableString));
+    tile.addPadding(featureTablePadding, ' ');
+    tile.addString(std::move(batchTableHeader));
+    tile.addBuffer(std::move(batchTableBuffer));
+    tile.addTile(std::move(glb));
+    tile.addPadding(glbPadding, 0);
+    return tile;
 }
 
-void writeToCMPT(uint32_t numOfTiles,
-                 std::ofstream &fs,
-                 std::function<uint32_t(std::ofstream &, size_t tileIdx)> writeToTileFormat)
+TileWriter createCMPT(std::vector<TileWriter> tiles)
 {
+    // inner tiles are already assembled, so the header is known before anything is written
+    size_t byteLength = sizeof(CmptHeader);
+    for (const auto &tile : tiles) {
+        byteLength += tile.getByteLength();
+    }
+
     CmptHeader header;
     header.magic[0] = 'c';
     header.magic[1] = 'm';
     header.magic[2] = 'p';
     header.magic[3] = 't';
     header.version = 1;
-    header.titleLength = numOfTiles;
-    header.byteLength = sizeof(header);
+    header.titleLength = static_cast<uint32_t>(tiles.size());
+    header.byteLength = static_cast<uint32_t>(byteLength);
 
-    fs.write(reinterpret_cast<char *>(&header), sizeof(header));
-    for (size_t i = 0; i < numOfTiles; ++i) {
-        header.byteLength += writeToTileFormat(fs, i);
+    TileWriter cmpt;
+    addHeader(header, cmpt);
+    for (auto &tile : tiles) {
+        cmpt.addTile(std::move(tile));
     }
 
-    fs.seekp(0, std::ios::beg);
-    fs.write(reinterpret_cast<char *>(&header), sizeof(header));
+    return cmpt;
+}
+
+template<typename Header>
+void addHeader(const Header &header, TileWriter &tile)
+{
+    const uint8_t *headerBytes = reinterpret_cast<const uint8_t *>(&header);
+    tile.addBuffer(std::vector<uint8_t>(headerBytes, headerBytes + sizeof(Header)));
 }
 
 void createBatchTable(const CDBInstancesAttributes *instancesAttribs,
@@ -361,7 +524,255 @@ void createBatchTable(const CDBInstancesAttributes *instancesAttribs,
     }
 }
 
-void convertTilesetToJson(const CDBTile &tile, float geometricError, nlohmann::json &json)
+void writeTilesetAsset(JsonWriter &writer)
+{
+    writer.key("asset");
+    writer.startObject();
+    writer.property("version", "1.0");
+    writer.endObject();
+}
+
+float getTileGeometricError(const CDBTile &tile, float depthGeometricError)
+{
+    // leaves are rendered at full detail
+    if (tile.getChildren().empty()) {
+        return 0.0f;
+    }
+
+    const auto &geometricError = tile.getGeometricError();
+    if (geometricError) {
+        return static_cast<float>(*geometricError);
+    }
+
+    return depthGeometricError;
+}
+
+const std::string &getTileRefine(const CDBTile &tile, const std::string &refine)
+{
+    static const std::string REPLACE = "REPLACE";
+    return tile.hasReplaceRefinement() ? REPLACE : refine;
+}
+
+void writeTileProperties(const CDBTile &tile, float geometricError, JsonWriter &writer)
+{
+    const auto &boundRegion = tile.getBoundRegion();
+    const auto &rectangle = boundRegion.getRectangle();
+    writer.key("boundingVolume");
+    writer.startObject();
+    writer.arrayProperty("region",
+                         std::vector<double>{rectangle.getWest(),
+                                             rectangle.getSouth(),
+                                             rectangle.getEast(),
+                                             rectangle.getNorth(),
+                                             boundRegion.getMinimumHeight(),
+                                             boundRegion.getMaximumHeight()});
+    writer.endObject();
+
+    auto contentURI = tile.getCustomContentURI();
+    if (contentURI) {
+        writer.key("content");
+        writer.startObject();
+        writer.property("uri", contentURI->generic_string());
+        writer.endObject();
+    }
+
+    writer.property("geometricError", geometricError);
+}
+
+void writeTileToJson(const CDBTile &tile,
+                     float geometricError,
+                     const std::string &refine,
+                     const std::string &parentRefine,
+                     JsonWriter &writer,
+                     std::string &output,
+                     std::ostream &fs)
+{
+    // the root always states its refinement, while other tiles only do when it differs from their parent
+    const auto &tileRefine = getTileRefine(tile, refine);
+    writer.startObject();
+    if (tileRefine != parentRefine) {
+        writer.property("refine", tileRefine);
+    }
+
+    const auto &children = tile.getChildren();
+    writeTileProperties(tile, getTileGeometricError(tile, geometricError), writer);
+
+    if (std::any_of(children.begin(), children.end(), [](const CDBTile *child) { return child; })) {
+        writer.key("children");
+        writer.startArray();
+        for (auto child : children) {
+            if (child) {
+                writeTileToJson(*child, geometricError / 2.0f, refine, tileRefine, writer, output, fs);
+            }
+        }
+        writer.endArray();
+    }
+
+    writer.endObject();
+
+    // hand serialized tiles over to the stream, so that the whole document never sits in memory
+    if (output.size() >= TILESET_JSON_FLUSH_BYTE_LENGTH) {
+        fs << output;
+        output.clear();
+    }
+}
+
+size_t planSplitTile(const CDBTile &tile,
+                     float geometricError,
+                     const std::string &refine,
+                     const std::string &parentRefine,
+                     const TilesetJsonSplit &split,
+                     std::unordered_set<const CDBTile *> &externalRoots)
+{
+    struct ChildSize
+    {
+        const CDBTile *tile;
+        size_t byteLength;
+        bool isExternal;
+    };
+
+    const auto &tileRefine = getTileRefine(tile, refine);
+    float childGeometricError = geometricError / 2.0f;
+    std::vector<ChildSize> childrenSize;
+    for (auto child : tile.getChildren()) {
+        if (child) {
+            size_t byteLength = planSplitTile(
+                *child, childGeometricError, refine, tileRefine, split, externalRoots);
+            childrenSize.emplace_back(ChildSize{child, byteLength, false});
+        }
+    }
+
+    // only subtrees are moved, since a leaf is no smaller than the tile that would reference it. A moved
+    // subtree is replaced with a tile whose content is the external tileset
+    auto moveToExternalTileset = [&](ChildSize &childSize) {
+        std::string stub;
+        JsonWriter stubWriter(stub);
+        writeExternalTilesetStub(*childSize.tile, childGeometricError, stubWriter);
+
+        externalRoots.insert(childSize.tile);
+        childSize.byteLength = stub.size();
+        childSize.isExternal = true;
+    };
+
+    for (auto &childSize : childrenSize) {
+        const auto &child = *childSize.tile;
+        if (child.getLevel() == split.externalTilesetLevel && !child.getChildren().empty()) {
+            moveToExternalTileset(childSize);
+        }
+    }
+
+    // the properties of a single tile are small, so they are measured by writing them
+    std::string properties;
+    JsonWriter writer(properties);
+    writer.startObject();
+    if (tileRefine != parentRefine) {
+        writer.property("refine", tileRefine);
+    }
+
+    writeTileProperties(tile, getTileGeometricError(tile, geometricError), writer);
+
+    // move the largest subtrees out until the tile and its remaining subtrees fit in the size budget
+    if (split.maxTilesetByteLength > 0) {
+        size_t maxTileByteLength = split.maxTilesetByteLength > TILESET_JSON_WRAPPER_BYTE_LENGTH
+                                       ? split.maxTilesetByteLength - TILESET_JSON_WRAPPER_BYTE_LENGTH
+                                       : 0;
+        while (true) {
+            size_t byteLength = properties.size();
+            ChildSize *largest = nullptr;
+            for (auto &childSize : childrenSize) {
+                byteLength += childSize.byteLength + 1;
+                if (!childSize.isExternal && !childSize.tile->getChildren().empty()
+                    && (!largest || childSize.byteLength > largest->byteLength)) {
+                    largest = &childSize;
+                }
+            }
+
+            if (byteLength <= maxTileByteLength || !largest) {
+                break;
+            }
+
+            moveToExternalTileset(*largest);
+        }
+    }
+
+    // ,"children":[ and ] around the children separated by commas, then the closing brace
+    size_t byteLength = properties.size() + 1;
+    if (!childrenSize.empty()) {
+        byteLength += 14 + childrenSize.size() - 1;
+        for (const auto &childSize : childrenSize) {
+            byteLength += childSize.byteLength;
+        }
+    }
+
+    return byteLength;
+}
+
+void writeExternalTilesetStub(const CDBTile &tile, float geometricError, JsonWriter &writer)
+{
+    CDBTile externalTile = tile;
+    externalTile.setCustomContentURI(tile.getRelativePath().filename().string() + ".json");
+    writer.startObject();
+    writeTileProperties(externalTile, getTileGeometricError(tile, geometricError), writer);
+    writer.endObject();
+}
+
+void writeSplitTileToJson(const CDBTile &tile,
+                          float geometricError,
+                          const std::string &refine,
+                          const std::string &parentRefine,
+                          const std::unordered_set<const CDBTile *> &externalRoots,
+                          JsonWriter &writer,
+                          std::map<std::filesystem::path, std::string> &externalTilesets)
+{
+    const auto &tileRefine = getTileRefine(tile, refine);
+    writer.startObject();
+    if (tileRefine != parentRefine) {
+        writer.property("refine", tileRefine);
+    }
+
+    const auto &children = tile.getChildren();
+    writeTileProperties(tile, getTileGeometricError(tile, geometricError), writer);
+
+    if (std::any_of(children.begin(), children.end(), [](const CDBTile *child) { return child; })) {
+        float childGeometricError = geometricError / 2.0f;
+        writer.key("children");
+        writer.startArray();
+        for (auto child : children) {
+            if (!child) {
+                continue;
+            }
+
+            if (externalRoots.find(child) == externalRoots.end()) {
+                writeSplitTileToJson(
+                    *child, childGeometricError, refine, tileRefine, externalRoots, writer, externalTilesets);
+                continue;
+            }
+
+            writeExternalTilesetStub(*child, childGeometricError, writer);
+
+            // the root of a tileset always states its refinement
+            std::string external;
+            JsonWriter externalWriter(external);
+            externalWriter.startObject();
+            writeTilesetAsset(externalWriter);
+            externalWriter.property("geometricError", getTileGeometricError(*child, childGeometricError));
+            externalWriter.key("root");
+            writeSplitTileToJson(
+                *child, childGeometricError, refine, "", externalRoots, externalWriter, externalTilesets);
+            externalWriter.endObject();
+            externalTilesets[child->getRelativePath().filename().string() + ".json"] = std::move(external);
+        }
+        writer.endArray();
+    }
+
+    writer.endObject();
+}
+
+void convertImplicitTilesetToJson(const CDBTile &tile,
+                                  float geometricError,
+                                  int subtreeLevels,
+                                  nlohmann::json &json,
+                                  std::map<std::filesystem::path, TileWriter> &subtrees)
 {
     const auto &boundRegion = tile.getBoundRegion();
     const auto &rectangle = boundRegion.getRectangle();
@@ -375,28 +786,189 @@ void convertTilesetToJson(const CDBTile &tile, float geometricError, nlohmann::j
                                    boundRegion.getMaximumHeight(),
                                }}};
 
+    // negative levels have a single child each, so they stay explicit
+    if (tile.getLevel() < 0) {
+        auto contentURI = tile.getCustomContentURI();
+        if (contentURI) {
+            json["content"] = nlohmann::json::object();
+            json["content"]["uri"] = *contentURI;
+        }
+
+        const auto &children = tile.getChildren();
+        if (children.empty() || children.front() == nullptr) {
+            json["geometricError"] = 0.0f;
+        } else {
+            json["geometricError"] = geometricError;
+
+            nlohmann::json childJson = nlohmann::json::object();
+            convertImplicitTilesetToJson(
+                *children.front(), geometricError / 2.0f, subtreeLevels, childJson, subtrees);
+            json["children"].emplace_back(childJson);
+        }
+
+        return;
+    }
+
+    std::map<ImplicitSubtreeRoot, ImplicitSubtree> implicitSubtrees;
+    int availableLevels = 0;
+    std::string contentExtension;
+    addImplicitTileAvailability(tile, subtreeLevels, implicitSubtrees, availableLevels, contentExtension);
+
+    for (const auto &implicitSubtree : implicitSubtrees) {
+        const auto &subtreeRoot = implicitSubtree.first;
+        auto subtreePath = std::filesystem::path(IMPLICIT_SUBTREE_DIRECTORY) / std::to_string(subtreeRoot[0])
+                           / std::to_string(subtreeRoot[1]) / (std::to_string(subtreeRoot[2]) + ".subtree");
+        subtrees[subtreePath] = createSubtree(implicitSubtree.second);
+    }
+
+    json["geometricError"] = geometricError;
+    if (!contentExtension.empty()) {
+        json["content"] = {{"uri", IMPLICIT_CONTENT_DIRECTORY + "/" + IMPLICIT_TEMPLATE + contentExtension}};
+    }
+
+    json["implicitTiling"] = {
+        {"subdivisionScheme", "QUADTREE"},
+        {"subtreeLevels", subtreeLevels},
+        {"availableLevels", availableLevels},
+        {"subtrees", {{"uri", IMPLICIT_SUBTREE_DIRECTORY + "/" + IMPLICIT_TEMPLATE + ".subtree"}}},
+    };
+}
+
+void addImplicitTileAvailability(const CDBTile &tile,
+                                 int subtreeLevels,
+                                 std::map<ImplicitSubtreeRoot, ImplicitSubtree> &implicitSubtrees,
+                                 int &availableLevels,
+                                 std::string &contentExtension)
+{
+    int level = tile.getLevel();
+    int x = tile.getRREF();
+    int y = tile.getUREF();
+    availableLevels = std::max(availableLevels, level + 1);
+
+    // locate the subtree of the tile and the tile within the subtree. Bits of each level are in Morton order
+    int subtreeLevel = level - level % subtreeLevels;
+    int relativeLevel = level - subtreeLevel;
+    ImplicitSubtreeRoot subtreeRoot{subtreeLevel, x >> relativeLevel, y >> relativeLevel};
+    size_t levelOffset = ((static_cast<size_t>(1) << (2 * relativeLevel)) - 1) / 3;
+    size_t bit = levelOffset
+                 + interleaveBits(x - (subtreeRoot[1] << relativeLevel),
+                                  y - (subtreeRoot[2] << relativeLevel));
+
+    auto &subtree = getImplicitSubtree(subtreeRoot, subtreeLevels, implicitSubtrees);
+    subtree.tileAvailability[bit] = true;
+
     auto contentURI = tile.getCustomContentURI();
     if (contentURI) {
-        json["content"] = nlohmann::json::object();
-        json["content"]["uri"] = *contentURI;
+        subtree.contentAvailability[bit] = true;
+        auto extension = contentURI->extension().string();
+        if (contentExtension.empty()) {
+            contentExtension = extension;
+        } else if (extension != contentExtension) {
+            throw std::invalid_argument("Implicit tiling requires the content of every tile to be "
+                                        + contentExtension + ", but " + contentURI->generic_string()
+                                        + " isn't");
+        }
     }
 
-   const std::vector<CDBTile *> &children = tile.getChildren();
+    // the root of a subtree is available in the child subtree availability of its parent subtree
+    if (relativeLevel == 0 && level > 0) {
+        ImplicitSubtreeRoot parentRoot{level - subtreeLevels, x >> subtreeLevels, y >> subtreeLevels};
+        auto &parent = getImplicitSubtree(parentRoot, subtreeLevels, implicitSubtrees);
+        size_t childBit = interleaveBits(x - (parentRoot[1] << subtreeLevels),
+                                         y - (parentRoot[2] << subtreeLevels));
+        parent.childSubtreeAvailability[childBit] = true;
+    }
 
-    if (children.empty()) {
-        json["geometricError"] = 0.0f;
-    } else {
-        json["geometricError"] = geometricError;
+    for (auto child : tile.getChildren()) {
+        if (child) {
+            addImplicitTileAvailability(
+                *child, subtreeLevels, implicitSubtrees, availableLevels, contentExtension);
+        }
+    }
+}
 
-        for (auto child : children) {
-            if (child == nullptr) {
-                continue;
-            }
+ImplicitSubtree &getImplicitSubtree(const ImplicitSubtreeRoot &subtreeRoot,
+                                    int subtreeLevels,
+                                    std::map<ImplicitSubtreeRoot, ImplicitSubtree> &implicitSubtrees)
+{
+    auto &subtree = implicitSubtrees[subtreeRoot];
+    if (subtree.tileAvailability.empty()) {
+        size_t childSubtreeCount = static_cast<size_t>(1) << (2 * subtreeLevels);
+        size_t tileCount = (childSubtreeCount - 1) / 3;
+        subtree.tileAvailability.resize(tileCount, false);
+        subtree.contentAvailability.resize(tileCount, false);
+        subtree.childSubtreeAvailability.resize(childSubtreeCount, false);
+    }
 
-            nlohmann::json childJson = nlohmann::json::object();
-            convertTilesetToJson(*child, geometricError / 2.0f, childJson);
-            json["children"].emplace_back(childJson);
+    return subtree;
+}
+
+TileWriter createSubtree(const ImplicitSubtree &subtree)
+{
+    // availability that is all 0 or all 1 is written as a constant instead of a bitstream
+    nlohmann::json subtreeJson;
+    std::vector<uint8_t> binary;
+    auto addAvailability = [&](const std::vector<bool> &availability) {
+        auto availableCount = std::count(availability.begin(), availability.end(), true);
+        if (availableCount == 0) {
+            return nlohmann::json{{"constant", 0}};
+        }
+
+        if (static_cast<size_t>(availableCount) == availability.size()) {
+            return nlohmann::json{{"constant", 1}};
+        }
+
+        size_t byteOffset = binary.size();
+        size_t byteLength = (availability.size() + 7) / 8;
+        binary.resize(roundUp(byteOffset + byteLength, 8), 0);
+        for (size_t i = 0; i < availability.size(); ++i) {
+            if (availability[i]) {
+                binary[byteOffset + i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
         }
+
+        size_t bufferView = subtreeJson["bufferViews"].size();
+        subtreeJson["bufferViews"].emplace_back(
+            nlohmann::json{{"buffer", 0}, {"byteOffset", byteOffset}, {"byteLength", byteLength}});
+        return nlohmann::json{{"bitstream", bufferView}, {"availableCount", availableCount}};
+    };
+
+    subtreeJson["tileAvailability"] = addAvailability(subtree.tileAvailability);
+    subtreeJson["contentAvailability"] = nlohmann::json::array();
+    subtreeJson["contentAvailability"].emplace_back(addAvailability(subtree.contentAvailability));
+    subtreeJson["childSubtreeAvailability"] = addAvailability(subtree.childSubtreeAvailability);
+    if (!binary.empty()) {
+        subtreeJson["buffers"] = nlohmann::json::array({{{"byteLength", binary.size()}}});
     }
+
+    std::string subtreeJsonStr = subtreeJson.dump();
+    size_t jsonPadding = roundUp(subtreeJsonStr.size(), 8) - subtreeJsonStr.size();
+
+    SubtreeHeader header;
+    header.magic[0] = 's';
+    header.magic[1] = 'u';
+    header.magic[2] = 'b';
+    header.magic[3] = 't';
+    header.version = 1;
+    header.jsonByteLength = subtreeJsonStr.size() + jsonPadding;
+    header.binaryByteLength = binary.size();
+
+    TileWriter tile;
+    addHeader(header, tile);
+    tile.addString(std::move(subtreeJsonStr));
+    tile.addPadding(jsonPadding, ' ');
+    tile.addBuffer(std::move(binary));
+    return tile;
+}
+
+size_t interleaveBits(int x, int y)
+{
+    size_t morton = 0;
+    for (size_t i = 0; i < 32; ++i) {
+        morton |= static_cast<size_t>((static_cast<unsigned>(x) >> i) & 1u) << (2 * i);
+        morton |= static_cast<size_t>((static_cast<unsigned>(y) >> i) & 1u) << (2 * i + 1);
+    }
+
+    return morton;
 }
 } // namespace CDBTo3DTiles
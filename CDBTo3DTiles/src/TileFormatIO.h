@@ -2,10 +2,12 @@
 
 #include "CDBAttributes.h"
 #include "CDBTileset.h"
+#include "TileWriter.h"
 #include "tiny_gltf.h"
 #include <filesystem>
 #include <fstream>
-#include <functional>
+#include <limits>
+#include <map>
 #include <sstream>
 
 namespace CDBTo3DTiles {
@@ -41,21 +43,65 @@ struct CmptHeader
     uint32_t titleLength;
 };
 
+struct SubtreeHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t jsonByteLength;
+    uint64_t binaryByteLength;
+};
+
 void combineTilesetJson(const std::vector<std::filesystem::path> &tilesetJsonPaths,
                         const std::vector<Core::BoundingRegion> &regions,
-                        std::ofstream &fs);
+                        std::ostream &fs);
+
+struct TilesetJsonSplit
+{
+    TilesetJsonSplit();
+
+    inline bool isEnabled() const noexcept
+    {
+        return externalTilesetLevel != std::numeric_limits<int>::max() || maxTilesetByteLength > 0;
+    }
+
+    // subtrees rooted at this level are always moved to external tilesets
+    int externalTilesetLevel;
+
+    // the largest subtrees are moved to external tilesets until every tileset JSON is at most this size.
+    // 0 disables it
+    size_t maxTilesetByteLength;
+};
+
+// tiles are written to the stream as they are serialized, without building the whole JSON document
+void writeToTilesetJson(const CDBTileset &tileset, bool replace, std::ostream &fs);
+
+// subtrees moved out of the tileset are returned in externalTilesets, keyed by their path relative to the
+// tileset JSON. They are named after their root tile and referenced by the content URI of a tile
+void writeToTilesetJson(const CDBTileset &tileset,
+                        bool replace,
+                        const TilesetJsonSplit &split,
+                        std::ostream &fs,
+                        std::map<std::filesystem::path, std::string> &externalTilesets);
+
+// 3D Tiles 1.1 implicit tiling. Tiles at positive levels form a quadtree rooted at the level 0 tile of the
+// GeoCell, with RREF as x and UREF as y, so their content has to be written at the templated URI returned by
+// getImplicitTilingContentURI. Negative levels are kept as explicit tiles above the implicit root. Subtree
+// availability files are returned in subtrees, keyed by their path relative to the tileset JSON
+std::filesystem::path getImplicitTilingContentURI(const CDBTile &tile, const std::string &extension);
 
-void writeToTilesetJson(const CDBTileset &tileset, bool replace, std::ofstream &fs);
+void writeToImplicitTilesetJson(const CDBTileset &tileset,
+                                bool replace,
+                                int subtreeLevels,
+                                std::ostream &fs,
+                                std::map<std::filesystem::path, TileWriter> &subtrees);
 
-size_t writeToI3DM(std::string GltfURI,
-                   const CDBModelsAttributes &modelsAttribs,
-                   const std::vector<int> &attribIndices,
-                   std::ofstream &fs);
+TileWriter createI3DM(const std::string &GltfURI,
+                      const CDBModelsAttributes &modelsAttribs,
+                      const std::vector<int> &attribIndices);
 
-void writeToB3DM(tinygltf::Model *gltf, const CDBInstancesAttributes *instancesAttribs, std::ofstream &fs);
+// the glTF model has to outlive the returned tile. It is written as it is, so it has to be compressed first
+TileWriter createB3DM(tinygltf::Model &gltf, const CDBInstancesAttributes *instancesAttribs);
 
-void writeToCMPT(uint32_t numOfTiles,
-                 std::ofstream &fs,
-                 std::function<uint32_t(std::ofstream &fs, size_t tileIdx)> writeToTileFormat);
+TileWriter createCMPT(std::vector<TileWriter> tiles);
 
 } // namespace CDBTo3DTiles
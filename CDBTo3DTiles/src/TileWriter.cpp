@@ -0,0 +1,87 @@
+#include "TileWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace CDBTo3DTiles {
+static const uint8_t ZERO_PADDING[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t SPACE_PADDING[8] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+
+TileWriter::TileWriter()
+    : m_byteLength{0}
+{}
+
+void TileWriter::addSegment(const uint8_t *data, size_t byteLength)
+{
+    if (byteLength == 0) {
+        return;
+    }
+
+    m_segments.emplace_back(GlbSegment{data, byteLength});
+    m_byteLength += byteLength;
+}
+
+void TileWriter::addString(std::string str)
+{
+    const auto &owned = m_strings.emplace_back(std::move(str));
+    addSegment(reinterpret_cast<const uint8_t *>(owned.data()), owned.size());
+}
+
+void TileWriter::addBuffer(std::vector<uint8_t> buffer)
+{
+    const auto &owned = m_buffers.emplace_back(std::move(buffer));
+    addSegment(owned.data(), owned.size());
+}
+
+void TileWriter::addGlb(const tinygltf::Model &gltf)
+{
+    const auto &glbWriter = m_glbWriters.emplace_back(gltf);
+    for (const auto &segment : glbWriter.getSegments()) {
+        addSegment(segment.data, segment.byteLength);
+    }
+}
+
+void TileWriter::addPadding(size_t byteLength, char paddingChar)
+{
+    const uint8_t *padding = paddingChar == ' ' ? SPACE_PADDING : ZERO_PADDING;
+    while (byteLength > 0) {
+        size_t paddingLength = std::min(byteLength, sizeof(ZERO_PADDING));
+        addSegment(padding, paddingLength);
+        byteLength -= paddingLength;
+    }
+}
+
+void TileWriter::addTile(TileWriter &&tile)
+{
+    m_strings.splice(m_strings.end(), tile.m_strings);
+    m_buffers.splice(m_buffers.end(), tile.m_buffers);
+    m_glbWriters.splice(m_glbWriters.end(), tile.m_glbWriters);
+    m_segments.insert(m_segments.end(), tile.m_segments.begin(), tile.m_segments.end());
+    m_byteLength += tile.m_byteLength;
+
+    tile.m_segments.clear();
+    tile.m_byteLength = 0;
+}
+
+void TileWriter::write(uint8_t *destination) const
+{
+    for (const auto &segment : m_segments) {
+        std::memcpy(destination, segment.data, segment.byteLength);
+        destination += segment.byteLength;
+    }
+}
+
+void TileWriter::write(std::ostream &stream) const
+{
+    for (const auto &segment : m_segments) {
+        stream.write(reinterpret_cast<const char *>(segment.data),
+                     static_cast<std::streamsize>(segment.byteLength));
+    }
+}
+
+std::vector<uint8_t> TileWriter::toBuffer() const
+{
+    std::vector<uint8_t> buffer(m_byteLength);
+    write(buffer.data());
+    return buffer;
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "GlbWriter.h"
+#include "tiny_gltf.h"
+#include <list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace CDBTo3DTiles {
+// assemble a tile as a list of segments whose sizes are all known before anything is written. The tile can
+// then be written in one pass to a stream, into a single preallocated buffer or to an archive entry, and
+// headers never have to be patched afterward. Segments either point into storage owned by the writer, or
+// into borrowed data (e.g. the buffer of a glTF model) that has to outlive the writer
+class TileWriter
+{
+public:
+    TileWriter();
+
+    inline size_t getByteLength() const noexcept { return m_byteLength; }
+
+    inline const std::vector<GlbSegment> &getSegments() const noexcept { return m_segments; }
+
+    void addSegment(const uint8_t *data, size_t byteLength);
+
+    void addString(std::string str);
+
+    void addBuffer(std::vector<uint8_t> buffer);
+
+    void addGlb(const tinygltf::Model &gltf);
+
+    // paddingChar is either ' ' for JSON or 0 for binary sections
+    void addPadding(size_t byteLength, char paddingChar);
+
+    // append all the segments of the other tile and take over its storage
+    void addTile(TileWriter &&tile);
+
+    // destination must have space for getByteLength() bytes
+    void write(uint8_t *destination) const;
+
+    void write(std::ostream &stream) const;
+
+    std::vector<uint8_t> toBuffer() const;
+
+private:
+    // lists keep the address of their elements stable when they grow or are spliced together
+    std::list<std::string> m_strings;
+    std::list<std::vector<uint8_t>> m_buffers;
+    std::list<GlbWriter> m_glbWriters;
+    std::vector<GlbSegment> m_segments;
+    size_t m_byteLength;
+};
+} // namespace CDBTo3DTiles
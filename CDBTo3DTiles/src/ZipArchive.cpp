@@ -0,0 +1,256 @@
+#include "ZipArchive.h"
+#include "zlib.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace CDBTo3DTiles {
+static const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const uint32_t ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+static const uint32_t ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06064b50;
+static const uint32_t ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIGNATURE = 0x07064b50;
+static const uint16_t ZIP_STORED = 0;
+static const uint16_t ZIP_DEFLATED = 8;
+static const uint16_t ZIP64_EXTRA_FIELD = 0x0001;
+static const size_t ZIP_LOCAL_HEADER_LENGTH = 30;
+static const size_t ZIP_CENTRAL_HEADER_LENGTH = 46;
+static const size_t ZIP_END_OF_CENTRAL_DIRECTORY_LENGTH = 22;
+static const size_t ZIP64_END_OF_CENTRAL_DIRECTORY_LENGTH = 56;
+static const size_t ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_LENGTH = 20;
+static const size_t ZIP_MAX_COMMENT_LENGTH = 0xFFFF;
+static const uint64_t ZIP_MAX_32 = std::numeric_limits<uint32_t>::max();
+static const uint64_t ZIP_MAX_16 = std::numeric_limits<uint16_t>::max();
+static const uint64_t DEFLATE_MAX_RATIO = 1032;
+static const uint64_t DEFLATE_MAX_OVERHEAD = 1024;
+
+template<typename T>
+static T readLittleEndian(const uint8_t *data);
+
+static void inflateEntry(const uint8_t *data, size_t byteLength, std::string &content);
+
+ZipArchive::ZipArchive(const std::filesystem::path &path)
+    : m_path{path}
+    , m_file{path}
+    , m_data{m_file.data()}
+    , m_byteLength{m_file.size()}
+{
+    readCentralDirectory();
+}
+
+bool ZipArchive::contains(const std::string &name) const
+{
+    return m_nameToEntry.find(name) != m_nameToEntry.end();
+}
+
+std::optional<std::string> ZipArchive::readEntry(const std::string &name) const
+{
+    auto entryIt = m_nameToEntry.find(name);
+    if (entryIt == m_nameToEntry.end()) {
+        return std::nullopt;
+    }
+
+    // the local header repeats the name, but its extra field may differ from the central directory one
+    const auto &entry = entryIt->second;
+    if (entry.localHeaderOffset > m_byteLength - ZIP_LOCAL_HEADER_LENGTH
+        || readLittleEndian<uint32_t>(m_data + entry.localHeaderOffset) != ZIP_LOCAL_HEADER_SIGNATURE) {
+        throw std::runtime_error("Invalid local header of " + name + " in " + m_path.string());
+    }
+
+    const uint8_t *localHeader = m_data + entry.localHeaderOffset;
+    uint64_t dataOffset = entry.localHeaderOffset + ZIP_LOCAL_HEADER_LENGTH
+                          + readLittleEndian<uint16_t>(localHeader + 26)
+                          + readLittleEndian<uint16_t>(localHeader + 28);
+    if (dataOffset > m_byteLength || entry.compressedByteLength > m_byteLength - dataOffset) {
+        throw std::runtime_error("Truncated entry " + name + " in " + m_path.string());
+    }
+
+    const uint8_t *data = m_data + dataOffset;
+    std::string content;
+    if (entry.compressionMethod == ZIP_STORED) {
+        if (entry.compressedByteLength != entry.byteLength) {
+            throw std::runtime_error("Invalid stored entry " + name + " in " + m_path.string());
+        }
+
+        content.assign(reinterpret_cast<const char *>(data), static_cast<size_t>(entry.byteLength));
+    } else if (entry.compressionMethod == ZIP_DEFLATED) {
+        // deflate expands at most about 1032:1, so a larger size can only come from a damaged header
+        if (entry.byteLength > entry.compressedByteLength * DEFLATE_MAX_RATIO + DEFLATE_MAX_OVERHEAD) {
+            throw std::runtime_error("Invalid size of entry " + name + " in " + m_path.string());
+        }
+
+        content.resize(static_cast<size_t>(entry.byteLength));
+        inflateEntry(data, static_cast<size_t>(entry.compressedByteLength), content);
+    } else {
+        throw std::runtime_error("Unsupported compression method of " + name + " in " + m_path.string());
+    }
+
+    // crc32 takes at most 4GB at a time
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const uint8_t *contentData = reinterpret_cast<const uint8_t *>(content.data());
+    size_t remainLength = content.size();
+    while (remainLength > 0) {
+        auto length = static_cast<uInt>(std::min<size_t>(remainLength, ZIP_MAX_32));
+        crc = crc32(crc, contentData, length);
+        contentData += length;
+        remainLength -= length;
+    }
+
+    if (static_cast<uint32_t>(crc) != entry.crc32) {
+        throw std::runtime_error("Corrupted entry " + name + " in " + m_path.string());
+    }
+
+    return content;
+}
+
+void ZipArchive::readCentralDirectory()
+{
+    if (m_byteLength < ZIP_END_OF_CENTRAL_DIRECTORY_LENGTH) {
+        throw std::runtime_error(m_path.string() + " is not a zip archive");
+    }
+
+    // the end of central directory record is followed by a comment of unknown length, so search backward
+    size_t endOffset = m_byteLength - ZIP_END_OF_CENTRAL_DIRECTORY_LENGTH;
+    size_t searchEnd = endOffset - std::min(endOffset, ZIP_MAX_COMMENT_LENGTH);
+    while (readLittleEndian<uint32_t>(m_data + endOffset) != ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+        if (endOffset == searchEnd) {
+            throw std::runtime_error(m_path.string() + " is not a zip archive");
+        }
+
+        --endOffset;
+    }
+
+    const uint8_t *end = m_data + endOffset;
+    uint64_t entriesCount = readLittleEndian<uint16_t>(end + 10);
+    uint64_t centralDirectoryLength = readLittleEndian<uint32_t>(end + 12);
+    uint64_t centralDirectoryOffset = readLittleEndian<uint32_t>(end + 16);
+    bool isZip64 = entriesCount == ZIP_MAX_16 || centralDirectoryLength == ZIP_MAX_32
+                   || centralDirectoryOffset == ZIP_MAX_32;
+    if (isZip64 && endOffset >= ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_LENGTH) {
+        const uint8_t *locator = end - ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_LENGTH;
+        if (readLittleEndian<uint32_t>(locator) == ZIP64_END_OF_CENTRAL_DIRECTORY_LOCATOR_SIGNATURE) {
+            uint64_t zip64EndOffset = readLittleEndian<uint64_t>(locator + 8);
+            if (m_byteLength < ZIP64_END_OF_CENTRAL_DIRECTORY_LENGTH
+                || zip64EndOffset > m_byteLength - ZIP64_END_OF_CENTRAL_DIRECTORY_LENGTH
+                || readLittleEndian<uint32_t>(m_data + zip64EndOffset)
+                       != ZIP64_END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+                throw std::runtime_error("Invalid ZIP64 end of central directory in " + m_path.string());
+            }
+
+            const uint8_t *zip64End = m_data + zip64EndOffset;
+            entriesCount = readLittleEndian<uint64_t>(zip64End + 32);
+            centralDirectoryLength = readLittleEndian<uint64_t>(zip64End + 40);
+            centralDirectoryOffset = readLittleEndian<uint64_t>(zip64End + 48);
+        }
+    }
+
+    if (centralDirectoryOffset > m_byteLength
+        || centralDirectoryLength > m_byteLength - centralDirectoryOffset) {
+        throw std::runtime_error("Invalid central directory in " + m_path.string());
+    }
+
+    m_entryNames.reserve(static_cast<size_t>(std::min(entriesCount, centralDirectoryLength)));
+    m_nameToEntry.reserve(static_cast<size_t>(std::min(entriesCount, centralDirectoryLength)));
+    const uint8_t *header = m_data + centralDirectoryOffset;
+    const uint8_t *centralDirectoryEnd = header + centralDirectoryLength;
+    for (uint64_t i = 0; i < entriesCount; ++i) {
+        if (static_cast<size_t>(centralDirectoryEnd - header) < ZIP_CENTRAL_HEADER_LENGTH
+            || readLittleEndian<uint32_t>(header) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+            throw std::runtime_error("Invalid central directory in " + m_path.string());
+        }
+
+        size_t nameLength = readLittleEndian<uint16_t>(header + 28);
+        size_t extraLength = readLittleEndian<uint16_t>(header + 30);
+        size_t commentLength = readLittleEndian<uint16_t>(header + 32);
+        size_t headerLength = ZIP_CENTRAL_HEADER_LENGTH + nameLength + extraLength + commentLength;
+        if (static_cast<size_t>(centralDirectoryEnd - header) < headerLength) {
+            throw std::runtime_error("Invalid central directory in " + m_path.string());
+        }
+
+        Entry entry;
+        entry.compressionMethod = readLittleEndian<uint16_t>(header + 10);
+        entry.crc32 = readLittleEndian<uint32_t>(header + 16);
+        entry.compressedByteLength = readLittleEndian<uint32_t>(header + 20);
+        entry.byteLength = readLittleEndian<uint32_t>(header + 24);
+        entry.localHeaderOffset = readLittleEndian<uint32_t>(header + 42);
+
+        // ZIP64 values only follow for the fields that are saturated, in this order
+        const uint8_t *extra = header + ZIP_CENTRAL_HEADER_LENGTH + nameLength;
+        const uint8_t *extraEnd = extra + extraLength;
+        while (extraEnd - extra >= 4) {
+            uint16_t extraID = readLittleEndian<uint16_t>(extra);
+            size_t extraFieldLength = readLittleEndian<uint16_t>(extra + 2);
+            const uint8_t *field = extra + 4;
+            size_t fieldLength = std::min(extraFieldLength, static_cast<size_t>(extraEnd - field));
+            const uint8_t *fieldEnd = field + fieldLength;
+            if (extraID == ZIP64_EXTRA_FIELD) {
+                auto values = {&entry.byteLength, &entry.compressedByteLength, &entry.localHeaderOffset};
+                for (auto value : values) {
+                    if (*value == ZIP_MAX_32 && fieldEnd - field >= 8) {
+                        *value = readLittleEndian<uint64_t>(field);
+                        field += 8;
+                    }
+                }
+            }
+
+            extra = fieldEnd;
+        }
+
+        std::string name(reinterpret_cast<const char *>(header + ZIP_CENTRAL_HEADER_LENGTH), nameLength);
+        header += headerLength;
+
+        // directories have no content
+        if (name.empty() || name.back() == '/') {
+            continue;
+        }
+
+        if (m_nameToEntry.insert({name, entry}).second) {
+            m_entryNames.emplace_back(std::move(name));
+        }
+    }
+}
+
+template<typename T>
+T readLittleEndian(const uint8_t *data)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value = static_cast<T>(value | (static_cast<T>(data[i]) << (8 * i)));
+    }
+
+    return value;
+}
+
+void inflateEntry(const uint8_t *data, size_t byteLength, std::string &content)
+{
+    // entries hold raw deflate streams without zlib header
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("Cannot initialize zip decompression");
+    }
+
+    // zlib takes at most 4GB at a time
+    stream.next_in = const_cast<Bytef *>(data);
+    stream.next_out = reinterpret_cast<Bytef *>(&content[0]);
+    size_t remainInput = byteLength;
+    size_t remainOutput = content.size();
+    int result = Z_OK;
+    while (result == Z_OK) {
+        auto input = static_cast<uInt>(std::min<size_t>(remainInput, ZIP_MAX_32));
+        auto output = static_cast<uInt>(std::min<size_t>(remainOutput, ZIP_MAX_32));
+        stream.avail_in = input;
+        stream.avail_out = output;
+        result = inflate(&stream, Z_FINISH);
+        remainInput -= input - stream.avail_in;
+        remainOutput -= output - stream.avail_out;
+        if (result == Z_BUF_ERROR && remainInput > 0 && remainOutput > 0) {
+            result = Z_OK;
+        }
+    }
+
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END || remainOutput != 0) {
+        throw std::runtime_error("Cannot decompress zip entry");
+    }
+}
+} // namespace CDBTo3DTiles
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace CDBTo3DTiles {
+// read only zip archive. The file is memory mapped and its central directory is indexed once when the
+// archive is opened, then entries are decompressed on demand. Stored and deflated entries are supported,
+// as well as ZIP64 archives. Every member is const after construction, so an archive can be read from
+// several threads at once
+class ZipArchive
+{
+public:
+    explicit ZipArchive(const std::filesystem::path &path);
+
+    inline const std::filesystem::path &getPath() const noexcept { return m_path; }
+
+    inline const std::vector<std::string> &getEntryNames() const noexcept { return m_entryNames; }
+
+    bool contains(const std::string &name) const;
+
+    std::optional<std::string> readEntry(const std::string &name) const;
+
+private:
+    struct Entry
+    {
+        uint16_t compressionMethod;
+        uint32_t crc32;
+        uint64_t compressedByteLength;
+        uint64_t byteLength;
+        uint64_t localHeaderOffset;
+    };
+
+    void readCentralDirectory();
+
+    std::filesystem::path m_path;
+    MappedFile m_file;
+    const uint8_t *m_data;
+    size_t m_byteLength;
+    std::vector<std::string> m_entryNames;
+    std::unordered_map<std::string, Entry> m_nameToEntry;
+};
+} // namespace CDBTo3DTiles
@@ -2,6 +2,7 @@
 #include "CDBTo3DTiles.h"
 #include "Utility.h"
 #include "cxxopts.hpp"
+#include <algorithm>
 #include <iostream>
 
 int main(int argc, char **argv)
@@ -14,7 +15,7 @@ int main(int argc, char **argv)
             "CDB directory",
             cxxopts::value<std::string>())
         ("o, output",
-            "3D Tiles output directory",
+            "3D Tiles output directory, or a .3tz file to write a single indexed archive",
             cxxopts::value<std::string>())
         ("combine",
             "Combine converted datasets into one tileset. Each dataset format is {DatasetName}_{ComponentSelector1}_{ComponentSelector2}. "
@@ -33,6 +34,60 @@ int main(int argc, char **argv)
         ("elevation-threshold-indices",
             "Set target percent of indices when decimating elevation mesh",
             cxxopts::value<float>()->default_value("0.3"))
+        ("normal-quantization-bits",
+            "Store normals as 8 or 16 bits normalized integers using KHR_mesh_quantization. 0 keeps 32 bits float normals",
+            cxxopts::value<int>()->default_value("0"))
+        ("position-quantization-bits",
+            "Store positions as unsigned integers with the given number of bits (1 to 16) within the mesh bounding box using KHR_mesh_quantization. 0 keeps 32 bits float positions",
+            cxxopts::value<int>()->default_value("0"))
+        ("uv-quantization-bits",
+            "Round texture coordinates in the range [0, 1] to the given number of bits (1 to 16) and store them as normalized unsigned short. 0 keeps 32 bits float texture coordinates",
+            cxxopts::value<int>()->default_value("0"))
+        ("meshopt-compression",
+            "Compress glTF buffers with EXT_meshopt_compression",
+            cxxopts::value<bool>()->default_value("false"))
+        ("meshopt-fallback",
+            "Keep uncompressed glTF buffers alongside the compressed ones for clients without EXT_meshopt_compression support",
+            cxxopts::value<bool>()->default_value("false"))
+        ("optimize-meshes",
+            "Reorder triangles and vertices for GPU vertex cache, overdraw and vertex fetch efficiency before writing glTF",
+            cxxopts::value<bool>()->default_value("false"))
+        ("deduplicate-content",
+            "Write byte-identical textures and glTF models once and point every reference to the same file",
+            cxxopts::value<bool>()->default_value("false"))
+        ("implicit-tiling",
+            "Write 3D Tiles 1.1 implicit tilesets with subtree availability files instead of listing every tile in the tileset JSON",
+            cxxopts::value<bool>()->default_value("false"))
+        ("tight-bounding-heights",
+            "Fit the heights of every bounding region to the tile content and its descendants instead of the ellipsoid surface",
+            cxxopts::value<bool>()->default_value("false"))
+        ("measured-geometric-error",
+            "Derive geometric errors from the elevation simplification error and sample spacing, and from the size of the largest model in a tile, instead of halving them at every level",
+            cxxopts::value<bool>()->default_value("false"))
+        ("gs-model-instancing",
+            "Write GS models that appear more than once in a tile a single time and place them with instanced tiles, instead of merging a copy of every instance",
+            cxxopts::value<bool>()->default_value("false"))
+        ("gs-model-hlod-level",
+            "Generate simplified GS models for the tiles at and below the given level of detail that have no GS models of their own. They replace their children until these are refined",
+            cxxopts::value<int>())
+        ("model-cache",
+            "Keep converted OpenFlight models in the given directory and reuse them in later conversions as long as their source files are unchanged",
+            cxxopts::value<std::string>())
+        ("model-texture-max-size",
+            "Resample GT and GS model textures larger than the given width or height in pixels down to it, keeping their aspect ratio",
+            cxxopts::value<int>())
+        ("model-texture-budget-kb",
+            "Halve the largest textures of every GT model and GS model tile until their decoded size is at most the given size in kilobytes. 0 keeps every texture",
+            cxxopts::value<int>()->default_value("0"))
+        ("external-tileset-level",
+            "Move every subtree rooted at the given level of detail to an external tileset JSON",
+            cxxopts::value<int>())
+        ("max-tileset-kb",
+            "Move the largest subtrees to external tileset JSON files until every tileset JSON is at most the given size in kilobytes. 0 keeps a single tileset JSON",
+            cxxopts::value<int>()->default_value("0"))
+        ("gzip",
+            "Also write a gzip compressed .gz copy of every tileset JSON, subtree and tile for static servers that deliver pre-compressed files. A .3tz archive deflates its entries instead",
+            cxxopts::value<bool>()->default_value("false"))
         ("h, help", "Print usage");
     // clang-format on
 
@@ -51,6 +106,20 @@ int main(int argc, char **argv)
             bool elevationLOD = result["elevation-lod"].as<bool>();
             float elevationDecimateError = result["elevation-decimate-error"].as<float>();
             float elevationThresholdIndices = result["elevation-threshold-indices"].as<float>();
+            int normalQuantizationBits = result["normal-quantization-bits"].as<int>();
+            int positionQuantizationBits = result["position-quantization-bits"].as<int>();
+            int UVQuantizationBits = result["uv-quantization-bits"].as<int>();
+            bool meshoptCompression = result["meshopt-compression"].as<bool>();
+            bool meshoptFallback = result["meshopt-fallback"].as<bool>();
+            bool optimizeMeshes = result["optimize-meshes"].as<bool>();
+            bool deduplicateContent = result["deduplicate-content"].as<bool>();
+            bool gzipOutput = result["gzip"].as<bool>();
+            bool implicitTiling = result["implicit-tiling"].as<bool>();
+            bool tightBoundingHeights = result["tight-bounding-heights"].as<bool>();
+            bool measuredGeometricError = result["measured-geometric-error"].as<bool>();
+            bool GSModelInstancing = result["gs-model-instancing"].as<bool>();
+            int maxTilesetKB = result["max-tileset-kb"].as<int>();
+            int modelTextureBudgetKB = result["model-texture-budget-kb"].as<int>();
             std::vector<std::string> combinedDatasets = result["combine"].as<std::vector<std::string>>();
 
             CDBTo3DTiles::GlobalInitializer initializer;
@@ -59,6 +128,33 @@ int main(int argc, char **argv)
             converter.setElevationLODOnly(elevationLOD);
             converter.setElevationDecimateError(elevationDecimateError);
             converter.setElevationThresholdIndices(elevationThresholdIndices);
+            converter.setNormalQuantizationBits(normalQuantizationBits);
+            converter.setPositionQuantizationBits(positionQuantizationBits);
+            converter.setUVQuantizationBits(UVQuantizationBits);
+            converter.setMeshoptCompression(meshoptCompression);
+            converter.setMeshoptFallback(meshoptFallback);
+            converter.setOptimizeMeshes(optimizeMeshes);
+            converter.setDeduplicateContent(deduplicateContent);
+            converter.setGzipOutput(gzipOutput);
+            converter.setImplicitTiling(implicitTiling);
+            converter.setTightBoundingHeights(tightBoundingHeights);
+            converter.setMeasuredGeometricError(measuredGeometricError);
+            converter.setGSModelInstancing(GSModelInstancing);
+            converter.setMaxTilesetByteLength(static_cast<size_t>(std::max(maxTilesetKB, 0)) * 1024);
+            converter.setModelTextureByteBudget(static_cast<size_t>(std::max(modelTextureBudgetKB, 0))
+                                                * 1024);
+            if (result.count("gs-model-hlod-level")) {
+                converter.setGSModelHLODLevel(result["gs-model-hlod-level"].as<int>());
+            }
+            if (result.count("model-cache")) {
+                converter.setModelCacheDirectory(result["model-cache"].as<std::string>());
+            }
+            if (result.count("model-texture-max-size")) {
+                converter.setModelTextureMaxSize(result["model-texture-max-size"].as<int>());
+            }
+            if (result.count("external-tileset-level")) {
+                converter.setExternalTilesetLevel(result["external-tileset-level"].as<int>());
+            }
             for (const auto &combined : combinedDatasets) {
                 converter.combineDataset(CDBTo3DTiles::splitString(combined, ","));
             }
@@ -570,7 +570,7 @@ TEST_CASE("Test that elevation conversion uses uniform grid mesh instead of simp
     const auto &uniformElevation = elevation->getUniformGridMesh();
     const auto &indicesAccessor = model.accessors[static_cast<size_t>(gltfPrimitive.indices)];
     REQUIRE(indicesAccessor.count == uniformElevation.indices.size());
-    REQUIRE(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+    REQUIRE(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
 
     const auto &positionAccessor = model.accessors[static_cast<size_t>(gltfPrimitive.attributes.at("POSITION"))];
     REQUIRE(positionAccessor.count == uniformElevation.positionRTCs.size());
@@ -587,10 +587,9 @@ TEST_CASE("Test that elevation conversion uses uniform grid mesh instead of simp
 
     const auto &indicesBufferView = model.bufferViews[static_cast<size_t>(indicesAccessor.bufferView)];
     size_t index = 0;
-    for (size_t i = indicesBufferView.byteOffset; i < indicesBufferView.byteLength;
-         i += sizeof(unsigned int)) {
-        unsigned gltfIndex = 0;
-        std::memcpy(&gltfIndex, &gltfBufferData[i], sizeof(unsigned int));
+    for (size_t i = indicesBufferView.byteOffset; i < indicesBufferView.byteLength; i += sizeof(uint16_t)) {
+        uint16_t gltfIndex = 0;
+        std::memcpy(&gltfIndex, &gltfBufferData[i], sizeof(uint16_t));
         REQUIRE(gltfIndex == uniformElevation.indices[index]);
         ++index;
     }
@@ -1,8 +1,12 @@
 #include "CDBModels.h"
 #include "CDBTo3DTiles.h"
 #include "Config.h"
+#include "OutputSink.h"
 #include "catch2/catch.hpp"
 #include "nlohmann/json.hpp"
+#include "osgDB/ReadFile"
+#include <cstring>
+#include <fstream>
 
 using namespace CDBTo3DTiles;
 
@@ -111,9 +115,108 @@ TEST_CASE("Test creating GSModel from model attributes", "[CDBGSModels]")
         REQUIRE(tile.getUREF() == 0);
         REQUIRE(tile.getRREF() == 0);
     }
+
+    SECTION("Create GSModel with repeated models instanced")
+    {
+        std::filesystem::path CDBPath = dataPath / "GSModelsWithGTModelTexture";
+        std::filesystem::path input = CDBPath / "Tiles" / "N32" / "W118" / "100_GSFeature" / "L00" / "U0"
+                                      / "N32W118_D100_S001_T001_L00_U0_R0.dbf";
+
+        auto GSFeatureTile = CDBTile::createFromFile(input.filename().string());
+        auto createModels = [&](bool instanceRepeatedModels) {
+            GDALDatasetUniquePtr attributesDataset = GDALDatasetUniquePtr(
+                (GDALDataset *) GDALOpenEx(input.c_str(), GDAL_OF_VECTOR, nullptr, nullptr, nullptr));
+            REQUIRE(attributesDataset != nullptr);
+
+            CDBModelsAttributes modelsAttributes(std::move(attributesDataset), *GSFeatureTile, CDBPath);
+            return CDBGSModels::createFromModelsAttributes(std::move(modelsAttributes),
+                                                           CDBPath,
+                                                           instanceRepeatedModels);
+        };
+
+        auto mergedModels = createModels(false);
+        REQUIRE(mergedModels != std::nullopt);
+        REQUIRE(mergedModels->getInstancedModels().empty());
+
+        auto instancedModels = createModels(true);
+        REQUIRE(instancedModels != std::nullopt);
+
+        // every instance is either merged or placed by a model referenced more than once
+        size_t instanceCount = instancedModels->getInstancesAttributes().getInstancesCount();
+        const auto &modelsAttribs = instancedModels->getModelsAttributes();
+        size_t modelsAttribsCount = modelsAttribs.getInstancesAttributes().getInstancesCount();
+        for (const auto &instancedModel : instancedModels->getInstancedModels()) {
+            REQUIRE(instancedModel.instances.size() > 1);
+            REQUIRE(instancedModel.model3D.getMeshes().size() > 0);
+            for (auto instance : instancedModel.instances) {
+                REQUIRE(static_cast<size_t>(instance) < modelsAttribsCount);
+            }
+
+            instanceCount += instancedModel.instances.size();
+        }
+
+        REQUIRE(instanceCount == mergedModels->getInstancesAttributes().getInstancesCount());
+    }
+}
+
+TEST_CASE("Test finding GSModel textures in the texture archive", "[CDBGSModels]")
+{
+    std::string tileName = "N32W118_D301_S001_T001_L00_U0_R0";
+    std::filesystem::path archivePath = "GSModelTextureIndex.zip";
+    {
+        ArchiveSink sink(archivePath);
+        sink.write(tileName + "_Roof_Tiled1.RGB", std::string("roof"));
+        sink.write(tileName + "_salmon.rgb", std::string("salmon"));
+        sink.write(tileName + "_salmon.png", std::string("salmon"));
+        sink.write("Window.jpg", std::string("window"));
+        sink.close();
+    }
+
+    osg::ref_ptr<CDBGSModels::FindGSModelTexture> findTexture = new CDBGSModels::FindGSModelTexture(
+        tileName, std::make_shared<const ZipArchive>(archivePath));
+
+    SECTION("Test names are matched regardless of their case, directory and tile name")
+    {
+        REQUIRE(findTexture->searchArchiveTextureName("Roof_Tiled1.RGB") == "Roof_Tiled1.RGB");
+        REQUIRE(findTexture->searchArchiveTextureName("roof_tiled1.rgb") == "Roof_Tiled1.RGB");
+        REQUIRE(findTexture->searchArchiveTextureName("textures/ROOF_TILED1.rgb") == "Roof_Tiled1.RGB");
+        REQUIRE(findTexture->searchArchiveTextureName(tileName + "_Roof_Tiled1.RGB") == "Roof_Tiled1.RGB");
+        REQUIRE(findTexture->searchArchiveTextureName("window.JPG") == "Window.jpg");
+    }
+
+    SECTION("Test the texture with the same extension is preferred")
+    {
+        REQUIRE(findTexture->searchArchiveTextureName("salmon.png") == "salmon.png");
+        REQUIRE(findTexture->searchArchiveTextureName("SALMON.RGB") == "salmon.rgb");
+
+        // without a texture of the same extension, the first one of the stem is used
+        REQUIRE(findTexture->searchArchiveTextureName("salmon.jpg") == "salmon.rgb");
+        REQUIRE(findTexture->searchArchiveTextureName("salmon") == "salmon.rgb");
+    }
+
+    SECTION("Test the stem is looked up without its leading parts")
+    {
+        REQUIRE(findTexture->searchArchiveTextureName("D301_S001_T001_salmon.png") == "salmon.png");
+        REQUIRE(findTexture->searchArchiveTextureName("N32W118_D300_Roof_Tiled1.rgb") == "Roof_Tiled1.RGB");
+    }
+
+    SECTION("Test missing textures are not found")
+    {
+        REQUIRE(findTexture->searchArchiveTextureName("missing.rgb") == std::nullopt);
+        REQUIRE(findTexture->searchArchiveTextureName("roof.rgb") == std::nullopt);
+        REQUIRE(findTexture->searchArchiveTextureName("salmon_roof.rgb") == std::nullopt);
+
+        osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
+        REQUIRE(findTexture->findDataFile("missing.rgb", options.get(), osgDB::CASE_SENSITIVE).empty());
+        REQUIRE(findTexture->findDataFile("roof_tiled1.rgb", options.get(), osgDB::CASE_SENSITIVE)
+                == "Roof_Tiled1.RGB");
+    }
+
+    findTexture = nullptr;
+    std::filesystem::remove(archivePath);
 }
 
-TEST_CASE("Test GSModel will close zip archive when destruct", "[CDBGSModels]")
+TEST_CASE("Test GSModel will release zip archive when destruct", "[CDBGSModels]")
 {
     std::filesystem::path CDBPath = dataPath / "GSModelsWithGTModelTexture";
     std::filesystem::path input = CDBPath / "Tiles" / "N32" / "W118" / "100_GSFeature" / "L00" / "U0"
@@ -140,30 +243,23 @@ TEST_CASE("Test GSModel will close zip archive when destruct", "[CDBGSModels]")
     std::filesystem::path GSModelZip = CDBPath / (modelTile.getRelativePath().string() + ".zip");
     REQUIRE(std::filesystem::exists(GSModelZip));
 
-    osgDB::ReaderWriter *rw = osgDB::Registry::instance()->getReaderWriterForExtension("zip");
-    REQUIRE(rw != nullptr);
-
     // set relative path for GSModel
     osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
     options->setObjectCacheHint(osgDB::Options::CACHE_NONE);
     options->getDatabasePathList().push_front(GSModelZip.parent_path());
 
     // read GSModel geometry
-    osgDB::ReaderWriter::ReadResult GSModelRead = rw->openArchive(GSModelZip, osgDB::Archive::READ);
-    REQUIRE(GSModelRead.validArchive());
-
-    osg::ref_ptr<osgDB::Archive> archive = GSModelRead.takeArchive();
-
-    // The function getFileNames will return true if archive is opened
-    std::vector<std::string> fileNames;
-    REQUIRE(archive->getFileNames(fileNames) == true);
+    auto archive = std::make_shared<const ZipArchive>(GSModelZip);
+    std::weak_ptr<const ZipArchive> weakArchive = archive;
+    REQUIRE(archive->getEntryNames().size() == 8);
 
     {
-        auto models = CDBGSModels(std::move(modelsAttributes), modelTile, archive, options);
+        auto models = CDBGSModels(std::move(modelsAttributes), modelTile, std::move(archive), options);
+        REQUIRE(!weakArchive.expired());
     }
 
-    // This function will return false if archive is closed;
-    REQUIRE(archive->getFileNames(fileNames) == false);
+    // the archive is unmapped once the last model holding it is gone
+    REQUIRE(weakArchive.expired());
 }
 
 TEST_CASE("Test converting GSModel to tileset.json", "[CDBGSModels]")
@@ -201,3 +297,189 @@ TEST_CASE("Test converting GSModel to tileset.json", "[CDBGSModels]")
     // remove the test output
     std::filesystem::remove_all(output);
 }
+
+TEST_CASE("Test converting instanced GSModel with implicit tiling", "[CDBGSModels]")
+{
+    std::filesystem::path CDBPath = dataPath / "GSModelsWithGTModelTexture";
+    std::filesystem::path output = "GSModelsImplicitInstancing";
+    Converter converter(CDBPath, output);
+    converter.setImplicitTiling(true);
+    converter.setGSModelInstancing(true);
+    converter.convert();
+
+    // only some tiles have repeated models, but every tile is a composite to match the content template
+    std::filesystem::path tilesetPath = output / "Tiles" / "N32" / "W118" / "GSModels" / "1_1";
+    std::ifstream fs(tilesetPath / "N32W118_D300_S001_T001.json");
+    auto implicitRoot = nlohmann::json::parse(fs)["root"];
+    while (!implicitRoot.contains("implicitTiling")) {
+        REQUIRE(implicitRoot["children"].size() == 1);
+        implicitRoot = implicitRoot["children"][0];
+    }
+
+    REQUIRE(implicitRoot["content"]["uri"] == "Content/{level}/{x}/{y}.cmpt");
+    REQUIRE(std::filesystem::exists(tilesetPath / "Content" / "0" / "0" / "0.cmpt"));
+    REQUIRE(std::filesystem::exists(tilesetPath / "Content" / "1" / "1" / "1.cmpt"));
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(tilesetPath / "Content")) {
+        if (entry.is_regular_file()) {
+            REQUIRE(entry.path().extension() == ".cmpt");
+        }
+    }
+
+    std::filesystem::remove_all(output);
+}
+
+TEST_CASE("Test converting GSModel with texture size limits", "[CDBGSModels]")
+{
+    std::filesystem::path CDBPath = dataPath / "GSModelsWithGSModelTexture";
+    std::filesystem::path output = "GSModelsWithGSModelTextureLimits";
+
+    auto readOutputTextures = [&]() {
+        std::vector<osg::ref_ptr<osg::Image>> textures;
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(output)) {
+            if (entry.is_regular_file() && entry.path().parent_path().filename() == "Textures") {
+                auto texture = osgDB::readRefImageFile(entry.path().string());
+                REQUIRE(texture);
+                textures.emplace_back(texture);
+            }
+        }
+
+        return textures;
+    };
+
+    SECTION("Test textures are resampled to the maximum size")
+    {
+        Converter converter(CDBPath, output);
+        converter.setModelTextureMaxSize(4);
+        converter.convert();
+
+        auto textures = readOutputTextures();
+        REQUIRE(!textures.empty());
+        for (const auto &texture : textures) {
+            REQUIRE(texture->s() <= 4);
+            REQUIRE(texture->t() <= 4);
+        }
+    }
+
+    SECTION("Test textures are halved to fit the byte budget")
+    {
+        Converter converter(CDBPath, output);
+        converter.setModelTextureByteBudget(1024);
+        converter.convert();
+
+        auto textures = readOutputTextures();
+        REQUIRE(!textures.empty());
+        for (const auto &texture : textures) {
+            REQUIRE(static_cast<size_t>(texture->s()) * static_cast<size_t>(texture->t())
+                        * texture->getPixelSizeInBits() / 8
+                    <= 1024);
+        }
+    }
+
+    std::filesystem::remove_all(output);
+}
+
+static std::vector<std::string> readTileImageURIs(const std::filesystem::path &tilePath)
+{
+    std::ifstream fs(tilePath, std::ios::binary);
+    std::string tile((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+
+    // b3dm, i3dm and every inner tile of a cmpt embed a GLB, whose first chunk is the glTF JSON
+    std::vector<std::string> URIs;
+    for (size_t glbOffset = tile.find("glTF"); glbOffset != std::string::npos;
+         glbOffset = tile.find("glTF", glbOffset + 4)) {
+        if (glbOffset + 20 > tile.size() || tile.compare(glbOffset + 16, 4, "JSON") != 0) {
+            continue;
+        }
+
+        uint32_t jsonLength;
+        std::memcpy(&jsonLength, tile.data() + glbOffset + 12, sizeof(uint32_t));
+        auto gltf = nlohmann::json::parse(tile.substr(glbOffset + 20, jsonLength));
+        for (const auto &image : gltf.value("images", nlohmann::json::array())) {
+            if (image.contains("uri")) {
+                URIs.emplace_back(image["uri"].get<std::string>());
+            }
+        }
+    }
+
+    return URIs;
+}
+
+TEST_CASE("Test converting GT and GS models sharing resampled textures", "[CDBGSModels]")
+{
+    // GT and GS models of one database, with every model texture holding the same image
+    std::filesystem::path CDBPath = "ModelsSharingTextures";
+    std::filesystem::path output = "ModelsSharingTexturesOutput";
+    std::filesystem::remove_all(CDBPath);
+    std::filesystem::copy(dataPath / "GTModels", CDBPath, std::filesystem::copy_options::recursive);
+    std::filesystem::copy(dataPath / "GSModelsWithGTModelTexture",
+                          CDBPath,
+                          std::filesystem::copy_options::recursive
+                              | std::filesystem::copy_options::skip_existing);
+
+    std::filesystem::path sharedTexture = dataPath / "GTModels" / "GTModel" / "501_GTModelTexture" / "T" / "R"
+                                          / "tree" / "D501_S001_T001_W00_tree.rgb";
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(CDBPath / "GTModel")) {
+        if (entry.is_regular_file() && entry.path().extension() == ".rgb") {
+            std::filesystem::copy_file(sharedTexture,
+                                       entry.path(),
+                                       std::filesystem::copy_options::overwrite_existing);
+        }
+    }
+
+    Converter converter(CDBPath, output);
+    converter.setModelTextureMaxSize(4);
+    converter.convert();
+
+    // every tileset directory keeps its own resampled textures
+    size_t imageURICount = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(output)) {
+        auto extension = entry.path().extension();
+        if (extension != ".b3dm" && extension != ".i3dm" && extension != ".cmpt") {
+            continue;
+        }
+
+        for (const auto &URI : readTileImageURIs(entry.path())) {
+            REQUIRE(URI.find("..") == std::string::npos);
+            REQUIRE(std::filesystem::exists(entry.path().parent_path() / URI));
+            ++imageURICount;
+        }
+    }
+
+    REQUIRE(imageURICount > 0);
+    REQUIRE(std::filesystem::exists(output / "Tiles" / "N32" / "W118" / "GTModels"));
+    REQUIRE(std::filesystem::exists(output / "Tiles" / "N32" / "W118" / "GSModels"));
+
+    std::filesystem::remove_all(output);
+    std::filesystem::remove_all(CDBPath);
+}
+
+TEST_CASE("Test converting GSModel skips tiles with a damaged archive", "[CDBGSModels]")
+{
+    std::filesystem::path CDBPath = "GSModelsWithDamagedArchive";
+    std::filesystem::path output = "GSModelsWithDamagedArchiveOutput";
+    std::filesystem::remove_all(CDBPath);
+    std::filesystem::copy(dataPath / "GSModelsWithGTModelTexture",
+                          CDBPath,
+                          std::filesystem::copy_options::recursive);
+
+    std::filesystem::path GSModelGeometryInput = CDBPath / "Tiles" / "N32" / "W118" / "300_GSModelGeometry";
+    std::filesystem::path damagedZip = GSModelGeometryInput / "L01" / "U1"
+                                       / "N32W118_D300_S001_T001_L01_U1_R1.zip";
+    {
+        std::ofstream fs(damagedZip, std::ios::binary | std::ios::trunc);
+        fs << "not a zip archive";
+    }
+
+    Converter converter(CDBPath, output);
+    REQUIRE_NOTHROW(converter.convert());
+
+    // the damaged tile is left out while the other tiles are still converted
+    std::filesystem::path tilesetPath = output / "Tiles" / "N32" / "W118" / "GSModels" / "1_1";
+    REQUIRE(std::filesystem::exists(tilesetPath / "N32W118_D300_S001_T001.json"));
+    REQUIRE(std::filesystem::exists(tilesetPath / "N32W118_D300_S001_T001_L00_U0_R0.b3dm"));
+    REQUIRE(std::filesystem::exists(tilesetPath / "N32W118_D300_S001_T001_LC01_U0_R0.b3dm"));
+    REQUIRE(!std::filesystem::exists(tilesetPath / "N32W118_D300_S001_T001_L01_U1_R1.b3dm"));
+
+    std::filesystem::remove_all(output);
+    std::filesystem::remove_all(CDBPath);
+}
@@ -158,3 +158,92 @@ TEST_CASE("Test CDBGTModels conversion to tileset.json", "[CDBGTModels]")
 
     std::filesystem::remove_all(output);
 }
+
+TEST_CASE("Test GT model cache", "[CDBGTModels]")
+{
+    CDBGTModelCache cache(dataPath / "GTModels");
+    REQUIRE(cache.getIndexedModelCount() == 3);
+
+    SECTION("Test locating an existing model")
+    {
+        std::string modelKey;
+        auto model = cache.locateModel3D("EC030", "coniferous_tree01", 12, modelKey);
+        REQUIRE(model != nullptr);
+        REQUIRE(modelKey == "D500_S001_T001_EC030_012_coniferous_tree01");
+        REQUIRE(cache.getMissCount() == 1);
+        REQUIRE(cache.getHitCount() == 0);
+
+        // the model is loaded only once
+        REQUIRE(cache.locateModel3D("EC030", "coniferous_tree01", 12, modelKey) == model);
+        REQUIRE(cache.getMissCount() == 1);
+        REQUIRE(cache.getHitCount() == 1);
+    }
+
+    SECTION("Test locating a missing model")
+    {
+        std::string modelKey;
+        REQUIRE(cache.locateModel3D("EC030", "missing_tree", 12, modelKey) == nullptr);
+        REQUIRE(cache.getMissCount() == 1);
+        REQUIRE(cache.getHitCount() == 0);
+
+        // the miss is remembered
+        REQUIRE(cache.locateModel3D("EC030", "missing_tree", 12, modelKey) == nullptr);
+        REQUIRE(cache.getMissCount() == 1);
+        REQUIRE(cache.getHitCount() == 1);
+    }
+
+    SECTION("Test prefetching models in parallel")
+    {
+        std::vector<std::string> FACCs{"EC030", "EC030", "EC030", "EC030"};
+        std::vector<std::string> MODLs{
+            "coniferous_tree01", "palm_tree01", "coniferous_tree01", "missing_tree"};
+        std::vector<int> FSCs{12, 17, 12, 12};
+
+        ThreadPool threadPool(4);
+        cache.prefetchModel3Ds(FACCs, MODLs, FSCs, threadPool);
+        REQUIRE(cache.getMissCount() == 3);
+        REQUIRE(cache.getHitCount() == 0);
+
+        // prefetched models and misses are answered from memory
+        std::string modelKey;
+        auto coniferous = cache.locateModel3D("EC030", "coniferous_tree01", 12, modelKey);
+        REQUIRE(coniferous != nullptr);
+        REQUIRE(cache.locateModel3D("EC030", "palm_tree01", 17, modelKey) != nullptr);
+        REQUIRE(cache.locateModel3D("EC030", "missing_tree", 12, modelKey) == nullptr);
+        REQUIRE(cache.getMissCount() == 3);
+        REQUIRE(cache.getHitCount() == 3);
+
+        // concurrent lookups share the same model
+        std::vector<const CDBModel3DResult *> models(16);
+        for (size_t i = 0; i < models.size(); ++i) {
+            threadPool.enqueue([&cache, &models, i]() {
+                std::string key;
+                models[i] = cache.locateModel3D("EC030", "coniferous_tree01", 12, key);
+            });
+        }
+        threadPool.wait();
+
+        for (auto model : models) {
+            REQUIRE(model == coniferous);
+        }
+        REQUIRE(cache.getMissCount() == 3);
+    }
+
+    SECTION("Test indexing a CDB without GT models")
+    {
+        CDBGTModelCache emptyCache(dataPath / "RoadNetwork");
+        REQUIRE(emptyCache.getIndexedModelCount() == 0);
+    }
+}
+
+TEST_CASE("Test GT model instance radius reaches the farthest corner", "[CDBGTModels]")
+{
+    // neither corner is the farthest point of a box that isn't symmetric around the origin
+    AABB aabb(glm::dvec3(-3.0, -1.0, -2.0), glm::dvec3(1.0, 4.0, 0.5));
+    REQUIRE(aabb.farthestCornerDistance() == Approx(std::sqrt(29.0)));
+    REQUIRE(aabb.farthestCornerDistance() > glm::length(aabb.min));
+    REQUIRE(aabb.farthestCornerDistance() > glm::length(aabb.max));
+
+    // every axis is scaled on its own, and a mirrored axis bounds the same distance
+    REQUIRE(aabb.farthestCornerDistance(glm::dvec3(2.0, 1.0, -1.0)) == Approx(std::sqrt(56.0)));
+}
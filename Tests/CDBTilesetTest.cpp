@@ -1,5 +1,9 @@
 #include "CDBTileset.h"
+#include "TileFormatIO.h"
 #include "catch2/catch.hpp"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <cstring>
 
 using namespace CDBTo3DTiles;
 using namespace Core;
@@ -140,3 +144,366 @@ TEST_CASE("Test get fit tile", "[CDBTileset]")
         REQUIRE(fitTile == nullptr);
     }
 }
+
+static bool isBitAvailable(const nlohmann::json &availability,
+                           const std::vector<uint8_t> &binary,
+                           const nlohmann::json &bufferViews,
+                           size_t bit)
+{
+    if (availability.contains("constant")) {
+        return availability["constant"] == 1;
+    }
+
+    size_t byteOffset = bufferViews[availability["bitstream"].get<size_t>()]["byteOffset"];
+    return (binary[byteOffset + bit / 8] >> (bit % 8)) & 1;
+}
+
+TEST_CASE("Test writing implicit tileset", "[CDBTileset]")
+{
+    CDBGeoCell geoCell(32, -118);
+    CDBTileset tileset;
+    std::vector<CDBTile> tiles{CDBTile(geoCell, CDBDataset::Elevation, 1, 1, -10, 0, 0),
+                               CDBTile(geoCell, CDBDataset::Elevation, 1, 1, 0, 0, 0),
+                               CDBTile(geoCell, CDBDataset::Elevation, 1, 1, 1, 1, 0),
+                               CDBTile(geoCell, CDBDataset::Elevation, 1, 1, 2, 2, 1)};
+    for (auto &tile : tiles) {
+        tile.setCustomContentURI(getImplicitTilingContentURI(tile, ".b3dm"));
+        REQUIRE(tileset.insertTile(tile) != nullptr);
+    }
+
+    REQUIRE(getImplicitTilingContentURI(tiles[0], ".b3dm") == "N32W118_D001_S001_T001_LC10_U0_R0.b3dm");
+    REQUIRE(getImplicitTilingContentURI(tiles[3], ".b3dm") == std::filesystem::path("Content/2/1/2.b3dm"));
+
+    std::stringstream ss;
+    std::map<std::filesystem::path, TileWriter> subtrees;
+    writeToImplicitTilesetJson(tileset, true, 2, ss, subtrees);
+
+    // negative levels are explicit tiles above the implicit root
+    auto tilesetJson = nlohmann::json::parse(ss.str());
+    REQUIRE(tilesetJson["asset"]["version"] == "1.1");
+    REQUIRE(tilesetJson["root"]["refine"] == "REPLACE");
+    REQUIRE(tilesetJson["root"]["content"]["uri"] == "N32W118_D001_S001_T001_LC10_U0_R0.b3dm");
+
+    auto implicitRoot = tilesetJson["root"];
+    for (int level = -10; level < 0; ++level) {
+        REQUIRE(implicitRoot["children"].size() == 1);
+        implicitRoot = implicitRoot["children"][0];
+    }
+
+    REQUIRE(implicitRoot["content"]["uri"] == "Content/{level}/{x}/{y}.b3dm");
+    REQUIRE(implicitRoot["implicitTiling"]["subdivisionScheme"] == "QUADTREE");
+    REQUIRE(implicitRoot["implicitTiling"]["subtreeLevels"] == 2);
+    REQUIRE(implicitRoot["implicitTiling"]["availableLevels"] == 3);
+    REQUIRE(implicitRoot["implicitTiling"]["subtrees"]["uri"] == "Subtrees/{level}/{x}/{y}.subtree");
+    REQUIRE(!implicitRoot.contains("children"));
+
+    // level 2 starts a new subtree. Bits are in Morton order within each level
+    REQUIRE(subtrees.size() == 2);
+    std::vector<std::pair<std::filesystem::path, std::vector<size_t>>> expectedSubtrees{
+        {"Subtrees/0/0/0.subtree", {0, 3}}, {"Subtrees/2/1/2.subtree", {0}}};
+    for (const auto &expectedSubtree : expectedSubtrees) {
+        auto subtree = subtrees.at(expectedSubtree.first).toBuffer();
+
+        SubtreeHeader header;
+        std::memcpy(&header, subtree.data(), sizeof(header));
+        REQUIRE(std::string(header.magic, 4) == "subt");
+        REQUIRE(header.version == 1);
+        REQUIRE(header.jsonByteLength % 8 == 0);
+        REQUIRE(subtree.size() == sizeof(header) + header.jsonByteLength + header.binaryByteLength);
+
+        auto jsonBegin = subtree.begin() + sizeof(header);
+        auto json = nlohmann::json::parse(jsonBegin, jsonBegin + static_cast<long>(header.jsonByteLength));
+        std::vector<uint8_t> binary(jsonBegin + static_cast<long>(header.jsonByteLength), subtree.end());
+
+        const auto &availableBits = expectedSubtree.second;
+        for (size_t bit = 0; bit < 5; ++bit) {
+            bool isAvailable = std::find(availableBits.begin(), availableBits.end(), bit)
+                               != availableBits.end();
+            REQUIRE(isBitAvailable(json["tileAvailability"], binary, json["bufferViews"], bit)
+                    == isAvailable);
+            REQUIRE(isBitAvailable(json["contentAvailability"][0], binary, json["bufferViews"], bit)
+                    == isAvailable);
+        }
+
+        for (size_t bit = 0; bit < 16; ++bit) {
+            bool isAvailable = expectedSubtree.first == "Subtrees/0/0/0.subtree" && bit == 9;
+            REQUIRE(isBitAvailable(json["childSubtreeAvailability"], binary, json["bufferViews"], bit)
+                    == isAvailable);
+        }
+    }
+}
+
+TEST_CASE("Test implicit tileset rejects mixed content formats", "[CDBTileset]")
+{
+    // the content URI template can only point at one format
+    CDBGeoCell geoCell(32, -118);
+    CDBTileset tileset;
+    CDBTile parent(geoCell, CDBDataset::GSModelGeometry, 1, 1, 0, 0, 0);
+    CDBTile child(geoCell, CDBDataset::GSModelGeometry, 1, 1, 1, 1, 1);
+    parent.setCustomContentURI(getImplicitTilingContentURI(parent, ".b3dm"));
+    child.setCustomContentURI(getImplicitTilingContentURI(child, ".cmpt"));
+    REQUIRE(tileset.insertTile(parent) != nullptr);
+    REQUIRE(tileset.insertTile(child) != nullptr);
+
+    std::stringstream ss;
+    std::map<std::filesystem::path, TileWriter> subtrees;
+    REQUIRE_THROWS_AS(writeToImplicitTilesetJson(tileset, true, 2, ss, subtrees), std::invalid_argument);
+}
+
+static CDBTileset createTilesetWithLevels(std::vector<CDBTile> &tiles)
+{
+    CDBGeoCell geoCell(32, -118);
+    tiles.emplace_back(geoCell, CDBDataset::Elevation, 1, 1, -10, 0, 0);
+    tiles.emplace_back(geoCell, CDBDataset::Elevation, 1, 1, 0, 0, 0);
+    for (int UREF = 0; UREF < 2; ++UREF) {
+        for (int RREF = 0; RREF < 2; ++RREF) {
+            tiles.emplace_back(geoCell, CDBDataset::Elevation, 1, 1, 1, UREF, RREF);
+            for (int i = 0; i < 4; ++i) {
+                tiles.emplace_back(
+                    geoCell, CDBDataset::Elevation, 1, 1, 2, UREF * 2 + i / 2, RREF * 2 + i % 2);
+            }
+        }
+    }
+
+    CDBTileset tileset;
+    for (auto &tile : tiles) {
+        tile.setCustomContentURI(tile.getRelativePath().filename().string() + ".b3dm");
+        REQUIRE(tileset.insertTile(tile) != nullptr);
+    }
+
+    return tileset;
+}
+
+static nlohmann::json getFirstDescendant(const nlohmann::json &tile, int levelCount)
+{
+    auto descendant = tile;
+    for (int level = 0; level < levelCount; ++level) {
+        descendant = descendant["children"][0];
+    }
+
+    return descendant;
+}
+
+static size_t countTilesWithContent(const nlohmann::json &tile, const std::string &extension)
+{
+    size_t count = 0;
+    if (tile.contains("content")) {
+        std::string uri = tile["content"]["uri"];
+        count += uri.size() >= extension.size()
+                 && uri.compare(uri.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    if (tile.contains("children")) {
+        for (const auto &child : tile["children"]) {
+            count += countTilesWithContent(child, extension);
+        }
+    }
+
+    return count;
+}
+
+TEST_CASE("Test writing tileset JSON", "[CDBTileset]")
+{
+    std::vector<CDBTile> tiles;
+    CDBTileset tileset = createTilesetWithLevels(tiles);
+
+    SECTION("Test streaming the whole tileset")
+    {
+        std::stringstream ss;
+        writeToTilesetJson(tileset, true, ss);
+
+        auto tilesetJson = nlohmann::json::parse(ss.str());
+        REQUIRE(tilesetJson["asset"]["version"] == "1.0");
+        REQUIRE(tilesetJson["geometricError"] == Approx(300000.0f));
+        REQUIRE(tilesetJson["root"]["refine"] == "REPLACE");
+        REQUIRE(tilesetJson["root"]["geometricError"] == Approx(300000.0f));
+        REQUIRE(tilesetJson["root"]["content"]["uri"] == "N32W118_D001_S001_T001_LC10_U0_R0.b3dm");
+        REQUIRE(countTilesWithContent(tilesetJson["root"], ".b3dm") == tiles.size());
+
+        const auto &rectangle = tiles.front().getBoundRegion().getRectangle();
+        const auto &region = tilesetJson["root"]["boundingVolume"]["region"];
+        REQUIRE(region[0] == Approx(rectangle.getWest()));
+        REQUIRE(region[1] == Approx(rectangle.getSouth()));
+        REQUIRE(region[2] == Approx(rectangle.getEast()));
+        REQUIRE(region[3] == Approx(rectangle.getNorth()));
+
+        // leaves have no geometric error and no children
+        auto levelZero = getFirstDescendant(tilesetJson["root"], 10);
+        auto leaf = getFirstDescendant(levelZero, 2);
+        REQUIRE(levelZero["content"]["uri"] == "N32W118_D001_S001_T001_L00_U0_R0.b3dm");
+        REQUIRE(levelZero["geometricError"] == Approx(300000.0f / 1024.0f));
+        REQUIRE(leaf["geometricError"] == 0);
+        REQUIRE(!leaf.contains("children"));
+        REQUIRE(!leaf.contains("refine"));
+    }
+
+    SECTION("Test tiles replacing their children")
+    {
+        CDBTileset replaceTileset;
+        for (auto tile : tiles) {
+            tile.setReplaceRefinement(tile.getLevel() == 1 && tile.getUREF() == 0 && tile.getRREF() == 0);
+            REQUIRE(replaceTileset.insertTile(tile) != nullptr);
+        }
+
+        std::stringstream ss;
+        writeToTilesetJson(replaceTileset, false, ss);
+
+        // only the tiles that differ from their parent state their refinement
+        auto tilesetJson = nlohmann::json::parse(ss.str());
+        auto levelZero = getFirstDescendant(tilesetJson["root"], 10);
+        auto levelOne = levelZero["children"][0];
+        REQUIRE(tilesetJson["root"]["refine"] == "ADD");
+        REQUIRE(!levelZero.contains("refine"));
+        REQUIRE(levelOne["refine"] == "REPLACE");
+        REQUIRE(levelOne["children"][0]["refine"] == "ADD");
+        REQUIRE(!levelZero["children"][1].contains("refine"));
+    }
+
+    SECTION("Test splitting at a level")
+    {
+        TilesetJsonSplit split;
+        split.externalTilesetLevel = 1;
+
+        std::stringstream ss;
+        std::map<std::filesystem::path, std::string> externalTilesets;
+        writeToTilesetJson(tileset, false, split, ss, externalTilesets);
+
+        auto tilesetJson = nlohmann::json::parse(ss.str());
+        REQUIRE(tilesetJson["root"]["refine"] == "ADD");
+        REQUIRE(countTilesWithContent(tilesetJson["root"], ".b3dm") == 2);
+        REQUIRE(countTilesWithContent(tilesetJson["root"], ".json") == 4);
+        REQUIRE(externalTilesets.size() == 4);
+
+        auto levelOne = getFirstDescendant(tilesetJson["root"], 11);
+        REQUIRE(levelOne["content"]["uri"] == "N32W118_D001_S001_T001_L01_U0_R0.json");
+        REQUIRE(levelOne["geometricError"] == Approx(300000.0f / 2048.0f));
+        REQUIRE(!levelOne.contains("children"));
+
+        auto externalJson = nlohmann::json::parse(
+            externalTilesets.at("N32W118_D001_S001_T001_L01_U0_R0.json"));
+        REQUIRE(externalJson["asset"]["version"] == "1.0");
+        REQUIRE(externalJson["geometricError"] == Approx(300000.0f / 2048.0f));
+        REQUIRE(externalJson["root"]["refine"] == "ADD");
+        REQUIRE(externalJson["root"]["boundingVolume"] == levelOne["boundingVolume"]);
+        REQUIRE(externalJson["root"]["content"]["uri"] == "N32W118_D001_S001_T001_L01_U0_R0.b3dm");
+        REQUIRE(countTilesWithContent(externalJson["root"], ".b3dm") == 5);
+    }
+
+    SECTION("Test splitting by size")
+    {
+        std::stringstream whole;
+        writeToTilesetJson(tileset, true, whole);
+
+        TilesetJsonSplit split;
+        split.maxTilesetByteLength = whole.str().size() / 2;
+
+        std::stringstream ss;
+        std::map<std::filesystem::path, std::string> externalTilesets;
+        writeToTilesetJson(tileset, true, split, ss, externalTilesets);
+        REQUIRE(!externalTilesets.empty());
+        REQUIRE(ss.str().size() <= split.maxTilesetByteLength);
+
+        // every tile and every external tileset is still reachable exactly once
+        auto tilesetJson = nlohmann::json::parse(ss.str());
+        size_t tileCount = countTilesWithContent(tilesetJson["root"], ".b3dm");
+        size_t externalTilesetCount = countTilesWithContent(tilesetJson["root"], ".json");
+        for (const auto &externalTileset : externalTilesets) {
+            REQUIRE(externalTileset.second.size() <= split.maxTilesetByteLength);
+            auto externalJson = nlohmann::json::parse(externalTileset.second);
+            REQUIRE(externalJson["root"]["refine"] == "REPLACE");
+            tileCount += countTilesWithContent(externalJson["root"], ".b3dm");
+            externalTilesetCount += countTilesWithContent(externalJson["root"], ".json");
+        }
+
+        REQUIRE(tileCount == tiles.size());
+        REQUIRE(externalTilesetCount == externalTilesets.size());
+    }
+
+    SECTION("Test splitting within the size budget writes the same tileset")
+    {
+        std::stringstream whole;
+        writeToTilesetJson(tileset, true, whole);
+
+        TilesetJsonSplit split;
+        split.maxTilesetByteLength = whole.str().size() + 1024;
+
+        std::stringstream ss;
+        std::map<std::filesystem::path, std::string> externalTilesets;
+        writeToTilesetJson(tileset, true, split, ss, externalTilesets);
+        REQUIRE(externalTilesets.empty());
+        REQUIRE(ss.str() == whole.str());
+    }
+}
+
+TEST_CASE("Test propagating content heights", "[CDBTileset]")
+{
+    CDBGeoCell geoCell(32, -118);
+    CDBTile parent(geoCell, CDBDataset::Elevation, 1, 1, 0, 0, 0);
+    CDBTile child(geoCell, CDBDataset::Elevation, 1, 1, 1, 0, 0);
+    CDBTile grandChild(geoCell, CDBDataset::Elevation, 1, 1, 2, 1, 1);
+    REQUIRE(!parent.hasContentHeights());
+
+    // the first range replaces the flat region and the next ones grow it
+    child.includeContentHeights(100.0, 200.0);
+    child.includeContentHeights(150.0, 300.0);
+    REQUIRE(child.hasContentHeights());
+    REQUIRE(child.getBoundRegion().getMinimumHeight() == Approx(100.0));
+    REQUIRE(child.getBoundRegion().getMaximumHeight() == Approx(300.0));
+
+    grandChild.includeContentHeights(-50.0, 120.0);
+
+    CDBTileset tileset;
+    REQUIRE(tileset.insertTile(parent) != nullptr);
+    REQUIRE(tileset.insertTile(child) != nullptr);
+    REQUIRE(tileset.insertTile(grandChild) != nullptr);
+    tileset.propagateContentHeights();
+
+    // ancestors bound the heights of all of their descendants
+    const CDBTile *tile = tileset.getRoot();
+    while (tile->getLevel() < 1) {
+        REQUIRE(tile->hasContentHeights());
+        REQUIRE(tile->getBoundRegion().getMinimumHeight() == Approx(-50.0));
+        REQUIRE(tile->getBoundRegion().getMaximumHeight() == Approx(300.0));
+        tile = tile->getChildren().front();
+    }
+
+    REQUIRE(tile->getBoundRegion().getMinimumHeight() == Approx(-50.0));
+    REQUIRE(tile->getBoundRegion().getMaximumHeight() == Approx(300.0));
+
+    std::stringstream ss;
+    writeToTilesetJson(tileset, true, ss);
+    auto tilesetJson = nlohmann::json::parse(ss.str());
+    REQUIRE(tilesetJson["root"]["boundingVolume"]["region"][4] == Approx(-50.0));
+    REQUIRE(tilesetJson["root"]["boundingVolume"]["region"][5] == Approx(300.0));
+}
+
+TEST_CASE("Test propagating geometric errors", "[CDBTileset]")
+{
+    CDBGeoCell geoCell(32, -118);
+    CDBTile parent(geoCell, CDBDataset::GSFeature, 1, 1, 0, 0, 0);
+    CDBTile child(geoCell, CDBDataset::GSFeature, 1, 1, 1, 0, 0);
+    CDBTile grandChild(geoCell, CDBDataset::GSFeature, 1, 1, 2, 1, 1);
+    parent.setGeometricError(20.0);
+    child.setGeometricError(40.0);
+    grandChild.setGeometricError(5.0);
+
+    CDBTileset tileset;
+    REQUIRE(tileset.insertTile(parent) != nullptr);
+    REQUIRE(tileset.insertTile(child) != nullptr);
+    REQUIRE(tileset.insertTile(grandChild) != nullptr);
+    tileset.propagateGeometricErrors();
+
+    // errors never grow when refining and leaves are rendered at full detail
+    std::stringstream ss;
+    writeToTilesetJson(tileset, false, ss);
+    auto tilesetJson = nlohmann::json::parse(ss.str());
+    REQUIRE(tilesetJson["geometricError"] == Approx(40.0));
+    REQUIRE(tilesetJson["root"]["geometricError"] == Approx(40.0));
+
+    auto levelZero = getFirstDescendant(tilesetJson["root"], 10);
+    auto levelOne = getFirstDescendant(levelZero, 1);
+    auto levelTwo = getFirstDescendant(levelOne, 1);
+    REQUIRE(levelZero["geometricError"] == Approx(40.0));
+    REQUIRE(levelOne["geometricError"] == Approx(40.0));
+    REQUIRE(levelTwo["geometricError"] == 0);
+}
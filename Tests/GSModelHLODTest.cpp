@@ -0,0 +1,198 @@
+#include "CDBTo3DTiles.h"
+#include "Config.h"
+#include "GSModelHLOD.h"
+#include "catch2/catch.hpp"
+#include "nlohmann/json.hpp"
+#include <cmath>
+#include <fstream>
+
+using namespace CDBTo3DTiles;
+
+static GSModelHLODContent createTriangleContent(const std::vector<Material> &materials,
+                                                const std::vector<std::string> &textureURIs,
+                                                const std::vector<int> &meshMaterials,
+                                                double geometricError)
+{
+    GSModelHLODContent content{};
+    content.materials = materials;
+    content.geometricError = geometricError;
+    for (const auto &uri : textureURIs) {
+        Texture texture;
+        texture.uri = uri;
+        content.textures.emplace_back(texture);
+        content.images.emplace_back(new osg::Image());
+    }
+
+    for (auto material : meshMaterials) {
+        Mesh mesh;
+        mesh.material = material;
+        mesh.indices = {0, 1, 2};
+        mesh.positions = {glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0), glm::dvec3(0.0, 1.0, 0.0)};
+        mesh.UVs = {glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f)};
+        mesh.normals = std::vector<glm::vec3>(3, glm::vec3(0.0f, 0.0f, 1.0f));
+        content.meshes.emplace_back(std::move(mesh));
+    }
+
+    return content;
+}
+
+TEST_CASE("Test merging GS model HLOD content of two children", "[GSModelHLOD]")
+{
+    Material roof;
+    roof.texture = 0;
+    Material wall;
+    wall.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+    Material otherRoof;
+    otherRoof.texture = 1;
+
+    // the second child lists the shared roof texture after a texture of its own
+    auto first = createTriangleContent({roof}, {"roof.png"}, {0}, 1.0);
+    auto second = createTriangleContent({wall, otherRoof}, {"wall.png", "roof.png"}, {0, 1, 1}, 2.0);
+
+    GSModelHLODContent parent{};
+    mergeGSModelHLODContent(first, parent);
+    mergeGSModelHLODContent(second, parent);
+
+    // textures with the same URI and identical materials are shared, and meshes are merged per material
+    REQUIRE(parent.textures.size() == 2);
+    REQUIRE(parent.images.size() == 2);
+    REQUIRE(parent.textures[0].uri == "roof.png");
+    REQUIRE(parent.textures[1].uri == "wall.png");
+    REQUIRE(parent.materials.size() == 2);
+    REQUIRE(parent.materials[0].texture == 0);
+    REQUIRE(parent.materials[1].texture == -1);
+    REQUIRE(parent.materials[1].diffuse == glm::vec3(0.5f, 0.5f, 0.5f));
+    REQUIRE(parent.geometricError == Approx(2.0));
+
+    REQUIRE(parent.meshes.size() == 2);
+    const auto &roofMesh = parent.meshes[0];
+    REQUIRE(roofMesh.material == 0);
+    REQUIRE(roofMesh.positions.size() == 9);
+    REQUIRE(roofMesh.UVs.size() == 9);
+    REQUIRE(roofMesh.normals.empty());
+    REQUIRE(roofMesh.indices == std::vector<uint32_t>{0, 1, 2, 3, 4, 5, 6, 7, 8});
+
+    // untextured meshes don't carry texture coordinates
+    const auto &wallMesh = parent.meshes[1];
+    REQUIRE(wallMesh.material == 1);
+    REQUIRE(wallMesh.positions.size() == 3);
+    REQUIRE(wallMesh.UVs.empty());
+    REQUIRE(wallMesh.indices == std::vector<uint32_t>{0, 1, 2});
+}
+
+TEST_CASE("Test simplifying GS model HLOD meshes", "[GSModelHLOD]")
+{
+    // a gently curved grid, so that simplification has to trade triangles against error
+    static const uint32_t GRID_SIZE = 32;
+    Mesh mesh;
+    mesh.material = 0;
+    for (uint32_t y = 0; y <= GRID_SIZE; ++y) {
+        for (uint32_t x = 0; x <= GRID_SIZE; ++x) {
+            double u = static_cast<double>(x) / GRID_SIZE;
+            double v = static_cast<double>(y) / GRID_SIZE;
+            mesh.positions.emplace_back(100.0 * u, 100.0 * v, 5.0 * std::sin(3.0 * u) * std::cos(2.0 * v));
+        }
+    }
+
+    for (uint32_t y = 0; y < GRID_SIZE; ++y) {
+        for (uint32_t x = 0; x < GRID_SIZE; ++x) {
+            uint32_t corner = y * (GRID_SIZE + 1) + x;
+            mesh.indices.insert(mesh.indices.end(),
+                                {corner, corner + 1, corner + GRID_SIZE + 2, corner, corner + GRID_SIZE + 2,
+                                 corner + GRID_SIZE + 1});
+        }
+    }
+
+    GSModelHLODContent content{};
+    content.materials.emplace_back(Material());
+    content.meshes.emplace_back(mesh);
+    content.geometricError = 1.0;
+
+    static const float TARGET_ERROR = 0.02f;
+    simplifyGSModelHLODMeshes(content, 0.25f, TARGET_ERROR);
+
+    // the error is relative to the largest extent of the mesh, and accumulates over the levels
+    REQUIRE(content.meshes.size() == 1);
+    const auto &simplified = content.meshes.front();
+    REQUIRE(!simplified.indices.empty());
+    REQUIRE(simplified.indices.size() < mesh.indices.size());
+    REQUIRE(simplified.indices.size() % 3 == 0);
+    REQUIRE(simplified.positions.size() < mesh.positions.size());
+    REQUIRE(content.geometricError >= 1.0);
+    REQUIRE(content.geometricError <= 1.0 + static_cast<double>(TARGET_ERROR) * 100.0 + 1e-6);
+}
+
+static void collectReplacedTiles(const nlohmann::json &tile,
+                                 const std::string &parentRefine,
+                                 int depth,
+                                 std::vector<std::pair<nlohmann::json, int>> &replacedTiles)
+{
+    std::string refine = tile.value("refine", parentRefine);
+    if (refine == "REPLACE") {
+        replacedTiles.emplace_back(tile, depth);
+    }
+
+    if (tile.contains("children")) {
+        for (const auto &child : tile["children"]) {
+            collectReplacedTiles(child, refine, depth + 1, replacedTiles);
+        }
+    }
+}
+
+TEST_CASE("Test converting GS models with HLOD parent tiles", "[GSModelHLOD]")
+{
+    std::filesystem::path CDBPath = dataPath / "GSModelsWithGTModelTexture";
+    std::filesystem::path output = "GSModelsHLOD";
+    std::filesystem::path tilesetPath = output / "Tiles" / "N32" / "W118" / "GSModels" / "1_1";
+
+    SECTION("Test generated tiles have content and the geometric error of their depth")
+    {
+        Converter converter(CDBPath, output);
+        converter.setGSModelHLODLevel(-10);
+        converter.convert();
+
+        std::ifstream fs(tilesetPath / "N32W118_D300_S001_T001.json");
+        auto tilesetJson = nlohmann::json::parse(fs);
+
+        // generated tiles replace their children, while tiles with models of their own stay additive
+        std::vector<std::pair<nlohmann::json, int>> replacedTiles;
+        collectReplacedTiles(tilesetJson["root"], "ADD", 0, replacedTiles);
+        REQUIRE(!replacedTiles.empty());
+        for (const auto &replacedTile : replacedTiles) {
+            const auto &tile = replacedTile.first;
+            auto uri = tile["content"]["uri"].get<std::string>();
+            REQUIRE(std::filesystem::path(uri).extension() == ".b3dm");
+            REQUIRE(std::filesystem::exists(tilesetPath / uri));
+            REQUIRE(tile["geometricError"].get<double>()
+                    == Approx(300000.0 / std::pow(2.0, replacedTile.second)));
+        }
+    }
+
+    SECTION("Test generated tiles measure the error of their simplified content")
+    {
+        Converter converter(CDBPath, output);
+        converter.setGSModelHLODLevel(-10);
+        converter.setMeasuredGeometricError(true);
+        converter.convert();
+
+        std::ifstream fs(tilesetPath / "N32W118_D300_S001_T001.json");
+        auto tilesetJson = nlohmann::json::parse(fs);
+
+        // a parent never has less error than the children it stands for
+        std::vector<std::pair<nlohmann::json, int>> replacedTiles;
+        collectReplacedTiles(tilesetJson["root"], "ADD", 0, replacedTiles);
+        REQUIRE(!replacedTiles.empty());
+        for (const auto &replacedTile : replacedTiles) {
+            const auto &tile = replacedTile.first;
+            REQUIRE(std::filesystem::exists(tilesetPath / tile["content"]["uri"].get<std::string>()));
+
+            double geometricError = tile["geometricError"];
+            REQUIRE(geometricError > 0.0);
+            for (const auto &child : tile["children"]) {
+                REQUIRE(geometricError >= child["geometricError"].get<double>());
+            }
+        }
+    }
+
+    std::filesystem::remove_all(output);
+}
@@ -1,5 +1,9 @@
+#include "GlbWriter.h"
 #include "Gltf.h"
 #include "catch2/catch.hpp"
+#include "meshoptimizer.h"
+#include "nlohmann/json.hpp"
+#include <type_traits>
 
 using namespace CDBTo3DTiles;
 
@@ -18,6 +22,56 @@ static Mesh createTriangleMesh()
     return mesh;
 }
 
+static Mesh createTriangleMeshRelativeToCenter()
+{
+    Mesh mesh = createTriangleMesh();
+    for (size_t i = 0; i < mesh.positions.size(); ++i) {
+        mesh.positionRTCs[i] = static_cast<glm::vec3>(mesh.positions[i] - mesh.aabb->center());
+    }
+
+    return mesh;
+}
+
+static Mesh createGridMesh(size_t gridSize)
+{
+    Mesh mesh;
+    mesh.aabb = AABB();
+    for (size_t y = 0; y < gridSize; ++y) {
+        for (size_t x = 0; x < gridSize; ++x) {
+            glm::dvec3 position(static_cast<double>(x), static_cast<double>(y), 0.0);
+            mesh.aabb->merge(position);
+            mesh.positions.emplace_back(position);
+            mesh.positionRTCs.emplace_back(static_cast<glm::vec3>(position));
+            mesh.normals.emplace_back(glm::vec3(0.0f, 0.0f, 1.0f));
+        }
+    }
+
+    for (size_t y = 0; y + 1 < gridSize; ++y) {
+        for (size_t x = 0; x + 1 < gridSize; ++x) {
+            uint32_t topLeft = static_cast<uint32_t>(y * gridSize + x);
+            uint32_t bottomLeft = static_cast<uint32_t>((y + 1) * gridSize + x);
+            mesh.indices.insert(mesh.indices.end(), {topLeft, bottomLeft, topLeft + 1});
+            mesh.indices.insert(mesh.indices.end(), {topLeft + 1, bottomLeft, bottomLeft + 1});
+        }
+    }
+
+    return mesh;
+}
+
+static nlohmann::json readGlbJson(const std::vector<uint8_t> &glb, std::vector<uint8_t> &bin)
+{
+    uint32_t jsonLength;
+    std::memcpy(&jsonLength, glb.data() + 12, sizeof(uint32_t));
+    const uint8_t *jsonBegin = glb.data() + 20;
+
+    uint32_t binLength;
+    std::memcpy(&binLength, jsonBegin + jsonLength, sizeof(uint32_t));
+    const uint8_t *binBegin = jsonBegin + jsonLength + 8;
+    bin.assign(binBegin, binBegin + binLength);
+
+    return nlohmann::json::parse(jsonBegin, jsonBegin + jsonLength);
+}
+
 static double calculateMaterialRoughness(const Material &material)
 {
     glm::vec3 specularColor = material.specular;
@@ -318,3 +372,619 @@ TEST_CASE("Test converting multiple meshes to gltf", "[Gltf]")
     const auto &modelImage = modelImages.front();
     REQUIRE(modelImage.uri == "textureURI");
 }
+
+TEST_CASE("Test quantizing normals", "[Gltf]")
+{
+    SECTION("Test 8 bits normals")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        GltfOptions options;
+        options.normalBits = 8;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        REQUIRE(model.extensionsUsed.front() == "KHR_mesh_quantization");
+        REQUIRE(model.extensionsRequired.front() == "KHR_mesh_quantization");
+
+        const auto &normalBufferView = model.bufferViews[1];
+        REQUIRE(normalBufferView.byteOffset == triangleMesh.positionRTCs.size() * sizeof(glm::vec3));
+        REQUIRE(normalBufferView.byteLength == triangleMesh.normals.size() * 4);
+        REQUIRE(normalBufferView.byteStride == 4);
+
+        const auto &normalAccessor = model.accessors[1];
+        REQUIRE(normalAccessor.count == triangleMesh.normals.size());
+        REQUIRE(normalAccessor.componentType == TINYGLTF_COMPONENT_TYPE_BYTE);
+        REQUIRE(normalAccessor.type == TINYGLTF_TYPE_VEC3);
+        REQUIRE(normalAccessor.normalized == true);
+
+        const auto &bufferData = model.buffers.front().data;
+        REQUIRE(bufferData.size() == normalBufferView.byteOffset + normalBufferView.byteLength);
+        for (size_t i = 0; i < triangleMesh.normals.size(); ++i) {
+            int8_t normal[4];
+            std::memcpy(normal, bufferData.data() + normalBufferView.byteOffset + i * 4, sizeof(normal));
+            REQUIRE(normal[0] == 0);
+            REQUIRE(normal[1] == 0);
+            REQUIRE(normal[2] == 127);
+        }
+    }
+
+    SECTION("Test 16 bits normals")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        GltfOptions options;
+        options.normalBits = 16;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        const auto &normalBufferView = model.bufferViews[1];
+        REQUIRE(normalBufferView.byteLength == triangleMesh.normals.size() * 8);
+        REQUIRE(normalBufferView.byteStride == 8);
+
+        const auto &normalAccessor = model.accessors[1];
+        REQUIRE(normalAccessor.componentType == TINYGLTF_COMPONENT_TYPE_SHORT);
+        REQUIRE(normalAccessor.normalized == true);
+
+        const auto &bufferData = model.buffers.front().data;
+        for (size_t i = 0; i < triangleMesh.normals.size(); ++i) {
+            int16_t normal[4];
+            std::memcpy(normal, bufferData.data() + normalBufferView.byteOffset + i * 8, sizeof(normal));
+            REQUIRE(normal[0] == 0);
+            REQUIRE(normal[1] == 0);
+            REQUIRE(normal[2] == 32767);
+        }
+    }
+
+    SECTION("Test invalid quantization bits")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        GltfOptions options;
+        options.normalBits = 12;
+        REQUIRE_THROWS_AS(createGltf(triangleMesh, nullptr, nullptr, options), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Test quantizing positions and UVs", "[Gltf]")
+{
+    SECTION("Test 16 bits positions")
+    {
+        Mesh triangleMesh = createTriangleMeshRelativeToCenter();
+        GltfOptions options;
+        options.positionBits = 16;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        REQUIRE(model.extensionsRequired.front() == "KHR_mesh_quantization");
+
+        const auto &positionBufferView = model.bufferViews[0];
+        REQUIRE(positionBufferView.byteLength == triangleMesh.positionRTCs.size() * 8);
+        REQUIRE(positionBufferView.byteStride == 8);
+
+        const auto &positionAccessor = model.accessors[0];
+        REQUIRE(positionAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+        REQUIRE(positionAccessor.normalized == false);
+        REQUIRE(positionAccessor.minValues == std::vector<double>{0.0, 0.0, 0.0});
+        REQUIRE(positionAccessor.maxValues[0] == 65535.0);
+        REQUIRE(positionAccessor.maxValues[2] == 0.0);
+
+        // the mesh node restores the original positions
+        const auto &meshNode = model.nodes[1];
+        double scale = 1.0 / 65535.0;
+        REQUIRE(meshNode.scale == std::vector<double>{scale, scale, scale});
+        REQUIRE(meshNode.translation[0] == Approx(-0.5));
+        REQUIRE(meshNode.translation[1] == Approx(0.0));
+        REQUIRE(meshNode.translation[2] == Approx(0.0));
+
+        const auto &bufferData = model.buffers.front().data;
+        for (size_t i = 0; i < triangleMesh.positions.size(); ++i) {
+            uint16_t position[4];
+            std::memcpy(position, bufferData.data() + i * 8, sizeof(position));
+            glm::dvec3 restored = glm::dvec3(position[0], position[1], position[2]) * scale
+                                  + glm::dvec3(-0.5, 0.0, 0.0);
+            REQUIRE(restored.x == Approx(triangleMesh.positions[i].x).margin(scale));
+            REQUIRE(restored.y == Approx(triangleMesh.positions[i].y).margin(scale));
+            REQUIRE(restored.z == Approx(triangleMesh.positions[i].z).margin(scale));
+        }
+    }
+
+    SECTION("Test 8 bits positions")
+    {
+        Mesh triangleMesh = createTriangleMeshRelativeToCenter();
+        GltfOptions options;
+        options.positionBits = 8;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        const auto &positionBufferView = model.bufferViews[0];
+        REQUIRE(positionBufferView.byteLength == triangleMesh.positionRTCs.size() * 4);
+        REQUIRE(positionBufferView.byteStride == 4);
+
+        const auto &positionAccessor = model.accessors[0];
+        REQUIRE(positionAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE);
+        REQUIRE(positionAccessor.maxValues[0] == 255.0);
+    }
+
+    SECTION("Test UVs in unit range")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        triangleMesh.UVs = {glm::vec2(0.0f, 0.0f), glm::vec2(0.5f, 1.0f), glm::vec2(1.0f, 0.0f)};
+        GltfOptions options;
+        options.UVBits = 12;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        // texture coordinates don't need KHR_mesh_quantization
+        REQUIRE(model.extensionsRequired.empty());
+
+        const auto &UVBufferView = model.bufferViews[2];
+        REQUIRE(UVBufferView.byteLength == triangleMesh.UVs.size() * 4);
+
+        const auto &UVAccessor = model.accessors[2];
+        REQUIRE(UVAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+        REQUIRE(UVAccessor.normalized == true);
+
+        const auto &bufferData = model.buffers.front().data;
+        for (size_t i = 0; i < triangleMesh.UVs.size(); ++i) {
+            uint16_t UV[2];
+            std::memcpy(UV, bufferData.data() + UVBufferView.byteOffset + i * 4, sizeof(UV));
+            REQUIRE(UV[0] / 65535.0 == Approx(triangleMesh.UVs[i].x).margin(1.0 / 4095.0));
+            REQUIRE(UV[1] / 65535.0 == Approx(triangleMesh.UVs[i].y).margin(1.0 / 4095.0));
+        }
+    }
+
+    SECTION("Test UVs out of unit range are kept as float")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        triangleMesh.UVs = {glm::vec2(0.0f, 0.0f), glm::vec2(0.5f, 2.0f), glm::vec2(1.0f, 0.0f)};
+        GltfOptions options;
+        options.UVBits = 16;
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+
+        const auto &UVAccessor = model.accessors[2];
+        REQUIRE(UVAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+        REQUIRE(model.buffers.front().data.size() == model.bufferViews[2].byteOffset + 3 * sizeof(glm::vec2));
+    }
+}
+
+TEST_CASE("Test compressing glb with EXT_meshopt_compression", "[Gltf]")
+{
+    Mesh gridMesh = createGridMesh(32);
+
+    SECTION("Test no fallback")
+    {
+        GltfOptions options;
+        options.meshoptCompression = true;
+        options.meshoptFallback = MeshoptFallback::None;
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr, options);
+        std::vector<unsigned char> uncompressedData = model.buffers.front().data;
+
+        std::vector<uint8_t> bin;
+        std::vector<uint8_t> glb = createGlb(model, options);
+        nlohmann::json json = readGlbJson(glb, bin);
+        REQUIRE(json["extensionsRequired"][0] == "EXT_meshopt_compression");
+
+        // fallback buffer has no data
+        const auto &buffers = json["buffers"];
+        REQUIRE(buffers.size() == 2);
+        REQUIRE(buffers[0]["byteLength"].get<size_t>() <= bin.size());
+        REQUIRE(buffers[0]["byteLength"].get<size_t>() < uncompressedData.size());
+        REQUIRE(buffers[1]["byteLength"].get<size_t>() == uncompressedData.size());
+        REQUIRE(buffers[1]["extensions"]["EXT_meshopt_compression"]["fallback"] == true);
+
+        // decode each view and compare it with the uncompressed data
+        const auto &bufferViews = json["bufferViews"];
+        REQUIRE(bufferViews.size() == 3);
+        for (const auto &bufferView : bufferViews) {
+            REQUIRE(bufferView["buffer"] == 1);
+
+            const auto &extension = bufferView["extensions"]["EXT_meshopt_compression"];
+            size_t count = extension["count"].get<size_t>();
+            size_t byteStride = extension["byteStride"].get<size_t>();
+            const uint8_t *encoded = bin.data() + extension["byteOffset"].get<size_t>();
+            size_t encodedLength = extension["byteLength"].get<size_t>();
+
+            std::vector<uint8_t> decoded(count * byteStride);
+            if (extension["mode"] == "TRIANGLES") {
+                REQUIRE(meshopt_decodeIndexBuffer(decoded.data(), count, byteStride, encoded, encodedLength)
+                        == 0);
+            } else {
+                REQUIRE(extension["mode"] == "ATTRIBUTES");
+                REQUIRE(meshopt_decodeVertexBuffer(decoded.data(), count, byteStride, encoded, encodedLength)
+                        == 0);
+            }
+
+            size_t byteOffset = bufferView.value("byteOffset", size_t(0));
+            REQUIRE(std::equal(decoded.begin(), decoded.end(), uncompressedData.begin() + byteOffset));
+        }
+    }
+
+    SECTION("Test uncompressed fallback")
+    {
+        GltfOptions options;
+        options.meshoptCompression = true;
+        options.meshoptFallback = MeshoptFallback::Uncompressed;
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr, options);
+        std::vector<unsigned char> uncompressedData = model.buffers.front().data;
+
+        std::vector<uint8_t> bin;
+        std::vector<uint8_t> glb = createGlb(model, options);
+        nlohmann::json json = readGlbJson(glb, bin);
+        REQUIRE(json["extensionsUsed"][0] == "EXT_meshopt_compression");
+        REQUIRE(json.find("extensionsRequired") == json.end());
+
+        // uncompressed data stays at the beginning of the binary chunk
+        REQUIRE(json["buffers"].size() == 1);
+        REQUIRE(std::equal(uncompressedData.begin(), uncompressedData.end(), bin.begin()));
+        for (const auto &bufferView : json["bufferViews"]) {
+            REQUIRE(bufferView["buffer"] == 0);
+
+            const auto &extension = bufferView["extensions"]["EXT_meshopt_compression"];
+            REQUIRE(extension["buffer"] == 0);
+            REQUIRE(extension["byteOffset"].get<size_t>() >= uncompressedData.size());
+        }
+    }
+
+    SECTION("Test quantized normals use octahedral filter")
+    {
+        GltfOptions options;
+        options.normalBits = 8;
+        options.meshoptCompression = true;
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr, options);
+
+        std::vector<uint8_t> bin;
+        std::vector<uint8_t> glb = createGlb(model, options);
+        nlohmann::json json = readGlbJson(glb, bin);
+
+        int normalAccessor = json["meshes"][0]["primitives"][0]["attributes"]["NORMAL"].get<int>();
+        int normalBufferView = json["accessors"][normalAccessor]["bufferView"].get<int>();
+        const auto &normalExtensions = json["bufferViews"][normalBufferView]["extensions"];
+        const auto &extension = normalExtensions["EXT_meshopt_compression"];
+        REQUIRE(extension["filter"] == "OCTAHEDRAL");
+        REQUIRE(extension["byteStride"] == 4);
+    }
+
+    SECTION("Test model is unchanged when no buffer view gets smaller")
+    {
+        // a single triangle encodes to more bytes than it takes uncompressed
+        Mesh triangleMesh;
+        triangleMesh.positions = {glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0), glm::dvec3(0.0, 1.0, 0.0)};
+        triangleMesh.positionRTCs = {glm::vec3(0.0f),
+                                     glm::vec3(1.0f, 0.0f, 0.0f),
+                                     glm::vec3(0.0f, 1.0f, 0.0f)};
+        triangleMesh.indices = {0, 1, 2};
+        triangleMesh.aabb = AABB(glm::dvec3(0.0), glm::dvec3(1.0, 1.0, 0.0));
+
+        for (auto fallback : {MeshoptFallback::None, MeshoptFallback::Uncompressed}) {
+            GltfOptions options;
+            options.meshoptCompression = true;
+            options.meshoptFallback = fallback;
+            tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr, options);
+            REQUIRE(model.extensionsUsed.empty());
+            REQUIRE(model.extensionsRequired.empty());
+
+            auto bufferData = model.buffers.front().data;
+            std::vector<std::pair<size_t, size_t>> viewRanges;
+            for (const auto &bufferView : model.bufferViews) {
+                viewRanges.emplace_back(bufferView.byteOffset, bufferView.byteLength);
+            }
+
+            compressGltfWithMeshopt(model, options);
+            REQUIRE(model.extensionsUsed.empty());
+            REQUIRE(model.extensionsRequired.empty());
+            REQUIRE(model.buffers.size() == 1);
+            REQUIRE(model.buffers.front().data == bufferData);
+            REQUIRE(model.bufferViews.size() == viewRanges.size());
+            for (size_t i = 0; i < viewRanges.size(); ++i) {
+                const auto &bufferView = model.bufferViews[i];
+                REQUIRE(bufferView.buffer == 0);
+                REQUIRE(bufferView.byteOffset == viewRanges[i].first);
+                REQUIRE(bufferView.byteLength == viewRanges[i].second);
+                REQUIRE(bufferView.extensions.empty());
+            }
+        }
+    }
+}
+
+TEST_CASE("Test optimizing mesh", "[Gltf]")
+{
+    Mesh gridMesh = createGridMesh(16);
+    for (size_t i = 0; i < gridMesh.positions.size(); ++i) {
+        gridMesh.batchIDs.emplace_back(static_cast<float>(i));
+        const auto &position = gridMesh.positionRTCs[i];
+        gridMesh.UVs.emplace_back(glm::vec2(position.x / 15.0f, position.y / 15.0f));
+    }
+
+    // add a vertex that isn't referenced by any triangle, outside of the others
+    gridMesh.positions.emplace_back(glm::dvec3(100.0));
+    gridMesh.positionRTCs.emplace_back(glm::vec3(100.0f));
+    gridMesh.normals.emplace_back(glm::vec3(0.0f, 0.0f, 1.0f));
+    gridMesh.UVs.emplace_back(glm::vec2(0.0f));
+    gridMesh.batchIDs.emplace_back(-1.0f);
+    gridMesh.aabb->merge(glm::dvec3(100.0));
+
+    // triangles are compared by the unique batch ID of their vertices, rotated to keep the winding
+    auto collectTriangles = [](const Mesh &mesh) {
+        std::vector<std::array<float, 3>> triangles;
+        for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+            std::array<float, 3> triangle = {mesh.batchIDs[mesh.indices[i]],
+                                             mesh.batchIDs[mesh.indices[i + 1]],
+                                             mesh.batchIDs[mesh.indices[i + 2]]};
+            auto smallest = std::min_element(triangle.begin(), triangle.end());
+            std::rotate(triangle.begin(), smallest, triangle.end());
+            triangles.emplace_back(triangle);
+        }
+
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+
+    Mesh optimizedMesh = gridMesh;
+    optimizeMesh(optimizedMesh);
+
+    SECTION("Test unreferenced vertex is removed")
+    {
+        size_t vertexCount = gridMesh.positions.size() - 1;
+        REQUIRE(optimizedMesh.positions.size() == vertexCount);
+        REQUIRE(optimizedMesh.positionRTCs.size() == vertexCount);
+        REQUIRE(optimizedMesh.normals.size() == vertexCount);
+        REQUIRE(optimizedMesh.UVs.size() == vertexCount);
+        REQUIRE(optimizedMesh.batchIDs.size() == vertexCount);
+        REQUIRE(std::find(optimizedMesh.batchIDs.begin(), optimizedMesh.batchIDs.end(), -1.0f)
+                == optimizedMesh.batchIDs.end());
+
+        // the bounding box and the accessor bounds fit the remaining vertices
+        REQUIRE(optimizedMesh.aabb->min == glm::dvec3(0.0));
+        REQUIRE(optimizedMesh.aabb->max == glm::dvec3(15.0, 15.0, 0.0));
+
+        GltfOptions options;
+        options.optimizeMeshes = true;
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr, options);
+        const auto &primitive = model.meshes.front().primitives.front();
+        int positionAccessorIndex = primitive.attributes.at("POSITION");
+        const auto &positionAccessor = model.accessors[static_cast<size_t>(positionAccessorIndex)];
+        REQUIRE(positionAccessor.minValues == std::vector<double>{-7.5, -7.5, 0.0});
+        REQUIRE(positionAccessor.maxValues == std::vector<double>{7.5, 7.5, 0.0});
+        REQUIRE(model.nodes.back().translation == std::vector<double>{7.5, 7.5, 0.0});
+    }
+
+    SECTION("Test triangles and vertex attributes are preserved")
+    {
+        REQUIRE(optimizedMesh.indices.size() == gridMesh.indices.size());
+        REQUIRE(collectTriangles(optimizedMesh) == collectTriangles(gridMesh));
+
+        for (size_t i = 0; i < optimizedMesh.positions.size(); ++i) {
+            size_t original = static_cast<size_t>(optimizedMesh.batchIDs[i]);
+            REQUIRE(optimizedMesh.positions[i] == gridMesh.positions[original]);
+            REQUIRE(optimizedMesh.positionRTCs[i]
+                    == static_cast<glm::vec3>(gridMesh.positions[original] - optimizedMesh.aabb->center()));
+            REQUIRE(optimizedMesh.UVs[i] == gridMesh.UVs[original]);
+        }
+    }
+
+    SECTION("Test vertices are in fetch order")
+    {
+        uint32_t nextVertex = 0;
+        for (auto index : optimizedMesh.indices) {
+            REQUIRE(index <= nextVertex);
+            if (index == nextVertex) {
+                ++nextVertex;
+            }
+        }
+    }
+
+    SECTION("Test mismatched vertex attributes")
+    {
+        Mesh invalidMesh = gridMesh;
+        invalidMesh.normals.pop_back();
+        REQUIRE_THROWS_AS(optimizeMesh(invalidMesh), std::invalid_argument);
+    }
+
+    SECTION("Test createGltf with optimizeMeshes")
+    {
+        GltfOptions options;
+        options.optimizeMeshes = true;
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr, options);
+        const auto &primitive = model.meshes.front().primitives.front();
+        REQUIRE(model.accessors[static_cast<size_t>(primitive.attributes.at("POSITION"))].count
+                == optimizedMesh.positions.size());
+        REQUIRE(model.accessors[static_cast<size_t>(primitive.indices)].count
+                == optimizedMesh.indices.size());
+    }
+}
+
+TEST_CASE("Test index component type", "[Gltf]")
+{
+    SECTION("Test short indices are padded to 4 bytes")
+    {
+        Mesh triangleMesh = createTriangleMesh();
+        triangleMesh.indices = {0, 1, 2};
+        tinygltf::Model model = createGltf(triangleMesh, nullptr, nullptr);
+
+        const auto &primitive = model.meshes.front().primitives.front();
+        const auto &indicesAccessor = model.accessors[static_cast<size_t>(primitive.indices)];
+        REQUIRE(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+        REQUIRE(indicesAccessor.count == 3);
+
+        const auto &indicesBufferView = model.bufferViews[static_cast<size_t>(indicesAccessor.bufferView)];
+        REQUIRE(indicesBufferView.byteOffset == 0);
+        REQUIRE(indicesBufferView.byteLength == 3 * sizeof(uint16_t));
+
+        int positionAccessorIndex = primitive.attributes.at("POSITION");
+        const auto &positionAccessor = model.accessors[static_cast<size_t>(positionAccessorIndex)];
+        const auto &positionBufferView = model.bufferViews[static_cast<size_t>(positionAccessor.bufferView)];
+        REQUIRE(positionBufferView.byteOffset == 8);
+
+        const auto &bufferData = model.buffers.front().data;
+        for (size_t i = 0; i < triangleMesh.indices.size(); ++i) {
+            uint16_t index;
+            std::memcpy(&index, bufferData.data() + i * sizeof(uint16_t), sizeof(uint16_t));
+            REQUIRE(index == triangleMesh.indices[i]);
+        }
+    }
+
+    SECTION("Test large mesh is split into primitives with short indices")
+    {
+        Mesh gridMesh = createGridMesh(300);
+        for (size_t i = 0; i < gridMesh.positions.size(); ++i) {
+            gridMesh.batchIDs.emplace_back(static_cast<float>(i));
+        }
+
+        tinygltf::Model model = createGltf(gridMesh, nullptr, nullptr);
+        REQUIRE(model.meshes.size() == 1);
+
+        const auto &primitives = model.meshes.front().primitives;
+        REQUIRE(primitives.size() == 2);
+
+        // every primitive must reference the same vertices as the original triangles
+        const auto &bufferData = model.buffers.front().data;
+        size_t indexCount = 0;
+        for (const auto &primitive : primitives) {
+            const auto &indicesAccessor = model.accessors[static_cast<size_t>(primitive.indices)];
+            const auto &indicesView = model.bufferViews[static_cast<size_t>(indicesAccessor.bufferView)];
+            REQUIRE(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+
+            int batchIDAccessorIndex = primitive.attributes.at("_BATCHID");
+            const auto &batchIDAccessor = model.accessors[static_cast<size_t>(batchIDAccessorIndex)];
+            const auto &batchIDView = model.bufferViews[static_cast<size_t>(batchIDAccessor.bufferView)];
+            REQUIRE(batchIDAccessor.count <= 65535);
+            REQUIRE(batchIDView.byteOffset % 4 == 0);
+
+            for (size_t i = 0; i < indicesAccessor.count; ++i) {
+                uint16_t index;
+                std::memcpy(&index,
+                            bufferData.data() + indicesView.byteOffset + i * sizeof(uint16_t),
+                            sizeof(uint16_t));
+                REQUIRE(index < batchIDAccessor.count);
+
+                float batchID;
+                std::memcpy(&batchID,
+                            bufferData.data() + batchIDView.byteOffset + index * sizeof(float),
+                            sizeof(float));
+                REQUIRE(static_cast<uint32_t>(batchID) == gridMesh.indices[indexCount + i]);
+            }
+
+            indexCount += indicesAccessor.count;
+        }
+
+        REQUIRE(indexCount == gridMesh.indices.size());
+    }
+
+    SECTION("Test large mesh keeps unsigned int indices when splitting duplicates too many vertices")
+    {
+        // every triangle strip pass goes through all the vertices, so each primitive would need most of them
+        size_t vertexCount = 70000;
+        Mesh mesh;
+        for (size_t i = 0; i < vertexCount; ++i) {
+            mesh.positions.emplace_back(glm::dvec3(static_cast<double>(i), 0.0, 0.0));
+            mesh.positionRTCs.emplace_back(glm::vec3(static_cast<float>(i), 0.0f, 0.0f));
+        }
+
+        for (size_t pass = 0; pass < 4; ++pass) {
+            for (size_t i = 0; i < vertexCount; ++i) {
+                mesh.indices.emplace_back(static_cast<uint32_t>(i));
+                mesh.indices.emplace_back(static_cast<uint32_t>((i + 1) % vertexCount));
+                mesh.indices.emplace_back(static_cast<uint32_t>((i + 2) % vertexCount));
+            }
+        }
+
+        tinygltf::Model model = createGltf(mesh, nullptr, nullptr);
+        const auto &primitives = model.meshes.front().primitives;
+        REQUIRE(primitives.size() == 1);
+
+        const auto &indicesAccessor = model.accessors[static_cast<size_t>(primitives.front().indices)];
+        REQUIRE(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+        REQUIRE(indicesAccessor.count == mesh.indices.size());
+    }
+}
+
+TEST_CASE("Test writing glb", "[Gltf]")
+{
+    Mesh triangleMesh = createTriangleMesh();
+    triangleMesh.indices = {0, 1, 2};
+    triangleMesh.material = 0;
+
+    Material material;
+    material.texture = 0;
+    material.unlit = true;
+
+    Texture texture;
+    texture.uri = "Textures/texture \"0\".png";
+
+    tinygltf::Model model = createGltf(triangleMesh, &material, &texture);
+    GlbWriter writer(model);
+
+    SECTION("Test segments point to the model buffer")
+    {
+        const auto &bufferData = model.buffers.front().data;
+        const auto &segments = writer.getSegments();
+        size_t byteLength = 0;
+        bool isBufferReferenced = false;
+        for (const auto &segment : segments) {
+            byteLength += segment.byteLength;
+            if (segment.data == bufferData.data()) {
+                REQUIRE(segment.byteLength == bufferData.size());
+                isBufferReferenced = true;
+            }
+        }
+
+        REQUIRE(isBufferReferenced);
+        REQUIRE(byteLength == writer.getByteLength());
+        REQUIRE(writer.getByteLength() % 4 == 0);
+    }
+
+    SECTION("Test glb content")
+    {
+        std::vector<uint8_t> glb(writer.getByteLength());
+        writer.write(glb.data());
+
+        uint32_t glbLength;
+        std::memcpy(&glbLength, glb.data() + 8, sizeof(uint32_t));
+        REQUIRE(std::string(glb.begin(), glb.begin() + 4) == "glTF");
+        REQUIRE(glbLength == glb.size());
+
+        std::vector<uint8_t> bin;
+        nlohmann::json json = readGlbJson(glb, bin);
+        const auto &bufferData = model.buffers.front().data;
+        REQUIRE(std::equal(bufferData.begin(), bufferData.end(), bin.begin()));
+        REQUIRE(json["asset"]["version"] == "2.0");
+        REQUIRE(json["extensionsUsed"][0] == "KHR_materials_unlit");
+        REQUIRE(json["scenes"][0]["nodes"][0] == 0);
+        REQUIRE(json["nodes"].size() == 2);
+        REQUIRE(json["nodes"][0]["children"][0] == 1);
+        REQUIRE(json["nodes"][1]["mesh"] == 0);
+        REQUIRE(json["images"][0]["uri"] == texture.uri);
+        REQUIRE(json["textures"][0]["source"] == 0);
+        REQUIRE(json["materials"][0]["pbrMetallicRoughness"]["baseColorTexture"]["index"] == 0);
+        REQUIRE(json["materials"][0]["extensions"]["KHR_materials_unlit"].is_object());
+        REQUIRE(json["buffers"][0]["byteLength"] == bufferData.size());
+
+        const auto &primitive = json["meshes"][0]["primitives"][0];
+        REQUIRE(primitive["mode"] == TINYGLTF_MODE_TRIANGLES);
+        REQUIRE(primitive["material"] == 0);
+
+        const auto &indicesAccessor = json["accessors"][primitive["indices"].get<size_t>()];
+        REQUIRE(indicesAccessor["componentType"] == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+        REQUIRE(indicesAccessor["type"] == "SCALAR");
+        REQUIRE(indicesAccessor["count"] == 3);
+
+        const auto &positionAccessor = json["accessors"][primitive["attributes"]["POSITION"].get<size_t>()];
+        REQUIRE(positionAccessor["type"] == "VEC3");
+        REQUIRE(positionAccessor["min"].size() == 3);
+        REQUIRE(positionAccessor["max"].size() == 3);
+    }
+
+    SECTION("Test writing to stream and buffer gives the same glb")
+    {
+        std::vector<uint8_t> glb(writer.getByteLength());
+        writer.write(glb.data());
+
+        std::stringstream ss;
+        writer.write(ss);
+        std::string streamString = ss.str();
+        std::vector<uint8_t> streamGlb(streamString.begin(), streamString.end());
+        REQUIRE(streamGlb == glb);
+        REQUIRE(createGlb(model) == glb);
+    }
+
+    SECTION("Test writer can't be copied or moved away from its segments")
+    {
+        REQUIRE(!std::is_copy_constructible<GlbWriter>::value);
+        REQUIRE(!std::is_move_constructible<GlbWriter>::value);
+        REQUIRE(!std::is_copy_assignable<GlbWriter>::value);
+        REQUIRE(!std::is_move_assignable<GlbWriter>::value);
+    }
+}
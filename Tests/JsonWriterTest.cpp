@@ -0,0 +1,77 @@
+#include "JsonWriter.h"
+#include "catch2/catch.hpp"
+#include "nlohmann/json.hpp"
+
+using namespace CDBTo3DTiles;
+
+TEST_CASE("Test writing json", "[JsonWriter]")
+{
+    std::string output;
+    JsonWriter writer(output);
+
+    SECTION("Test nested objects and arrays")
+    {
+        writer.startObject();
+        writer.property("name", std::string("tile \"0\"\n\\"));
+        writer.property("count", size_t(3));
+        writer.property("negative", -1);
+        writer.property("flag", false);
+        writer.key("nothing");
+        writer.null();
+        writer.arrayProperty("values", std::vector<double>{0.1, 1.0, -2.5e-10});
+        writer.key("children");
+        writer.startArray();
+        writer.startObject();
+        writer.endObject();
+        writer.startArray();
+        writer.endArray();
+        writer.endArray();
+        writer.endObject();
+
+        REQUIRE(output.substr(0, 9) == "{\"name\":\"");
+
+        nlohmann::json json = nlohmann::json::parse(output);
+        REQUIRE(json["name"] == "tile \"0\"\n\\");
+        REQUIRE(json["count"] == 3);
+        REQUIRE(json["negative"] == -1);
+        REQUIRE(json["flag"] == false);
+        REQUIRE(json["nothing"].is_null());
+        REQUIRE(json["values"][0].get<double>() == 0.1);
+        REQUIRE(json["values"][1].get<double>() == 1.0);
+        REQUIRE(json["values"][2].get<double>() == -2.5e-10);
+        REQUIRE(json["children"].size() == 2);
+        REQUIRE(json["children"][0].is_object());
+        REQUIRE(json["children"][1].is_array());
+    }
+
+    SECTION("Test numbers round trip with shortest representation")
+    {
+        writer.startArray();
+        writer.value(0.1);
+        writer.value(1.0 / 3.0);
+        writer.value(std::numeric_limits<double>::infinity());
+        writer.endArray();
+
+        REQUIRE(output.substr(0, 5) == "[0.1,");
+
+        nlohmann::json json = nlohmann::json::parse(output);
+        REQUIRE(json[1].get<double>() == 1.0 / 3.0);
+        REQUIRE(json[2].is_null());
+    }
+
+    SECTION("Test writing serialized values")
+    {
+        writer.startArray();
+        writer.rawValue("{\"a\":1}");
+        writer.rawValue("[]");
+        writer.endArray();
+
+        REQUIRE(output == "[{\"a\":1},[]]");
+    }
+
+    SECTION("Test control characters are escaped")
+    {
+        writer.value(std::string("\x01\t"));
+        REQUIRE(output == "\"\\u0001\\t\"");
+    }
+}
@@ -0,0 +1,185 @@
+#include "ModelDiskCache.h"
+#include "catch2/catch.hpp"
+#include <cstring>
+#include <fstream>
+
+using namespace CDBTo3DTiles;
+
+static CDBModel3DResult createModel3D()
+{
+    Mesh mesh;
+    mesh.material = 0;
+    mesh.primitiveType = PrimitiveType::Triangles;
+    mesh.aabb = AABB(glm::dvec3(0.0), glm::dvec3(1.0));
+    mesh.indices = {0, 1, 2};
+    mesh.positions = {glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0), glm::dvec3(1.0)};
+    mesh.positionRTCs = {glm::vec3(-0.5f), glm::vec3(0.5f, -0.5f, -0.5f), glm::vec3(0.5f)};
+    mesh.UVs = {glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f)};
+    mesh.normals = {glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f)};
+    mesh.batchIDs = {2.0f, 2.0f, 2.0f};
+
+    Material material;
+    material.texture = 0;
+    material.diffuse = glm::vec3(0.5f, 0.25f, 1.0f);
+    material.doubleSided = true;
+
+    Texture texture;
+    texture.uri = "texture.png";
+    texture.minFilter = TextureFilter::LINEAR_MIPMAP_LINEAR;
+    texture.magFilter = TextureFilter::NEAREST;
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(2, 2, 1, GL_RGB, GL_UNSIGNED_BYTE);
+    image->setFileName("texture.rgb");
+    for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i) {
+        image->data()[i] = static_cast<unsigned char>(i);
+    }
+
+    CDBModel3DResult model3D;
+    model3D.setContent({mesh}, {material}, {texture}, {image});
+    return model3D;
+}
+
+TEST_CASE("Test model disk cache round trip", "[ModelDiskCache]")
+{
+    std::filesystem::path cacheDirectory = "ModelDiskCache";
+    std::filesystem::remove_all(cacheDirectory);
+
+    SECTION("Test stored records are loaded back")
+    {
+        ModelDiskCache cache(cacheDirectory);
+        REQUIRE(std::filesystem::is_directory(cacheDirectory));
+        REQUIRE(cache.load("model") == std::nullopt);
+
+        auto model3D = createModel3D();
+        cache.store("model",
+                    {ModelDiskCacheRecord::create("merged", model3D, {1, 3}),
+                     ModelDiskCacheRecord::create("instanced", CDBModel3DResult(), {0, 2})});
+
+        auto records = cache.load("model");
+        REQUIRE(records);
+        REQUIRE(records->size() == 2);
+
+        const auto &merged = records->front();
+        REQUIRE(merged.name == "merged");
+        REQUIRE(merged.instances == std::vector<int>{1, 3});
+        REQUIRE(merged.meshes.size() == 1);
+
+        const auto &mesh = merged.meshes.front();
+        const auto &expectedMesh = model3D.getMeshes().front();
+        REQUIRE(mesh.primitiveType == PrimitiveType::Triangles);
+        REQUIRE(mesh.aabb->min == expectedMesh.aabb->min);
+        REQUIRE(mesh.aabb->max == expectedMesh.aabb->max);
+        REQUIRE(mesh.indices == expectedMesh.indices);
+        REQUIRE(mesh.positions == expectedMesh.positions);
+        REQUIRE(mesh.positionRTCs == expectedMesh.positionRTCs);
+        REQUIRE(mesh.UVs == expectedMesh.UVs);
+        REQUIRE(mesh.normals == expectedMesh.normals);
+        REQUIRE(mesh.batchIDs == expectedMesh.batchIDs);
+
+        REQUIRE(merged.materials.size() == 1);
+        REQUIRE(merged.materials.front().diffuse == glm::vec3(0.5f, 0.25f, 1.0f));
+        REQUIRE(merged.materials.front().doubleSided);
+
+        REQUIRE(merged.textures.size() == 1);
+        REQUIRE(merged.textures.front().uri == "texture.png");
+        REQUIRE(merged.textures.front().minFilter == TextureFilter::LINEAR_MIPMAP_LINEAR);
+        REQUIRE(merged.textures.front().magFilter == TextureFilter::NEAREST);
+
+        REQUIRE(merged.images.size() == 1);
+        const auto &image = merged.images.front();
+        const auto &expectedImage = model3D.getImages().front();
+        REQUIRE(image->getFileName() == "texture.rgb");
+        REQUIRE(image->s() == 2);
+        REQUIRE(image->t() == 2);
+        REQUIRE(image->getPixelFormat() == static_cast<GLenum>(GL_RGB));
+        REQUIRE(image->getTotalSizeInBytes() == expectedImage->getTotalSizeInBytes());
+        REQUIRE(std::memcmp(image->data(), expectedImage->data(), image->getTotalSizeInBytes()) == 0);
+
+        const auto &instanced = records->back();
+        REQUIRE(instanced.name == "instanced");
+        REQUIRE(instanced.instances == std::vector<int>{0, 2});
+        REQUIRE(instanced.meshes.empty());
+        REQUIRE(instanced.images.empty());
+    }
+
+    SECTION("Test stored entries are replaced")
+    {
+        ModelDiskCache cache(cacheDirectory);
+        cache.store("model", {ModelDiskCacheRecord::create("first", CDBModel3DResult())});
+        cache.store("model", {ModelDiskCacheRecord::create("second", CDBModel3DResult())});
+
+        auto records = cache.load("model");
+        REQUIRE(records);
+        REQUIRE(records->size() == 1);
+        REQUIRE(records->front().name == "second");
+        REQUIRE(cache.load("other model") == std::nullopt);
+    }
+
+    SECTION("Test damaged entries are reported as missing")
+    {
+        ModelDiskCache cache(cacheDirectory);
+        cache.store("model", {ModelDiskCacheRecord::create("merged", createModel3D())});
+
+        auto entries = std::filesystem::directory_iterator(cacheDirectory);
+        std::filesystem::path entryPath = entries->path();
+        std::filesystem::resize_file(entryPath, std::filesystem::file_size(entryPath) / 2);
+        REQUIRE(cache.load("model") == std::nullopt);
+
+        {
+            std::ofstream fs(entryPath, std::ios::binary | std::ios::trunc);
+            fs << "not a model";
+        }
+
+        REQUIRE(cache.load("model") == std::nullopt);
+    }
+
+    SECTION("Test entries that cannot be written are skipped")
+    {
+        ModelDiskCache cache(cacheDirectory);
+        std::filesystem::permissions(cacheDirectory,
+                                     std::filesystem::perms::owner_write
+                                         | std::filesystem::perms::group_write
+                                         | std::filesystem::perms::others_write,
+                                     std::filesystem::perm_options::remove);
+
+        // the permissions don't apply to a privileged user, in which case the entry is simply stored
+        bool isReadOnly = !std::ofstream(cacheDirectory / "probe");
+        std::filesystem::remove(cacheDirectory / "probe");
+
+        REQUIRE_NOTHROW(cache.store("model", {ModelDiskCacheRecord::create("merged", createModel3D())}));
+        if (isReadOnly) {
+            REQUIRE(cache.load("model") == std::nullopt);
+            REQUIRE(std::filesystem::is_empty(cacheDirectory));
+        } else {
+            REQUIRE(cache.load("model"));
+        }
+
+        std::filesystem::permissions(cacheDirectory,
+                                     std::filesystem::perms::owner_write,
+                                     std::filesystem::perm_options::add);
+    }
+
+    std::filesystem::remove_all(cacheDirectory);
+}
+
+TEST_CASE("Test model disk cache source key", "[ModelDiskCache]")
+{
+    std::filesystem::path sourcePath = "ModelDiskCacheSource.flt";
+    {
+        std::ofstream fs(sourcePath, std::ios::binary);
+        fs << "model";
+    }
+
+    std::string key = ModelDiskCache::createSourceKey(sourcePath);
+    REQUIRE(key == ModelDiskCache::createSourceKey(std::filesystem::absolute(sourcePath)));
+
+    {
+        std::ofstream fs(sourcePath, std::ios::binary | std::ios::app);
+        fs << " changed";
+    }
+
+    REQUIRE(key != ModelDiskCache::createSourceKey(sourcePath));
+
+    std::filesystem::remove(sourcePath);
+}
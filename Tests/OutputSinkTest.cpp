@@ -0,0 +1,418 @@
+#include "CDBTo3DTiles.h"
+#include "Config.h"
+#include "MD5.h"
+#include "OutputSink.h"
+#include "ZipArchive.h"
+#include "catch2/catch.hpp"
+#include "nlohmann/json.hpp"
+#include "zlib.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+using namespace CDBTo3DTiles;
+
+template<typename T>
+static T readLittleEndian(const std::vector<uint8_t> &buffer, size_t offset)
+{
+    T value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    return value;
+}
+
+static std::vector<uint8_t> readFile(const std::filesystem::path &path)
+{
+    std::ifstream fs(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+}
+
+static std::map<std::string, std::vector<uint8_t>> readStoredZip(const std::vector<uint8_t> &zip)
+{
+    // end of central directory record is the last 22 bytes when there is no comment
+    size_t endOffset = zip.size() - 22;
+    REQUIRE(readLittleEndian<uint32_t>(zip, endOffset) == 0x06054b50);
+    uint16_t entriesCount = readLittleEndian<uint16_t>(zip, endOffset + 10);
+    uint32_t centralDirectoryOffset = readLittleEndian<uint32_t>(zip, endOffset + 16);
+
+    std::map<std::string, std::vector<uint8_t>> files;
+    size_t offset = centralDirectoryOffset;
+    for (uint16_t i = 0; i < entriesCount; ++i) {
+        REQUIRE(readLittleEndian<uint32_t>(zip, offset) == 0x02014b50);
+        REQUIRE(readLittleEndian<uint16_t>(zip, offset + 10) == 0);
+        uint32_t byteLength = readLittleEndian<uint32_t>(zip, offset + 24);
+        uint16_t nameLength = readLittleEndian<uint16_t>(zip, offset + 28);
+        uint16_t extraLength = readLittleEndian<uint16_t>(zip, offset + 30);
+        uint32_t localHeaderOffset = readLittleEndian<uint32_t>(zip, offset + 42);
+        std::string name(zip.begin() + static_cast<long>(offset + 46),
+                         zip.begin() + static_cast<long>(offset + 46 + nameLength));
+
+        REQUIRE(readLittleEndian<uint32_t>(zip, localHeaderOffset) == 0x04034b50);
+        uint16_t localNameLength = readLittleEndian<uint16_t>(zip, localHeaderOffset + 26);
+        uint16_t localExtraLength = readLittleEndian<uint16_t>(zip, localHeaderOffset + 28);
+        size_t dataOffset = localHeaderOffset + 30 + localNameLength + localExtraLength;
+        files[name] = std::vector<uint8_t>(zip.begin() + static_cast<long>(dataOffset),
+                                           zip.begin() + static_cast<long>(dataOffset + byteLength));
+
+        offset += 46 + nameLength + extraLength;
+    }
+
+    return files;
+}
+
+TEST_CASE("Test writing to memory sink", "[OutputSink]")
+{
+    MemorySink sink;
+
+    TileWriter tile;
+    tile.addString("b3dm");
+    tile.addPadding(4, 0);
+    sink.write(std::filesystem::path("Tiles") / "N32" / "tile.b3dm", tile);
+    sink.write("tileset.json", std::string("{}"));
+    sink.write("empty.bin", nullptr, 0);
+
+    REQUIRE(sink.getFiles().size() == 3);
+    REQUIRE(*sink.find("Tiles/N32/tile.b3dm") == std::vector<uint8_t>{'b', '3', 'd', 'm', 0, 0, 0, 0});
+    REQUIRE(*sink.find("tileset.json") == std::vector<uint8_t>{'{', '}'});
+    REQUIRE(sink.find("empty.bin")->empty());
+    REQUIRE(sink.find("missing.json") == nullptr);
+
+    // writing the same path replaces the content
+    sink.write("tileset.json", std::string("[]"));
+    REQUIRE(sink.getFiles().size() == 3);
+    REQUIRE(*sink.find("tileset.json") == std::vector<uint8_t>{'[', ']'});
+}
+
+TEST_CASE("Test writing to file system sink", "[OutputSink]")
+{
+    std::filesystem::path output = "FileSystemSink";
+    FileSystemSink sink(output);
+    sink.write(std::filesystem::path("Tiles") / "N32" / "tile.json", std::string("{\"tile\":0}"));
+    sink.write("tileset.json", std::string("{}"));
+    sink.close();
+
+    auto tile = readFile(output / "Tiles" / "N32" / "tile.json");
+    REQUIRE(std::string(tile.begin(), tile.end()) == "{\"tile\":0}");
+
+    auto tileset = readFile(output / "tileset.json");
+    REQUIRE(std::string(tileset.begin(), tileset.end()) == "{}");
+
+    std::filesystem::remove_all(output);
+}
+
+TEST_CASE("Test writing to archive sink", "[OutputSink]")
+{
+    std::filesystem::path archivePath = "ArchiveSink.zip";
+
+    {
+        ArchiveSink sink(archivePath);
+        sink.write(std::filesystem::path("Tiles") / "N32" / "tile.b3dm", std::string("tile content"));
+        sink.write("tileset.json", std::string("{\"old\":true}"));
+        sink.write("tileset.json", std::string("{}"));
+        sink.close();
+
+        REQUIRE_THROWS(sink.write("late.json", std::string("{}")));
+    }
+
+    auto files = readStoredZip(readFile(archivePath));
+    REQUIRE(files.size() == 2);
+
+    const auto &tile = files["Tiles/N32/tile.b3dm"];
+    REQUIRE(std::string(tile.begin(), tile.end()) == "tile content");
+
+    // the central directory points to the last content written to a path
+    const auto &tileset = files["tileset.json"];
+    REQUIRE(std::string(tileset.begin(), tileset.end()) == "{}");
+
+    std::filesystem::remove(archivePath);
+}
+
+static std::vector<uint8_t> gunzip(const std::vector<uint8_t> &gzip)
+{
+    z_stream stream{};
+    REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+
+    std::vector<uint8_t> content(1 << 20);
+    stream.next_in = const_cast<Bytef *>(gzip.data());
+    stream.avail_in = static_cast<uInt>(gzip.size());
+    stream.next_out = content.data();
+    stream.avail_out = static_cast<uInt>(content.size());
+    REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+    content.resize(stream.total_out);
+    inflateEnd(&stream);
+
+    return content;
+}
+
+TEST_CASE("Test writing to gzip sink", "[OutputSink]")
+{
+    auto memorySink = std::make_unique<MemorySink>();
+    const auto &files = memorySink->getFiles();
+
+    std::string tilesetJson = "{\"root\":{\"children\":[";
+    for (int i = 0; i < 100; ++i) {
+        tilesetJson += "{\"content\":{\"uri\":\"tile_" + std::to_string(i) + ".b3dm\"}},";
+    }
+    tilesetJson += "{}]}}";
+
+    GzipSink sink(std::move(memorySink), 4);
+    sink.write("tileset.json", tilesetJson);
+    for (int i = 0; i < 20; ++i) {
+        TileWriter tile;
+        tile.addString("b3dm");
+        tile.addPadding(1000, 0);
+        sink.write("tile_" + std::to_string(i) + ".b3dm", tile);
+    }
+
+    // images and content that doesn't shrink are written as is
+    sink.write("texture.jpeg", std::string(1000, ' '));
+    sink.write("small.json", std::string("{}"));
+    sink.close();
+
+    REQUIRE(files.size() == 2 * 21 + 2);
+    REQUIRE(files.find("texture.jpeg.gz") == files.end());
+    REQUIRE(files.find("small.json.gz") == files.end());
+
+    const auto &tilesetGzip = files.at("tileset.json.gz");
+    REQUIRE(tilesetGzip.size() < tilesetJson.size());
+    REQUIRE(gunzip(tilesetGzip) == std::vector<uint8_t>(tilesetJson.begin(), tilesetJson.end()));
+    for (int i = 0; i < 20; ++i) {
+        auto tilePath = "tile_" + std::to_string(i) + ".b3dm";
+        REQUIRE(gunzip(files.at(tilePath + ".gz")) == files.at(tilePath));
+    }
+}
+
+TEST_CASE("Test gzip sink never leaves a stale copy", "[OutputSink]")
+{
+    auto memorySink = std::make_unique<MemorySink>();
+    const auto &files = memorySink->getFiles();
+
+    std::string subtree(1000, 's');
+    std::string tilesetJson = "{\"asset\":\"" + std::string(1000, 'a') + "\"}";
+
+    GzipSink sink(std::move(memorySink), 4);
+    sink.write("Tiles/0.0.0.subtree", subtree);
+    sink.write("tileset.json", tilesetJson);
+    sink.write("removed.json", tilesetJson);
+    sink.write("tileset.json", std::string("{}"));
+    sink.remove("removed.json");
+    sink.close();
+
+    // content that doesn't shrink anymore drops the copy of its previous version
+    REQUIRE(files.size() == 3);
+    REQUIRE(gunzip(files.at("Tiles/0.0.0.subtree.gz")) == std::vector<uint8_t>(subtree.begin(), subtree.end()));
+    REQUIRE(files.at("tileset.json") == std::vector<uint8_t>{'{', '}'});
+    REQUIRE(files.find("tileset.json.gz") == files.end());
+    REQUIRE(files.find("removed.json.gz") == files.end());
+}
+
+TEST_CASE("Test writing compressed entries to archive sink", "[OutputSink]")
+{
+    std::filesystem::path archivePath = "CompressedArchiveSink.3tz";
+    std::string tilesetJson = "{\"asset\":\"" + std::string(1000, 'a') + "\"}";
+    std::string texture(1000, 't');
+
+    {
+        ArchiveSink sink(archivePath, true);
+        sink.setCompressEntries(true);
+        sink.write("tileset.json", tilesetJson);
+        sink.write("Tiles/0.0.0.subtree", std::string("{}"));
+        sink.write("Tiles/texture.jpeg", texture);
+        sink.write("removed.json", tilesetJson);
+        sink.remove("removed.json");
+    }
+
+    // deflated entries are smaller, and content that doesn't shrink or isn't a tile stays stored
+    auto zipSize = std::filesystem::file_size(archivePath);
+    REQUIRE(zipSize < tilesetJson.size() + texture.size());
+    REQUIRE(zipSize > texture.size());
+
+    ZipArchive archive(archivePath);
+    REQUIRE(archive.getEntryNames().size() == 4);
+    REQUIRE(archive.readEntry("tileset.json") == tilesetJson);
+    REQUIRE(archive.readEntry("Tiles/0.0.0.subtree") == std::string("{}"));
+    REQUIRE(archive.readEntry("Tiles/texture.jpeg") == texture);
+    REQUIRE(archive.contains(ArchiveSink::TILES_INDEX_NAME));
+    REQUIRE(!archive.contains("removed.json"));
+    REQUIRE(!archive.contains("tileset.json.gz"));
+
+    std::filesystem::remove(archivePath);
+}
+
+TEST_CASE("Test MD5 hash", "[OutputSink]")
+{
+    REQUIRE(MD5::toHex(MD5::hash("")) == "d41d8cd98f00b204e9800998ecf8427e");
+    REQUIRE(MD5::toHex(MD5::hash("abc")) == "900150983cd24fb0d6963f7d28e17f72");
+    REQUIRE(MD5::toHex(MD5::hash("The quick brown fox jumps over the lazy dog"))
+            == "9e107d9d372bb6826bd81d3542a419d6");
+
+    // hashing in chunks that straddle the 64 bytes blocks gives the same digest
+    std::string message(1000, 'a');
+    MD5 md5;
+    for (size_t offset = 0; offset < message.size(); offset += 37) {
+        size_t chunkLength = std::min<size_t>(37, message.size() - offset);
+        md5.update(reinterpret_cast<const uint8_t *>(message.data() + offset), chunkLength);
+    }
+
+    REQUIRE(md5.finalize() == MD5::hash(message));
+    REQUIRE(MD5::toHex(MD5::hash(message)) == "cabe45dcc9ae5b66ba86600cca6b8ba8");
+}
+
+TEST_CASE("Test writing to archive sink with 3D Tiles index", "[OutputSink]")
+{
+    std::filesystem::path archivePath = "ArchiveSink.3tz";
+
+    std::vector<std::string> names{"tileset.json", "Tiles/N32/W118/Elevation/1_1/tileset.json"};
+    for (int i = 0; i < 20; ++i) {
+        names.emplace_back("Tiles/N32/W118/Elevation/1_1/tile_" + std::to_string(i) + ".b3dm");
+    }
+
+    {
+        ArchiveSink sink(archivePath, true);
+        for (const auto &name : names) {
+            sink.write(name, name);
+        }
+    }
+
+    auto zip = readFile(archivePath);
+    auto files = readStoredZip(zip);
+    REQUIRE(files.size() == names.size() + 1);
+
+    // every entry of the index points to the local header of the file with the same hash
+    const auto &index = files[ArchiveSink::TILES_INDEX_NAME];
+    REQUIRE(index.size() == names.size() * 24);
+
+    std::map<std::array<uint8_t, 16>, std::string> hashToName;
+    for (const auto &name : names) {
+        hashToName[MD5::hash(name)] = name;
+    }
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::array<uint8_t, 16> hash;
+        std::copy(index.begin() + static_cast<long>(i * 24),
+                  index.begin() + static_cast<long>(i * 24 + 16),
+                  hash.begin());
+        REQUIRE(hashToName.find(hash) != hashToName.end());
+        const auto &name = hashToName[hash];
+
+        auto localHeaderOffset = readLittleEndian<uint64_t>(index, i * 24 + 16);
+        REQUIRE(readLittleEndian<uint32_t>(zip, localHeaderOffset) == 0x04034b50);
+        uint16_t nameLength = readLittleEndian<uint16_t>(zip, localHeaderOffset + 26);
+        REQUIRE(std::string(zip.begin() + static_cast<long>(localHeaderOffset + 30),
+                            zip.begin() + static_cast<long>(localHeaderOffset + 30 + nameLength))
+                == name);
+
+        // the index is sorted by the hash read as two little endian 64 bits integers
+        if (i > 0) {
+            auto previous = std::make_pair(readLittleEndian<uint64_t>(index, (i - 1) * 24),
+                                           readLittleEndian<uint64_t>(index, (i - 1) * 24 + 8));
+            auto current = std::make_pair(readLittleEndian<uint64_t>(index, i * 24),
+                                          readLittleEndian<uint64_t>(index, i * 24 + 8));
+            REQUIRE(previous < current);
+        }
+    }
+
+    std::filesystem::remove(archivePath);
+}
+
+TEST_CASE("Test converter writes a root tileset to 3tz archives", "[OutputSink]")
+{
+    std::filesystem::path input = dataPath / "CombineTilesets";
+    std::filesystem::path output = "CombineTilesets.3tz";
+
+    Converter converter(input, output);
+    converter.convert();
+
+    ZipArchive archive(output);
+    auto tilesetJson = archive.readEntry("tileset.json");
+    REQUIRE(tilesetJson);
+
+    // the root refers to every combined dataset tileset of the archive
+    auto json = nlohmann::json::parse(*tilesetJson);
+    const auto &children = json["root"]["children"];
+    REQUIRE(!children.empty());
+    for (const auto &child : children) {
+        REQUIRE(archive.contains(child["content"]["uri"].get<std::string>()));
+    }
+
+    std::filesystem::remove(output);
+}
+
+TEST_CASE("Test converter deflates 3tz entries instead of writing gzip copies", "[OutputSink]")
+{
+    std::filesystem::path input = dataPath / "CombineTilesets";
+    std::filesystem::path output = "CombineTilesetsGzip.3tz";
+
+    Converter converter(input, output);
+    converter.setGzipOutput(true);
+    converter.convert();
+
+    ZipArchive archive(output);
+    REQUIRE(archive.readEntry("tileset.json"));
+    for (const auto &name : archive.getEntryNames()) {
+        REQUIRE(std::filesystem::path(name).extension() != ".gz");
+    }
+
+    std::filesystem::remove(output);
+}
+
+TEST_CASE("Test converter writes the same output to memory and file system", "[OutputSink]")
+{
+    std::filesystem::path input = dataPath / "CombineTilesets";
+    std::filesystem::path output = "MemorySinkCombineTilesets";
+
+    auto memorySink = std::make_unique<MemorySink>();
+    const auto &memoryFiles = memorySink->getFiles();
+    auto memoryConverter = createConverter(input, std::move(memorySink));
+    memoryConverter->convert();
+    REQUIRE(!std::filesystem::exists(output));
+
+    Converter fileSystemConverter(input, output);
+    fileSystemConverter.convert();
+
+    size_t fileCount = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(output)) {
+        if (entry.is_regular_file()) {
+            auto relativePath = std::filesystem::relative(entry.path(), output).generic_string();
+            auto memoryFile = memoryFiles.find(relativePath);
+            REQUIRE(memoryFile != memoryFiles.end());
+            REQUIRE(memoryFile->second == readFile(entry.path()));
+            ++fileCount;
+        }
+    }
+
+    REQUIRE(fileCount > 0);
+    REQUIRE(fileCount == memoryFiles.size());
+
+    std::filesystem::remove_all(output);
+}
+
+TEST_CASE("Test converter deduplicates identical content", "[OutputSink]")
+{
+    std::filesystem::path input = dataPath / "GTModels";
+
+    auto sink = std::make_unique<MemorySink>();
+    const auto &files = sink->getFiles();
+    auto converter = createConverter(input, std::move(sink));
+    converter->setDeduplicateContent(true);
+    converter->convert();
+
+    auto duplicateSink = std::make_unique<MemorySink>();
+    const auto &duplicateFiles = duplicateSink->getFiles();
+    auto duplicateConverter = createConverter(input, std::move(duplicateSink));
+    duplicateConverter->convert();
+
+    REQUIRE(files.size() <= duplicateFiles.size());
+
+    // textures and models are written once, tiles and tilesets are unchanged
+    std::set<std::vector<uint8_t>> textures;
+    for (const auto &file : files) {
+        auto extension = std::filesystem::path(file.first).extension();
+        if (extension == ".b3dm" || extension == ".cmpt" || extension == ".json") {
+            REQUIRE(duplicateFiles.find(file.first) != duplicateFiles.end());
+        } else if (extension != ".glb") {
+            REQUIRE(textures.insert(file.second).second);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#include "ThreadPool.h"
+#include "catch2/catch.hpp"
+#include <atomic>
+#include <stdexcept>
+
+using namespace CDBTo3DTiles;
+
+TEST_CASE("Test running tasks on thread pool", "[ThreadPool]")
+{
+    ThreadPool threadPool(4, 2);
+    REQUIRE(threadPool.getThreadCount() == 4);
+
+    std::atomic<int> sum{0};
+    for (int i = 1; i <= 1000; ++i) {
+        threadPool.enqueue([&sum, i]() { sum += i; });
+    }
+
+    threadPool.wait();
+    REQUIRE(sum == 500500);
+
+    // the pool can be reused after waiting
+    threadPool.enqueue([&sum]() { sum = 0; });
+    threadPool.wait();
+    REQUIRE(sum == 0);
+}
+
+TEST_CASE("Test thread pool rethrows task exception", "[ThreadPool]")
+{
+    ThreadPool threadPool(2);
+
+    std::atomic<int> count{0};
+    threadPool.enqueue([]() { throw std::runtime_error("task failed"); });
+    for (int i = 0; i < 10; ++i) {
+        threadPool.enqueue([&count]() { ++count; });
+    }
+
+    REQUIRE_THROWS_AS(threadPool.wait(), std::runtime_error);
+    REQUIRE(count == 10);
+
+    // the exception is only reported once
+    REQUIRE_NOTHROW(threadPool.wait());
+}
+
+TEST_CASE("Test thread pool finishes queued tasks on destruction", "[ThreadPool]")
+{
+    std::atomic<int> count{0};
+    {
+        ThreadPool threadPool(1);
+        for (int i = 0; i < 100; ++i) {
+            threadPool.enqueue([&count]() { ++count; });
+        }
+    }
+
+    REQUIRE(count == 100);
+}
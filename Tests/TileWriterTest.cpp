@@ -0,0 +1,133 @@
+#include "TileFormatIO.h"
+#include "TileWriter.h"
+#include "catch2/catch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace CDBTo3DTiles;
+
+static tinygltf::Model createSimpleGltf()
+{
+    tinygltf::Model gltf;
+    gltf.asset.version = "2.0";
+
+    tinygltf::Buffer buffer;
+    buffer.data = {1, 2, 3, 4, 5};
+    gltf.buffers.emplace_back(buffer);
+
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteLength = buffer.data.size();
+    gltf.bufferViews.emplace_back(bufferView);
+    return gltf;
+}
+
+TEST_CASE("Test assembling tile segments", "[TileWriter]")
+{
+    TileWriter tile;
+    tile.addString("abc");
+    tile.addPadding(5, ' ');
+    tile.addBuffer({1, 2, 3});
+    tile.addPadding(10, 0);
+    tile.addString("");
+
+    SECTION("Test byte length is known before writing")
+    {
+        REQUIRE(tile.getByteLength() == 21);
+
+        size_t segmentsByteLength = 0;
+        for (const auto &segment : tile.getSegments()) {
+            REQUIRE(segment.byteLength > 0);
+            segmentsByteLength += segment.byteLength;
+        }
+        REQUIRE(segmentsByteLength == tile.getByteLength());
+    }
+
+    SECTION("Test writing to buffer and stream gives the same content")
+    {
+        std::vector<uint8_t> expected{'a', 'b', 'c', ' ', ' ', ' ', ' ', ' ', 1, 2, 3};
+        expected.resize(21, 0);
+        REQUIRE(tile.toBuffer() == expected);
+
+        std::stringstream ss;
+        tile.write(ss);
+        std::string streamContent = ss.str();
+        REQUIRE(std::vector<uint8_t>(streamContent.begin(), streamContent.end()) == expected);
+    }
+
+    SECTION("Test appending a tile takes over its storage")
+    {
+        TileWriter other;
+        other.addString(std::string(100, 'x'));
+        other.addBuffer(std::vector<uint8_t>(50, 7));
+
+        tile.addTile(std::move(other));
+        REQUIRE(tile.getByteLength() == 171);
+
+        auto buffer = tile.toBuffer();
+        REQUIRE(buffer[21] == 'x');
+        REQUIRE(buffer[120] == 'x');
+        REQUIRE(buffer[121] == 7);
+        REQUIRE(buffer[170] == 7);
+    }
+}
+
+TEST_CASE("Test creating tile formats", "[TileWriter]")
+{
+    SECTION("Test b3dm header matches assembled size")
+    {
+        auto gltf = createSimpleGltf();
+        TileWriter b3dm = createB3DM(gltf, nullptr);
+        REQUIRE(b3dm.getByteLength() % 8 == 0);
+
+        auto buffer = b3dm.toBuffer();
+        B3dmHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        REQUIRE(std::string(header.magic, 4) == "b3dm");
+        REQUIRE(header.version == 1);
+        REQUIRE(header.byteLength == buffer.size());
+        REQUIRE((sizeof(header) + header.featureTableJsonByteLength) % 8 == 0);
+        REQUIRE(header.featureTableBinByteLength == 0);
+        REQUIRE(header.batchTableJsonByteLength == 0);
+        REQUIRE(header.batchTableBinByteLength == 0);
+
+        std::string featureTable(reinterpret_cast<const char *>(buffer.data()) + sizeof(header),
+                                 header.featureTableJsonByteLength);
+        REQUIRE(featureTable.find("{\"BATCH_LENGTH\":0}") == 0);
+
+        size_t glbOffset = sizeof(header) + header.featureTableJsonByteLength;
+        REQUIRE(std::string(reinterpret_cast<const char *>(buffer.data()) + glbOffset, 4) == "glTF");
+
+        uint32_t glbByteLength;
+        std::memcpy(&glbByteLength, buffer.data() + glbOffset + 8, sizeof(uint32_t));
+        REQUIRE(glbOffset + glbByteLength <= buffer.size());
+        REQUIRE(buffer.size() - (glbOffset + glbByteLength) < 8);
+    }
+
+    SECTION("Test cmpt header counts inner tiles")
+    {
+        auto firstGltf = createSimpleGltf();
+        auto secondGltf = createSimpleGltf();
+        std::vector<TileWriter> tiles;
+        tiles.emplace_back(createB3DM(firstGltf, nullptr));
+        tiles.emplace_back(createB3DM(secondGltf, nullptr));
+        size_t innerByteLength = tiles[0].getByteLength();
+        auto innerTile = tiles[0].toBuffer();
+
+        TileWriter cmpt = createCMPT(std::move(tiles));
+        REQUIRE(cmpt.getByteLength() == sizeof(CmptHeader) + 2 * innerByteLength);
+
+        auto buffer = cmpt.toBuffer();
+        CmptHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        REQUIRE(std::string(header.magic, 4) == "cmpt");
+        REQUIRE(header.version == 1);
+        REQUIRE(header.titleLength == 2);
+        REQUIRE(header.byteLength == buffer.size());
+        REQUIRE(std::equal(innerTile.begin(), innerTile.end(), buffer.begin() + sizeof(header)));
+        REQUIRE(std::equal(innerTile.begin(),
+                           innerTile.end(),
+                           buffer.begin() + sizeof(header) + innerByteLength));
+    }
+}
@@ -0,0 +1,110 @@
+#include "Config.h"
+#include "OutputSink.h"
+#include "ZipArchive.h"
+#include "catch2/catch.hpp"
+#include <fstream>
+
+using namespace CDBTo3DTiles;
+
+TEST_CASE("Test reading stored zip archive", "[ZipArchive]")
+{
+    std::filesystem::path archivePath = "ZipArchive.zip";
+
+    {
+        ArchiveSink sink(archivePath);
+        sink.write(std::filesystem::path("Tiles") / "N32" / "tile.b3dm", std::string("tile content"));
+        sink.write("tileset.json", std::string("{}"));
+        sink.write("empty.json", std::string());
+        sink.close();
+    }
+
+    {
+        ZipArchive archive(archivePath);
+        REQUIRE(archive.getEntryNames()
+                == std::vector<std::string>{"Tiles/N32/tile.b3dm", "tileset.json", "empty.json"});
+        REQUIRE(archive.contains("tileset.json"));
+        REQUIRE(!archive.contains("/tileset.json"));
+        REQUIRE(*archive.readEntry("Tiles/N32/tile.b3dm") == "tile content");
+        REQUIRE(*archive.readEntry("tileset.json") == "{}");
+        REQUIRE(archive.readEntry("empty.json")->empty());
+        REQUIRE(archive.readEntry("missing.json") == std::nullopt);
+    }
+
+    std::filesystem::remove(archivePath);
+}
+
+TEST_CASE("Test reading deflated zip archive", "[ZipArchive]")
+{
+    std::filesystem::path archivePath = dataPath / "GSModelsWithGSModelTexture" / "Tiles" / "N32" / "W118"
+                                        / "301_GSModelTexture" / "L00" / "U0"
+                                        / "N32W118_D301_S001_T001_L00_U0_R0.zip";
+
+    ZipArchive archive(archivePath);
+    REQUIRE(archive.getEntryNames().size() == 2);
+    REQUIRE(archive.getEntryNames()[0] == "N32W118_D301_S001_T001_L00_U0_R0_roof_tiled1.rgb");
+    REQUIRE(archive.getEntryNames()[1] == "N32W118_D301_S001_T001_L00_U0_R0_salmon_3_story_0_scale.rgb");
+
+    // the crc of every entry is checked after inflating it
+    auto roof = archive.readEntry("N32W118_D301_S001_T001_L00_U0_R0_roof_tiled1.rgb");
+    REQUIRE(roof);
+    REQUIRE(roof->size() == 197120);
+
+    auto salmon = archive.readEntry("N32W118_D301_S001_T001_L00_U0_R0_salmon_3_story_0_scale.rgb");
+    REQUIRE(salmon);
+    REQUIRE(salmon->size() == 49664);
+}
+
+TEST_CASE("Test opening invalid zip archive", "[ZipArchive]")
+{
+    REQUIRE_THROWS_AS(ZipArchive("NonExistZipArchive.zip"), std::runtime_error);
+
+    std::filesystem::path archivePath = "NotZipArchive.zip";
+    {
+        std::ofstream fs(archivePath, std::ios::binary);
+        fs << "this is not a zip archive, even though it is long enough to have an end record";
+    }
+
+    REQUIRE_THROWS_AS(ZipArchive(archivePath), std::runtime_error);
+    std::filesystem::remove(archivePath);
+}
+
+TEST_CASE("Test reading zip archive entry with an invalid size", "[ZipArchive]")
+{
+    std::filesystem::path archivePath = "InvalidSizeZipArchive.zip";
+    {
+        ArchiveSink sink(archivePath);
+        sink.setCompressEntries(true);
+        sink.write("tileset.json", std::string(4096, ' '));
+        sink.close();
+    }
+
+    // the uncompressed size of the central directory is far beyond what deflate can produce
+    auto setCentralDirectoryByteLength = [&](uint32_t byteLength) {
+        std::fstream fs(archivePath, std::ios::binary | std::ios::in | std::ios::out);
+        std::string archive((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+        size_t headerOffset = archive.find("PK\x01\x02");
+        REQUIRE(headerOffset != std::string::npos);
+
+        uint8_t bytes[4];
+        for (size_t i = 0; i < 4; ++i) {
+            bytes[i] = static_cast<uint8_t>(byteLength >> (8 * i));
+        }
+
+        fs.clear();
+        fs.seekp(static_cast<std::streamoff>(headerOffset + 24));
+        fs.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    };
+
+    {
+        ZipArchive archive(archivePath);
+        REQUIRE(*archive.readEntry("tileset.json") == std::string(4096, ' '));
+    }
+
+    setCentralDirectoryByteLength(0xFFFFFFFE);
+    REQUIRE_THROWS_WITH(ZipArchive(archivePath).readEntry("tileset.json"), Catch::Contains("Invalid size"));
+
+    setCentralDirectoryByteLength(0xFFFFFFFF);
+    REQUIRE_THROWS_WITH(ZipArchive(archivePath).readEntry("tileset.json"), Catch::Contains("Invalid size"));
+
+    std::filesystem::remove(archivePath);
+}